@@ -0,0 +1,17 @@
+@echo off
+set CORE=src/Bus.cpp src/CPU6502.cpp src/CPUJit.cpp src/CPULanes.cpp src/PPU2C02.cpp src/PPUThread.cpp src/PPUCompositor.cpp src/APU2A03.cpp src/Cartridge.cpp src/Mapper*.cpp
+
+echo Building mgkemu.dll...
+g++ -O2 -std=c++17 -shared -DMGK_BUILD_LIBRARY -o mgkemu.dll lib/mgkemu.cpp %CORE% -static-libgcc -static-libstdc++ -Wl,--out-implib,libmgkemu.a
+if %errorlevel% neq 0 goto failed
+
+echo.
+echo Build successful!
+pause
+exit /b 0
+
+:failed
+echo.
+echo Build failed!
+pause
+exit /b 1
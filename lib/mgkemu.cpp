@@ -0,0 +1,407 @@
+#include "mgkemu.h"
+#include "../src/Bus.h"
+#include "../src/Cartridge.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <vector>
+
+struct mgk_emu {
+  std::unique_ptr<Bus> bus;
+  std::shared_ptr<Cartridge> cart;
+
+  // Settings, applied again to the machine of each ROM loaded
+  int nFormat = MGK_FORMAT_RGBA;
+  int nScale = 1;
+  void *pFrame = nullptr; // Caller's frame buffer, if any
+  bool bJit = false;
+  bool bSpriteLimit = true;
+
+  // Audio, sampled and filtered as the SDL frontend does
+  std::vector<float> vAudio; // Used when the caller gives no buffer
+  float *pAudio = nullptr;
+  size_t nAudioCapacity = 0;
+  size_t nAudioCount = 0;
+  double dCyclesPerSample = 0.0; // 0 while audio is off
+  double dSampleCounter = 0.0;
+  double dLastSample = 0.0;
+
+  // mgk_step
+  std::vector<mgk_reward> vRewards;
+  std::vector<int64_t> vLast; // Value of each delta term a frame ago
+  std::vector<mgk_terminal> vTerminals;
+  std::vector<uint8_t> vPool; // The frame before the last, for max_pool
+  // vPool holds the last frame drawn, which the frame buffer no longer does
+  // once pooled or swapped for another
+  bool bKept = false;
+
+  // No frame has been drawn in this format yet, so the one before the next
+  // counts as all zeros and pooling keeps the next as it is
+  void ResetPool() {
+    vPool.assign(FrameSize(), 0);
+    bKept = true;
+  }
+
+  void Clock() {
+    bus->clock();
+    if (dCyclesPerSample == 0.0)
+      return;
+    dSampleCounter += 1.0 / 3.0;
+    if (dSampleCounter >= dCyclesPerSample) {
+      dSampleCounter -= dCyclesPerSample;
+      dLastSample += 0.4 * (bus->GetAudioSample() - dLastSample);
+      if (nAudioCount < nAudioCapacity)
+        pAudio[nAudioCount++] = (float)(dLastSample * 0.5);
+    }
+  }
+
+  void RunFrame() {
+    do
+      Clock();
+    while (!bus->ppu.frame_complete);
+    bus->ppu.frame_complete = false;
+    bKept = false;
+  }
+
+  size_t FrameSize() const {
+    return (size_t)(MGK_WIDTH / nScale) * (MGK_HEIGHT / nScale) *
+           (nFormat == MGK_FORMAT_RGBA ? 4 : 1);
+  }
+
+  // The machine, and where the audio sampling is, so a loaded state plays
+  // on with the same samples
+  void State(SaveState &s) {
+    bus->State(s);
+    if (!s.Failed())
+      s.Values(dSampleCounter, dLastSample);
+  }
+};
+
+static_assert(MGK_FORMAT_RGBA == (int)PPU2C02::OUTPUT_RGBA &&
+                  MGK_FORMAT_INDEX == (int)PPU2C02::OUTPUT_INDEX &&
+                  MGK_FORMAT_GRAY == (int)PPU2C02::OUTPUT_GRAY,
+              "MGK_FORMAT_* are passed on as PPU2C02::OUTPUT");
+
+// Master clocks per CPU cycle
+static const uint32_t CLOCKS_PER_CYCLE = 3;
+
+// NTSC CPU clock
+static const double CPU_FREQ = 1789773.0;
+
+int mgk_version(void) { return MGK_VERSION; }
+
+mgk_emu *mgk_create(void) { return new (std::nothrow) mgk_emu(); }
+
+void mgk_destroy(mgk_emu *emu) { delete emu; }
+
+int mgk_load_rom(mgk_emu *emu, const void *data, size_t size) {
+  if (!emu || !data)
+    return MGK_ERROR_ARGUMENT;
+  auto cart = std::make_shared<Cartridge>((const uint8_t *)data, size);
+  if (!cart->ImageValid())
+    return MGK_ERROR_ROM;
+
+  // A new machine, so nothing of the last ROM carries over
+  emu->bus = std::make_unique<Bus>();
+  emu->cart = cart;
+  Bus &bus = *emu->bus;
+  bus.cpu.bJit = emu->bJit;
+  bus.ppu.bSpriteLimit = emu->bSpriteLimit;
+  bus.ppu.SetOutput((PPU2C02::OUTPUT)emu->nFormat, (uint8_t)emu->nScale,
+                    emu->pFrame);
+  bus.insertCartridge(cart);
+  bus.reset();
+  emu->ResetPool();
+  emu->nAudioCount = 0;
+  emu->dSampleCounter = emu->dLastSample = 0.0;
+  return MGK_OK;
+}
+
+int mgk_reset(mgk_emu *emu) {
+  if (!emu)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  emu->bus->reset();
+  return MGK_OK;
+}
+
+int mgk_set_input(mgk_emu *emu, int port, uint8_t buttons) {
+  if (!emu || port < 0 || port > 1)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  emu->bus->controller[port] = buttons;
+  return MGK_OK;
+}
+
+int mgk_step_frame(mgk_emu *emu) {
+  if (!emu)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  emu->nAudioCount = 0;
+  emu->RunFrame();
+  return MGK_OK;
+}
+
+int mgk_step_cycles(mgk_emu *emu, uint32_t cycles) {
+  if (!emu)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  Bus &bus = *emu->bus;
+  emu->nAudioCount = 0;
+  int nFrames = 0;
+  emu->bKept = false;
+  for (uint64_t i = (uint64_t)cycles * CLOCKS_PER_CYCLE; i > 0; i--) {
+    emu->Clock();
+    if (bus.ppu.frame_complete) {
+      bus.ppu.frame_complete = false;
+      nFrames++;
+    }
+  }
+  return nFrames;
+}
+
+size_t mgk_state_size(mgk_emu *emu) {
+  if (!emu || !emu->bus)
+    return 0;
+  SaveState s(nullptr, 0, false);
+  emu->State(s);
+  return s.Size();
+}
+
+size_t mgk_save_state(mgk_emu *emu, void *buffer, size_t size) {
+  if (!emu || !emu->bus || !buffer)
+    return 0;
+  SaveState s(buffer, size, false);
+  emu->State(s);
+  return s.Good() ? s.Size() : 0;
+}
+
+int mgk_load_state(mgk_emu *emu, const void *buffer, size_t size) {
+  if (!emu || !buffer)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  // Too short a buffer would leave the machine half loaded
+  if (size < mgk_state_size(emu))
+    return MGK_ERROR_STATE;
+  SaveState s(const_cast<void *>(buffer), size, true);
+  emu->State(s);
+  return s.Good() ? MGK_OK : MGK_ERROR_STATE;
+}
+
+uint8_t *mgk_ram(mgk_emu *emu) {
+  if (!emu || !emu->bus)
+    return nullptr;
+  return emu->bus->ram.data();
+}
+
+uint8_t *mgk_framebuffer(mgk_emu *emu) {
+  if (!emu || !emu->bus)
+    return nullptr;
+  return (uint8_t *)emu->bus->ppu.OutputBuffer();
+}
+
+int mgk_set_framebuffer(mgk_emu *emu, void *buffer) {
+  return mgk_set_output(emu, MGK_FORMAT_RGBA, 1, buffer);
+}
+
+int mgk_set_output(mgk_emu *emu, int format, int scale, void *buffer) {
+  if (!emu || format < MGK_FORMAT_RGBA || format > MGK_FORMAT_GRAY ||
+      (scale != 1 && scale != 2 && scale != 4))
+    return MGK_ERROR_ARGUMENT;
+  bool bSameFormat = format == emu->nFormat && scale == emu->nScale;
+  if (bSameFormat && emu->bus && !emu->bKept) {
+    // The last frame stays behind in the old buffer; keep it, so max pooling
+    // goes on into the new one rather than reading what that held before
+    const uint8_t *p = (const uint8_t *)emu->bus->ppu.OutputBuffer();
+    emu->vPool.assign(p, p + emu->FrameSize());
+    emu->bKept = true;
+  }
+  emu->nFormat = format;
+  emu->nScale = scale;
+  if (!bSameFormat)
+    emu->ResetPool();
+  emu->pFrame = buffer;
+  if (emu->bus)
+    emu->bus->ppu.SetOutput((PPU2C02::OUTPUT)format, (uint8_t)scale, buffer);
+  return MGK_OK;
+}
+
+int mgk_set_audio(mgk_emu *emu, float *buffer, size_t capacity,
+                  int sample_rate) {
+  if (!emu || sample_rate < 0 || (sample_rate > 0 && capacity == 0))
+    return MGK_ERROR_ARGUMENT;
+  if (sample_rate == 0) {
+    emu->dCyclesPerSample = 0.0;
+    emu->nAudioCapacity = 0;
+  } else {
+    if (!buffer) {
+      emu->vAudio.assign(capacity, 0.0f);
+      buffer = emu->vAudio.data();
+    }
+    emu->pAudio = buffer;
+    emu->nAudioCapacity = capacity;
+    emu->dCyclesPerSample = CPU_FREQ / sample_rate;
+  }
+  emu->nAudioCount = 0;
+  return MGK_OK;
+}
+
+const float *mgk_audio(mgk_emu *emu, size_t *count) {
+  if (count)
+    *count = emu ? emu->nAudioCount : 0;
+  return emu ? emu->pAudio : nullptr;
+}
+
+int mgk_set_option(mgk_emu *emu, int option, int value) {
+  if (!emu)
+    return MGK_ERROR_ARGUMENT;
+  switch (option) {
+  case MGK_OPTION_JIT:
+    emu->bJit = value != 0;
+    if (emu->bus)
+      emu->bus->cpu.bJit = emu->bJit;
+    return MGK_OK;
+  case MGK_OPTION_SPRITE_LIMIT:
+    emu->bSpriteLimit = value != 0;
+    if (emu->bus)
+      emu->bus->ppu.bSpriteLimit = emu->bSpriteLimit;
+    return MGK_OK;
+  }
+  return MGK_ERROR_ARGUMENT;
+}
+
+static bool ValidValue(const mgk_value &v) {
+  uint32_t nEnd = (uint32_t)v.address + v.size;
+  bool bRAM = nEnd <= 0x2000;
+  bool bPRGRAM = v.address >= 0x6000 && nEnd <= 0x8000;
+  return v.size >= 1 && v.size <= 8 && (bRAM || bPRGRAM);
+}
+
+static int64_t ReadValue(Bus &bus, const mgk_value &v) {
+  // Most significant byte first
+  bool bBig = v.flags & MGK_VALUE_BIG_ENDIAN;
+  uint64_t n = 0;
+  for (int i = 0; i < v.size; i++) {
+    uint8_t b = bus.read(v.address + (bBig ? i : v.size - 1 - i), true);
+    if (v.flags & MGK_VALUE_BCD)
+      n = n * 100 + (b >> 4) * 10 + (b & 0x0F);
+    else if (v.flags & MGK_VALUE_DIGITS)
+      n = n * 10 + b;
+    else
+      n = n << 8 | b;
+  }
+  if ((v.flags & (MGK_VALUE_SIGNED | MGK_VALUE_BCD | MGK_VALUE_DIGITS)) ==
+          MGK_VALUE_SIGNED &&
+      v.size < 8 && (n >> (v.size * 8 - 1)) & 1)
+    n |= ~0ull << (v.size * 8);
+  return (int64_t)n;
+}
+
+static bool Compare(int64_t a, int nCompare, int64_t b) {
+  switch (nCompare) {
+  case MGK_EQ:
+    return a == b;
+  case MGK_NE:
+    return a != b;
+  case MGK_LT:
+    return a < b;
+  case MGK_LE:
+    return a <= b;
+  case MGK_GT:
+    return a > b;
+  case MGK_GE:
+    return a >= b;
+  }
+  return false;
+}
+
+int mgk_set_rewards(mgk_emu *emu, const mgk_reward *rewards, size_t count) {
+  if (!emu || (count > 0 && !rewards))
+    return MGK_ERROR_ARGUMENT;
+  for (size_t i = 0; i < count; i++)
+    if (!ValidValue(rewards[i].value))
+      return MGK_ERROR_ARGUMENT;
+  emu->vRewards.assign(rewards, rewards + count);
+  emu->vLast.assign(count, 0);
+  return MGK_OK;
+}
+
+int mgk_set_terminals(mgk_emu *emu, const mgk_terminal *terminals,
+                      size_t count) {
+  if (!emu || (count > 0 && !terminals))
+    return MGK_ERROR_ARGUMENT;
+  for (size_t i = 0; i < count; i++)
+    if (!ValidValue(terminals[i].value) || terminals[i].compare < MGK_EQ ||
+        terminals[i].compare > MGK_GE)
+      return MGK_ERROR_ARGUMENT;
+  emu->vTerminals.assign(terminals, terminals + count);
+  return MGK_OK;
+}
+
+int mgk_step(mgk_emu *emu, uint8_t buttons, int frames, int max_pool,
+             mgk_step_result *result) {
+  if (!emu || frames < 1)
+    return MGK_ERROR_ARGUMENT;
+  if (!emu->bus)
+    return MGK_ERROR_NO_ROM;
+  Bus &bus = *emu->bus;
+  bus.controller[0] = buttons;
+  emu->nAudioCount = 0;
+
+  // Deltas count from where this step starts
+  for (size_t i = 0; i < emu->vRewards.size(); i++)
+    if (emu->vRewards[i].delta)
+      emu->vLast[i] = ReadValue(bus, emu->vRewards[i].value);
+
+  double dReward = 0.0;
+  int nFrames = 0;
+  int nTerminal = 0;
+  uint8_t *pFrame = (uint8_t *)bus.ppu.OutputBuffer();
+  size_t nFrameSize = emu->FrameSize();
+  while (nFrames < frames && !nTerminal) {
+    // With terminal predicates any frame may turn out to be the last. The
+    // frame before this step's first is kept from the last pooling.
+    bool bKeep = nFrames == frames - 1 || !emu->vTerminals.empty();
+    if (max_pool && bKeep && !(nFrames == 0 && emu->bKept))
+      emu->vPool.assign(pFrame, pFrame + nFrameSize);
+    emu->RunFrame();
+    nFrames++;
+
+    for (size_t i = 0; i < emu->vRewards.size(); i++) {
+      const mgk_reward &r = emu->vRewards[i];
+      int64_t n = ReadValue(bus, r.value);
+      if (r.delta) {
+        dReward += (double)r.scale * (double)(n - emu->vLast[i]);
+        emu->vLast[i] = n;
+      } else {
+        dReward += (double)r.scale * (double)n;
+      }
+    }
+    for (size_t i = 0; i < emu->vTerminals.size() && !nTerminal; i++) {
+      const mgk_terminal &t = emu->vTerminals[i];
+      if (Compare(ReadValue(bus, t.value), t.compare, t.operand))
+        nTerminal = (int)i + 1;
+    }
+  }
+
+  if (max_pool) {
+    for (size_t i = 0; i < nFrameSize; i++) {
+      uint8_t nLast = pFrame[i];
+      pFrame[i] = std::max(nLast, emu->vPool[i]);
+      emu->vPool[i] = nLast;
+    }
+    emu->bKept = true;
+  }
+
+  if (result) {
+    result->reward = (float)dReward;
+    result->frames = nFrames;
+    result->terminal = nTerminal;
+  }
+  return MGK_OK;
+}
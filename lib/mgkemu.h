@@ -0,0 +1,187 @@
+/* libmgkemu: the emulator core behind a C interface, for use from other
+ * processes and languages.
+ *
+ * Every function takes the instance it works on; instances share nothing,
+ * so different ones may be used from different threads. Pointers returned
+ * for RAM, the frame buffer and audio stay valid until the instance is
+ * destroyed or another ROM is loaded.
+ *
+ * The frame buffer and audio buffer may be supplied by the caller, in which
+ * case the core writes into them directly and nothing is copied.
+ */
+#ifndef MGKEMU_H
+#define MGKEMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(MGK_BUILD_LIBRARY)
+#define MGK_API __declspec(dllexport)
+#else
+#define MGK_API __declspec(dllimport)
+#endif
+#else
+#define MGK_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped when a function or the state layout changes */
+#define MGK_VERSION 2
+
+typedef struct mgk_emu mgk_emu;
+
+/* Controller buttons, or'ed together for mgk_set_input */
+enum {
+  MGK_BUTTON_RIGHT = 0x01,
+  MGK_BUTTON_LEFT = 0x02,
+  MGK_BUTTON_DOWN = 0x04,
+  MGK_BUTTON_UP = 0x08,
+  MGK_BUTTON_START = 0x10,
+  MGK_BUTTON_SELECT = 0x20,
+  MGK_BUTTON_B = 0x40,
+  MGK_BUTTON_A = 0x80
+};
+
+/* Return codes */
+enum {
+  MGK_OK = 0,
+  MGK_ERROR_ARGUMENT = -1, /* Bad pointer, size or value */
+  MGK_ERROR_ROM = -2,      /* Not an iNES image, or an unsupported mapper */
+  MGK_ERROR_NO_ROM = -3,   /* No ROM loaded yet */
+  MGK_ERROR_STATE = -4     /* State too short, or of another ROM or version */
+};
+
+/* Options for mgk_set_option */
+enum {
+  MGK_OPTION_JIT = 0,         /* Block translator on x86-64 hosts (0/1) */
+  MGK_OPTION_SPRITE_LIMIT = 1 /* 8 sprites per line (1, default) or all (0) */
+};
+
+/* Frame buffer size, in pixels of 4 bytes (R, G, B, A) */
+#define MGK_WIDTH 256
+#define MGK_HEIGHT 240
+
+/* Frame formats for mgk_set_output */
+enum {
+  MGK_FORMAT_RGBA = 0,  /* 4 bytes per pixel */
+  MGK_FORMAT_INDEX = 1, /* NES colour, 0-63 */
+  MGK_FORMAT_GRAY = 2   /* Luma, 0-255 */
+};
+
+MGK_API int mgk_version(void);
+
+MGK_API mgk_emu *mgk_create(void);
+MGK_API void mgk_destroy(mgk_emu *emu);
+
+/* Load an iNES image from memory, which may be freed afterwards, and reset */
+MGK_API int mgk_load_rom(mgk_emu *emu, const void *data, size_t size);
+MGK_API int mgk_reset(mgk_emu *emu);
+
+/* Buttons held on controller port 0 or 1 */
+MGK_API int mgk_set_input(mgk_emu *emu, int port, uint8_t buttons);
+
+/* Run until the next frame is complete */
+MGK_API int mgk_step_frame(mgk_emu *emu);
+/* Run for a number of CPU cycles; returns the frames completed, or an error */
+MGK_API int mgk_step_cycles(mgk_emu *emu, uint32_t cycles);
+
+/* Bytes a saved state of the loaded ROM takes, 0 without a ROM */
+MGK_API size_t mgk_state_size(mgk_emu *emu);
+/* Returns the bytes written, 0 if the buffer is too short */
+MGK_API size_t mgk_save_state(mgk_emu *emu, void *buffer, size_t size);
+/* The machine is left unchanged when the state is rejected */
+MGK_API int mgk_load_state(mgk_emu *emu, const void *buffer, size_t size);
+
+/* The 2KB of CPU RAM, writable */
+MGK_API uint8_t *mgk_ram(mgk_emu *emu);
+
+/* The frame buffer the PPU draws into, in the format set (RGBA at full
+ * size by default) */
+MGK_API uint8_t *mgk_framebuffer(mgk_emu *emu);
+/* Draw full RGBA frames into the caller's buffer of MGK_WIDTH * MGK_HEIGHT
+ * * 4 bytes from now on, or into the internal one again if buffer is NULL */
+MGK_API int mgk_set_framebuffer(mgk_emu *emu, void *buffer);
+/* Draw frames of another format or scale (1, 2 or 4) instead, of
+ * MGK_WIDTH / scale * MGK_HEIGHT / scale pixels. Scaled frames average each
+ * block of pixels, except index frames, which take its top-left pixel.
+ * Pixels are converted as they are drawn and no full RGBA frame is kept.
+ * With a NULL buffer the core allocates one. Between frames the buffer
+ * alone may be changed, so each step can draw into a buffer of its own. */
+MGK_API int mgk_set_output(mgk_emu *emu, int format, int scale, void *buffer);
+
+/* Mono audio at sample_rate, up to capacity samples per step; further
+ * samples are dropped. With a NULL buffer the core allocates one. A
+ * sample_rate of 0 turns audio off (the default). */
+MGK_API int mgk_set_audio(mgk_emu *emu, float *buffer, size_t capacity,
+                          int sample_rate);
+/* Samples written by the last step */
+MGK_API const float *mgk_audio(mgk_emu *emu, size_t *count);
+
+MGK_API int mgk_set_option(mgk_emu *emu, int option, int value);
+
+/* Stepping for agents: one call runs several frames with the same input,
+ * scores them from RAM and stops at a terminal state, so the caller is not
+ * entered between frames. */
+
+/* A number in CPU RAM ($0000-$1FFF) or PRG RAM ($6000-$7FFF) */
+typedef struct mgk_value {
+  uint16_t address; /* First byte */
+  uint8_t size;     /* Bytes, 1-8 */
+  uint8_t flags;    /* MGK_VALUE_* */
+} mgk_value;
+
+enum {
+  MGK_VALUE_BIG_ENDIAN = 0x01, /* The first byte is the most significant */
+  MGK_VALUE_BCD = 0x02,        /* Two decimal digits per byte */
+  MGK_VALUE_DIGITS = 0x04,     /* One decimal digit per byte (0-9) */
+  MGK_VALUE_SIGNED = 0x08      /* Two's complement, for binary values */
+};
+
+/* Reward terms, summed every frame */
+typedef struct mgk_reward {
+  mgk_value value;
+  float scale; /* Reward per unit */
+  int delta;   /* Nonzero: the change since the frame before, not the value */
+} mgk_reward;
+
+/* Comparisons for terminal predicates */
+enum { MGK_EQ, MGK_NE, MGK_LT, MGK_LE, MGK_GT, MGK_GE };
+
+/* A state is terminal when any predicate holds */
+typedef struct mgk_terminal {
+  mgk_value value;
+  int compare; /* value <compare> operand */
+  int64_t operand;
+} mgk_terminal;
+
+typedef struct mgk_step_result {
+  float reward; /* Sum over the frames run */
+  int frames;   /* Frames run, fewer than asked when a terminal state ends */
+  int terminal; /* 1 + index of the predicate that held, 0 if none did */
+} mgk_step_result;
+
+/* Replace the reward terms or terminal predicates (count 0 clears them).
+ * The arrays are copied. */
+MGK_API int mgk_set_rewards(mgk_emu *emu, const mgk_reward *rewards,
+                            size_t count);
+MGK_API int mgk_set_terminals(mgk_emu *emu, const mgk_terminal *terminals,
+                              size_t count);
+
+/* Hold buttons on port 0 for up to frames frames. With max_pool set, the
+ * frame buffer ends up holding the per-byte maximum of the last two frames,
+ * so sprites that flicker on alternate frames are seen, also when the
+ * buffer was changed since the last step. The first frame after loading a
+ * ROM or changing the format has none before it and is kept as drawn.
+ * Audio covers all the frames run. */
+MGK_API int mgk_step(mgk_emu *emu, uint8_t buttons, int frames, int max_pool,
+                     mgk_step_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+// Shared memory server (Linux, see mgkshm.h)
+//
+// Runs one emulator instance and answers the requests clients put into its
+// region until one asks it to quit.
+//
+// Usage: mgkshm <rom> <name> [--format rgba|index|gray] [--scale N]
+//                            [--slots N] [--jit] [--force]
+//   name        shared memory object, e.g. /mgk0
+//   --format    frame format (default gray)
+//   --scale     1, 2 or 4 (default 2)
+//   --slots     requests that may be in flight, a power of two (default 8)
+//   --jit       enable the block translator
+//   --force     replace an object of that name, such as one a killed server
+//               left behind; without it the server refuses to start
+
+#include "mgkshm.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static size_t Align(size_t n) { return (n + 63) & ~(size_t)63; }
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: mgkshm <rom> <name> [--format rgba|index|gray] "
+                    "[--scale N] [--slots N] [--jit] [--force]\n");
+    return 1;
+  }
+  const char *sName = argv[2];
+  int nFormat = MGK_FORMAT_GRAY;
+  int nScale = 2;
+  uint32_t nSlots = 8;
+  bool bJit = false;
+  bool bForce = false;
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--format" && i + 1 < argc) {
+      std::string f = argv[++i];
+      nFormat = f == "rgba"    ? MGK_FORMAT_RGBA
+                : f == "index" ? MGK_FORMAT_INDEX
+                               : MGK_FORMAT_GRAY;
+    } else if (arg == "--scale" && i + 1 < argc) {
+      nScale = atoi(argv[++i]);
+    } else if (arg == "--slots" && i + 1 < argc) {
+      nSlots = (uint32_t)atoi(argv[++i]);
+    } else if (arg == "--jit") {
+      bJit = true;
+    } else if (arg == "--force") {
+      bForce = true;
+    }
+  }
+  if ((nScale != 1 && nScale != 2 && nScale != 4) || nSlots == 0 ||
+      (nSlots & (nSlots - 1)) != 0) {
+    fprintf(stderr, "mgkshm: bad scale or slot count\n");
+    return 1;
+  }
+
+  std::ifstream ifs(argv[1], std::ifstream::binary);
+  std::vector<uint8_t> vROM((std::istreambuf_iterator<char>(ifs)),
+                            std::istreambuf_iterator<char>());
+  mgk_emu *emu = mgk_create();
+  mgk_set_option(emu, MGK_OPTION_JIT, bJit);
+  mgk_set_output(emu, nFormat, nScale, nullptr);
+  if (mgk_load_rom(emu, vROM.data(), vROM.size()) != MGK_OK) {
+    fprintf(stderr, "mgkshm: cannot load %s\n", argv[1]);
+    return 1;
+  }
+
+  // Layout, each part on its own cache lines
+  size_t nFrameSize = (size_t)(MGK_WIDTH / nScale) * (MGK_HEIGHT / nScale) *
+                      (nFormat == MGK_FORMAT_RGBA ? 4 : 1);
+  size_t nRAMSize = 2048;
+  size_t nStateSize = mgk_state_size(emu);
+  size_t nRequests = Align(sizeof(mgk_shm_header));
+  size_t nResponses = nRequests + Align(nSlots * sizeof(mgk_shm_request));
+  size_t nFrames = nResponses + Align(nSlots * sizeof(mgk_shm_response));
+  size_t nRAM = nFrames + Align(nSlots * nFrameSize);
+  size_t nState = nRAM + Align(nSlots * nRAMSize);
+  size_t nRegion = nState + Align(nStateSize);
+
+  int fd = shm_open(sName, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    if (!bForce) {
+      fprintf(stderr, "mgkshm: %s exists; if no server is using it, start "
+                      "with --force to replace it\n", sName);
+      return 1;
+    }
+    // Clients still attached to the old object keep their mapping of it
+    shm_unlink(sName);
+    fd = shm_open(sName, O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    perror("mgkshm: shm_open");
+    return 1;
+  }
+  // The object is ours from here on; leave no name behind on failure, or the
+  // next start would need --force
+  if (ftruncate(fd, (off_t)nRegion) != 0) {
+    perror("mgkshm: ftruncate");
+    close(fd);
+    shm_unlink(sName);
+    return 1;
+  }
+  void *p = mmap(nullptr, nRegion, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("mgkshm: mmap");
+    shm_unlink(sName);
+    return 1;
+  }
+  uint8_t *pRegion = (uint8_t *)p;
+  mgk_shm_header *h = (mgk_shm_header *)p;
+  h->version = MGK_SHM_VERSION;
+  h->slots = nSlots;
+  h->format = (uint32_t)nFormat;
+  h->scale = (uint32_t)nScale;
+  h->frame_size = (uint32_t)nFrameSize;
+  h->ram_size = (uint32_t)nRAMSize;
+  h->state_size = (uint32_t)nStateSize;
+  h->region_size = nRegion;
+  h->requests = nRequests;
+  h->responses = nResponses;
+  h->frames = nFrames;
+  h->ram = nRAM;
+  h->state = nState;
+  // Clients check the magic first, so it goes in last
+  __atomic_store_n(&h->magic, MGK_SHM_MAGIC, __ATOMIC_RELEASE);
+  printf("mgkshm: serving %s as %s (%zu bytes)\n", argv[1], sName, nRegion);
+  fflush(stdout);
+
+  mgk_shm_request *pRequests = (mgk_shm_request *)(pRegion + nRequests);
+  mgk_shm_response *pResponses = (mgk_shm_response *)(pRegion + nResponses);
+  bool bQuit = false;
+  while (!bQuit) {
+    mgk_shm_ring_wait(&h->request_ring);
+    uint32_t nSlot = h->request_ring.tail & (nSlots - 1);
+    mgk_shm_request req = pRequests[nSlot];
+    mgk_shm_ring_release(&h->request_ring);
+
+    mgk_shm_response &res = pResponses[nSlot];
+    memset(&res, 0, sizeof(res));
+    res.tag = req.tag;
+    res.slot = nSlot;
+    switch (req.kind) {
+    case MGK_SHM_STEP:
+      // The PPU draws straight into the slot
+      mgk_set_output(emu, nFormat, nScale,
+                     pRegion + nFrames + nSlot * nFrameSize);
+      res.status = mgk_step(emu, req.buttons, req.frames, req.max_pool,
+                            &res.result);
+      memcpy(pRegion + nRAM + nSlot * nRAMSize, mgk_ram(emu), nRAMSize);
+      break;
+    case MGK_SHM_RESET:
+      res.status = mgk_reset(emu);
+      break;
+    case MGK_SHM_CONFIGURE:
+      res.status = MGK_ERROR_ARGUMENT;
+      if (h->reward_count <= MGK_SHM_MAX_TERMS &&
+          h->terminal_count <= MGK_SHM_MAX_TERMS &&
+          mgk_set_rewards(emu, h->rewards, h->reward_count) == MGK_OK)
+        res.status = mgk_set_terminals(emu, h->terminals, h->terminal_count);
+      break;
+    case MGK_SHM_SAVE:
+      res.status = (int32_t)mgk_save_state(emu, pRegion + nState, nStateSize);
+      break;
+    case MGK_SHM_LOAD:
+      res.status = mgk_load_state(emu, pRegion + nState, nStateSize);
+      break;
+    case MGK_SHM_QUIT:
+      bQuit = true;
+      break;
+    default:
+      res.status = MGK_ERROR_ARGUMENT;
+      break;
+    }
+
+    // Position n of the response ring answers position n of the requests
+    mgk_shm_ring_publish(&h->response_ring);
+  }
+
+  shm_unlink(sName);
+  munmap(p, nRegion);
+  mgk_destroy(emu);
+  return 0;
+}
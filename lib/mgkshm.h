@@ -0,0 +1,213 @@
+/* mgkshm: an emulator process serving agents in other processes through a
+ * POSIX shared memory region (Linux).
+ *
+ * The region holds a header, a ring of requests (client to server), a ring
+ * of responses (server to client) and, for every ring slot, the observation
+ * of the step in that slot: its frame, drawn there by the PPU, and a copy
+ * of CPU RAM. Rings are single producer, single consumer and lock free. A
+ * side that finds its ring empty spins for a moment and then sleeps on a
+ * futex in the ring, which the producer wakes.
+ *
+ * The response to the request in ring position n is in position n, and its
+ * observation stays valid until the client submits request n + slots. The
+ * helpers below never let a client get that far ahead.
+ */
+#ifndef MGKSHM_H
+#define MGKSHM_H
+
+#include "mgkemu.h"
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MGK_SHM_MAGIC 0x53484D4Du
+#define MGK_SHM_VERSION 1
+#define MGK_SHM_MAX_TERMS 16 /* Reward terms and terminal predicates */
+#define MGK_SHM_SPIN 20000   /* Polls before sleeping on the futex */
+
+/* Requests */
+enum {
+  MGK_SHM_STEP = 0,      /* mgk_step, filling the slot's observation */
+  MGK_SHM_RESET = 1,     /* mgk_reset */
+  MGK_SHM_CONFIGURE = 2, /* Take the reward terms and terminal predicates */
+  MGK_SHM_SAVE = 3,      /* Save the machine into the state area */
+  MGK_SHM_LOAD = 4,      /* Load it back */
+  MGK_SHM_QUIT = 5       /* Answer, then remove the region and exit */
+};
+
+/* One ring. Head is written by the producer only, tail by the consumer. */
+typedef struct mgk_shm_ring {
+  uint32_t head;   /* Entries published */
+  uint32_t signal; /* Futex word, bumped with every entry */
+  uint8_t pad0[56];
+  uint32_t tail;    /* Entries consumed */
+  uint32_t waiting; /* The consumer may be asleep on signal */
+  uint8_t pad1[56];
+} mgk_shm_ring;
+
+typedef struct mgk_shm_request {
+  uint64_t tag; /* Returned in the response */
+  uint32_t kind;
+  uint16_t frames; /* MGK_SHM_STEP: frames to hold the buttons for */
+  uint8_t buttons;
+  uint8_t max_pool;
+} mgk_shm_request;
+
+typedef struct mgk_shm_response {
+  uint64_t tag;
+  int32_t status; /* MGK_OK, an error, or the bytes saved */
+  uint32_t slot;  /* Ring slot, for mgk_shm_frame and mgk_shm_ram */
+  mgk_step_result result;
+} mgk_shm_response;
+
+typedef struct mgk_shm_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots; /* Entries per ring, a power of two */
+  uint32_t format; /* MGK_FORMAT_* of the frames */
+  uint32_t scale;
+  uint32_t frame_size; /* Bytes per frame */
+  uint32_t ram_size;   /* Bytes per RAM copy */
+  uint32_t state_size; /* Bytes in the state area */
+  uint64_t region_size;
+  uint64_t requests; /* Offsets into the region */
+  uint64_t responses;
+  uint64_t frames;
+  uint64_t ram;
+  uint64_t state;
+
+  /* Read by MGK_SHM_CONFIGURE */
+  uint32_t reward_count;
+  uint32_t terminal_count;
+  mgk_reward rewards[MGK_SHM_MAX_TERMS];
+  mgk_terminal terminals[MGK_SHM_MAX_TERMS];
+
+  mgk_shm_ring request_ring;
+  mgk_shm_ring response_ring;
+} mgk_shm_header;
+
+static inline void mgk_shm_futex(uint32_t *word, int op, uint32_t value) {
+  syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+/* Polls before sleeping: none on a single CPU, where the other side cannot
+ * run while this one spins */
+static inline int mgk_shm_spin(void) {
+  static int spin = -1;
+  if (spin < 0)
+    spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? MGK_SHM_SPIN : 0;
+  return spin;
+}
+
+/* Block until the ring holds an entry past the consumer's tail */
+static inline void mgk_shm_ring_wait(mgk_shm_ring *r) {
+  uint32_t tail = r->tail;
+  int spin = mgk_shm_spin();
+  for (int i = 0; i < spin; i++) {
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != tail)
+      return;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  for (;;) {
+    uint32_t signal = __atomic_load_n(&r->signal, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) != tail)
+      break;
+    /* Returns at once if an entry was published since signal was read */
+    mgk_shm_futex(&r->signal, FUTEX_WAIT, signal);
+  }
+  __atomic_store_n(&r->waiting, 0, __ATOMIC_RELAXED);
+}
+
+/* Publish the entry at head */
+static inline void mgk_shm_ring_publish(mgk_shm_ring *r) {
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&r->signal, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST))
+    mgk_shm_futex(&r->signal, FUTEX_WAKE, 1);
+}
+
+/* Consume the entry at tail */
+static inline void mgk_shm_ring_release(mgk_shm_ring *r) {
+  __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Client side */
+
+/* Map a server's region, NULL if there is none by that name */
+static inline mgk_shm_header *mgk_shm_attach(const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(mgk_shm_header))
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+  mgk_shm_header *h = (mgk_shm_header *)p;
+  /* The server writes the magic last */
+  if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != MGK_SHM_MAGIC ||
+      h->version != MGK_SHM_VERSION) {
+    munmap(p, st.st_size);
+    return NULL;
+  }
+  return h;
+}
+
+static inline void mgk_shm_detach(mgk_shm_header *h) {
+  munmap(h, h->region_size);
+}
+
+/* The next request to fill in, or NULL while all slots are taken by
+ * requests in flight and responses not yet released */
+static inline mgk_shm_request *mgk_shm_request_slot(mgk_shm_header *h) {
+  uint32_t head = h->request_ring.head;
+  if (head - h->response_ring.tail >= h->slots)
+    return NULL;
+  return (mgk_shm_request *)((uint8_t *)h + h->requests) +
+         (head & (h->slots - 1));
+}
+
+static inline void mgk_shm_submit(mgk_shm_header *h) {
+  mgk_shm_ring_publish(&h->request_ring);
+}
+
+/* Wait for the oldest response; release it when done with its slot */
+static inline const mgk_shm_response *mgk_shm_wait(mgk_shm_header *h) {
+  mgk_shm_ring_wait(&h->response_ring);
+  return (const mgk_shm_response *)((uint8_t *)h + h->responses) +
+         (h->response_ring.tail & (h->slots - 1));
+}
+
+static inline void mgk_shm_release(mgk_shm_header *h) {
+  mgk_shm_ring_release(&h->response_ring);
+}
+
+static inline const uint8_t *mgk_shm_frame(const mgk_shm_header *h,
+                                           uint32_t slot) {
+  return (const uint8_t *)h + h->frames + (size_t)slot * h->frame_size;
+}
+
+static inline const uint8_t *mgk_shm_ram(const mgk_shm_header *h,
+                                         uint32_t slot) {
+  return (const uint8_t *)h + h->ram + (size_t)slot * h->ram_size;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
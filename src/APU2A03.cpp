@@ -47,6 +47,12 @@ void APU2A03::reset() {
   dmcIRQ = false;
 }
 
+void APU2A03::State(SaveState &s) {
+  s.Values(clockCounter, frameCounterMode, frameIRQInhibit, frameIRQ,
+           frameCounter);
+  s.Values(pulse1, pulse2, triangle, noise, dmc, dmcIRQ);
+}
+
 //========================================
 // PULSE CHANNEL IMPLEMENTATION
 //========================================
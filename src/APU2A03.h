@@ -1,4 +1,5 @@
 #pragma once
+#include "SaveState.h"
 #include <cstdint>
 #include <functional>
 
@@ -12,6 +13,9 @@ public:
   void clock();
   void reset();
 
+  // Save or load the frame counter and channels (see SaveState.h)
+  void State(SaveState &s);
+
   // Get current audio sample (-1.0 to 1.0)
   double GetOutputSample();
 
@@ -0,0 +1,219 @@
+#include "BatchRunner.h"
+#include "Bus.h"
+#include <algorithm>
+#include <chrono>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static double Seconds(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+BatchRunner::BatchRunner(int nThreads, bool bPin) : bPin(bPin) {
+  if (nThreads <= 0)
+    nThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 0; i < nThreads; i++)
+    vThreads.push_back(std::make_unique<THREAD>());
+  for (int i = 0; i < nThreads; i++)
+    vThreads[i]->thread = std::thread(&BatchRunner::Worker, this, i);
+}
+
+BatchRunner::~BatchRunner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bQuit = true;
+  }
+  wake.notify_all();
+  for (auto &t : vThreads)
+    t->thread.join();
+}
+
+size_t BatchRunner::Add(Bus &bus) {
+  MACHINE m;
+  m.bus = &bus;
+  vMachines.push_back(m);
+  return vMachines.size() - 1;
+}
+
+void BatchRunner::ResetStats() {
+  for (MACHINE &m : vMachines)
+    m.stats = MACHINE_STATS();
+  for (auto &t : vThreads)
+    t->stats = THREAD_STATS();
+  dWall = 0;
+}
+
+void BatchRunner::Run(int nFrames) {
+  if (nFrames <= 0 || vMachines.empty())
+    return;
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Deal the machines out in turn; the threads are all waiting for the
+  // batch, so the queues need no locks yet
+  size_t nThreads = vThreads.size();
+  for (size_t i = 0; i < vMachines.size(); i++) {
+    vMachines[i].nLeft = nFrames;
+    vThreads[i % nThreads]->queue.push_back(i);
+  }
+  nQueued = vMachines.size();
+  nRemaining = vMachines.size();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  nFinished = 0;
+  nBatch++;
+  wake.notify_all();
+  done.wait(lock, [&] { return nFinished == (int)nThreads; });
+  dWall += Seconds(t0);
+}
+
+void BatchRunner::Worker(int nThread) {
+  if (bPin)
+    Pin(nThread);
+  uint64_t nSeen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return bQuit || nBatch != nSeen; });
+      if (bQuit)
+        return;
+      nSeen = nBatch;
+    }
+    Work(nThread);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (++nFinished == (int)vThreads.size())
+      done.notify_one();
+  }
+}
+
+void BatchRunner::Work(int nThread) {
+  THREAD &t = *vThreads[nThread];
+  size_t n;
+  bool bKeep = false; // Run n again
+  while (nRemaining > 0) {
+    if (!bKeep && !Take(nThread, n)) {
+      // Without stealing an empty queue stays empty: this thread's
+      // machines are done
+      if (!bSteal)
+        return;
+      // The machines left are running on other threads; wait for one of
+      // them to be queued again or for the last to finish
+      nSleeping++;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return nQueued > 0 || nRemaining == 0; });
+      }
+      nSleeping--;
+      continue;
+    }
+
+    MACHINE &m = vMachines[n];
+    if (m.nThread >= 0 && m.nThread != nThread)
+      m.stats.nMoves++;
+    m.nThread = nThread;
+    if (onFrame)
+      onFrame(n, m.stats.nFrames);
+
+    auto t0 = std::chrono::steady_clock::now();
+    Bus &bus = *m.bus;
+    do
+      bus.clock();
+    while (!bus.ppu.frame_complete);
+    bus.ppu.frame_complete = false;
+    double dFrame = Seconds(t0);
+
+    m.stats.nFrames++;
+    m.stats.dSeconds += dFrame;
+    t.stats.nFrames++;
+    t.stats.dBusy += dFrame;
+
+    if (--m.nLeft > 0) {
+      // A machine with nothing queued behind it stays on this thread
+      // rather than moving to whichever thread wakes first. Only this
+      // thread adds to its queue, so an empty one stays empty.
+      {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        bKeep = t.queue.empty();
+      }
+      if (!bKeep)
+        Push(nThread, n);
+    } else {
+      bKeep = false;
+      if (--nRemaining == 0) {
+        // Release threads waiting for work that will not come
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+      }
+    }
+  }
+}
+
+// Own queue first, then the others starting with the next thread's
+bool BatchRunner::Take(int nThread, size_t &nMachine) {
+  int nThreads = (int)vThreads.size();
+  for (int k = 0; k < (bSteal ? nThreads : 1); k++) {
+    THREAD &t = *vThreads[(nThread + k) % nThreads];
+    std::lock_guard<std::mutex> lock(t.mutex);
+    if (t.queue.empty())
+      continue;
+    nMachine = t.queue.front();
+    t.queue.pop_front();
+    nQueued--;
+    if (k > 0)
+      vThreads[nThread]->stats.nSteals++;
+    return true;
+  }
+  return false;
+}
+
+void BatchRunner::Push(int nThread, size_t nMachine) {
+  THREAD &t = *vThreads[nThread];
+  {
+    std::lock_guard<std::mutex> lock(t.mutex);
+    t.queue.push_back(nMachine);
+  }
+  nQueued++;
+  // Wake threads that found no work. Taking the lock first means one that
+  // is about to wait cannot miss the notification.
+  if (nSleeping > 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_all();
+  }
+}
+
+// Bind the thread to the nThread'th CPU the process may run on
+void BatchRunner::Pin(int nThread) {
+#ifdef _WIN32
+  DWORD_PTR nProcess, nSystem;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &nProcess, &nSystem))
+    return;
+  std::vector<int> vCPUs;
+  for (int i = 0; i < (int)sizeof(DWORD_PTR) * 8; i++)
+    if (nProcess & ((DWORD_PTR)1 << i))
+      vCPUs.push_back(i);
+  if (!vCPUs.empty())
+    SetThreadAffinityMask(GetCurrentThread(),
+                          (DWORD_PTR)1 << vCPUs[nThread % vCPUs.size()]);
+#elif defined(__linux__)
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    return;
+  std::vector<int> vCPUs;
+  for (int i = 0; i < CPU_SETSIZE; i++)
+    if (CPU_ISSET(i, &set))
+      vCPUs.push_back(i);
+  if (vCPUs.empty())
+    return;
+  CPU_ZERO(&set);
+  CPU_SET(vCPUs[nThread % vCPUs.size()], &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)nThread;
+#endif
+}
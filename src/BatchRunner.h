@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Bus;
+
+// Many machines stepped a frame at a time on a pool of threads.
+//
+// Frames of different cartridges cost very different amounts (MMC5 does
+// work on every PPU fetch, NROM none), so dealing out machines in equal
+// numbers leaves threads idle while the slowest one finishes. Each thread
+// instead keeps a queue of machines and runs them one frame in turn; a
+// thread whose queue runs dry takes the next machine from the front of
+// another's queue. Every frame of a machine still runs on one thread at a
+// time, in order, so its results do not depend on the threads it ran on.
+//
+// Machines are independent, but must not be attached to a CPULanes engine,
+// whose lanes have to be clocked together.
+class BatchRunner {
+public:
+  // nThreads 0 takes one per hardware thread. With bPin each thread is
+  // bound to its own CPU of those the process may use.
+  explicit BatchRunner(int nThreads = 0, bool bPin = false);
+  ~BatchRunner();
+
+  // Add a machine, already reset. It is only clocked inside Run().
+  size_t Add(Bus &bus);
+  size_t Size() const { return vMachines.size(); }
+  int Threads() const { return (int)vThreads.size(); }
+
+  // Called before each frame of a machine, on the thread about to run it,
+  // with the frames the machine has run so far; e.g. to set its controllers
+  std::function<void(size_t nMachine, uint64_t nFrame)> onFrame;
+
+  // Threads take machines from each other's queues. Without it every
+  // machine stays on the thread it was dealt to.
+  bool bSteal = true;
+
+  // Run every machine for nFrames frames and return when all are done
+  void Run(int nFrames);
+
+  struct MACHINE_STATS {
+    uint64_t nFrames = 0;
+    double dSeconds = 0; // Spent running its frames
+    uint32_t nMoves = 0; // Frames run on another thread than the one before
+  };
+  struct THREAD_STATS {
+    uint64_t nFrames = 0;
+    double dBusy = 0;     // Seconds spent running frames
+    uint32_t nSteals = 0; // Machines taken from other queues
+  };
+  const MACHINE_STATS &MachineStats(size_t n) const {
+    return vMachines[n].stats;
+  }
+  const THREAD_STATS &ThreadStats(int n) const { return vThreads[n]->stats; }
+  // Seconds spent inside Run()
+  double WallSeconds() const { return dWall; }
+  void ResetStats();
+
+private:
+  struct MACHINE {
+    Bus *bus = nullptr;
+    int nLeft = 0;    // Frames still to run in this batch
+    int nThread = -1; // Thread that ran the last frame
+    MACHINE_STATS stats;
+  };
+  std::vector<MACHINE> vMachines;
+
+  struct THREAD {
+    std::thread thread;
+    std::mutex mutex; // Guards the queue, which other threads steal from
+    std::deque<size_t> queue;
+    THREAD_STATS stats;
+  };
+  std::vector<std::unique_ptr<THREAD>> vThreads;
+  bool bPin = false;
+  double dWall = 0;
+
+  // A batch is started by bumping nBatch and is over once every thread has
+  // run out of work and counted itself in nFinished
+  std::mutex mutex;
+  std::condition_variable wake; // Workers: a batch started, a machine was
+                                // queued or the batch is over
+  std::condition_variable done; // Run(): every thread finished
+  uint64_t nBatch = 0;
+  int nFinished = 0;
+  bool bQuit = false;
+
+  std::atomic<size_t> nRemaining{0}; // Machines with frames left
+  std::atomic<size_t> nQueued{0};    // Machines waiting in queues
+  std::atomic<int> nSleeping{0};     // Threads waiting for nQueued
+
+  void Worker(int nThread);
+  void Work(int nThread);
+  bool Take(int nThread, size_t &nMachine);
+  void Push(int nThread, size_t nMachine);
+  void Pin(int nThread);
+};
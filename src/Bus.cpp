@@ -1,4 +1,6 @@
 #include "Bus.h"
+#include <algorithm>
+#include <cstring>
 
 Bus::Bus() {
   for (auto &i : ram)
@@ -14,6 +16,7 @@ Bus::~Bus() {}
 
 void Bus::insertCartridge(const std::shared_ptr<Cartridge> &cartridge) {
   this->cart = cartridge;
+  cart->ConnectCPUClock(&nCPUCycles);
   ppu.ConnectCartridge(cartridge);
 }
 
@@ -23,15 +26,44 @@ void Bus::reset() {
   ppu.reset();
   apu.reset();
   nSystemClockCounter = 0;
+  nDMAStall = 0;
+}
+
+void Bus::State(SaveState &s) {
+  // Layout version, bumped when a State() function changes
+  static const uint32_t nMagic = 0x4B474D02;
+  uint32_t nTag = nMagic;
+  s.Value(nTag);
+  if (nTag != nMagic || !cart) {
+    s.Fail();
+    return;
+  }
+  cart->State(s);
+  if (s.Failed())
+    return;
+  cpu.State(s);
+  ppu.State(s);
+  apu.State(s);
+  s.Values(ram, controller, controller_state, nSystemClockCounter, nCPUCycles);
+  s.Values(dma_page, dma_addr, dma_data, dma_transfer, dma_dummy, nDMAStall,
+           bPrevMapperIRQ);
 }
 
 void Bus::clock() {
-  ppu.clock();
+  // The PPU lets the bus skip dots where nothing observable happens
+  if (ppu.nIdleDots > 0)
+    ppu.nIdleDots--;
+  else
+    ppu.clock();
 
   if (nSystemClockCounter % 3 == 0) {
     // APU runs at CPU rate
     apu.clock();
 
+    // Mapper cycle counter IRQs fire on their scheduled cycle
+    if (nCPUCycles >= cart->GetIRQDeadline())
+      cart->IRQDeadlineReached();
+
     if (dma_transfer) {
       if (dma_dummy) {
         if (nSystemClockCounter % 2 == 1) {
@@ -41,7 +73,7 @@ void Bus::clock() {
         if (nSystemClockCounter % 2 == 0) {
           dma_data = read(dma_page << 8 | dma_addr);
         } else {
-          ppu.OAM[dma_addr] = dma_data;
+          ppu.DMAWrite(dma_addr, dma_data);
           dma_addr++;
 
           if (dma_addr == 0x00) {
@@ -50,6 +82,8 @@ void Bus::clock() {
           }
         }
       }
+    } else if (nDMAStall > 0) {
+      nDMAStall--;
     } else {
       cpu.clock();
     }
@@ -61,6 +95,8 @@ void Bus::clock() {
     if (cart->GetIRQState()) {
       cpu.irq();
     }
+
+    nCPUCycles++;
   }
 
   if (ppu.nmi) {
@@ -71,6 +107,22 @@ void Bus::clock() {
   nSystemClockCounter++;
 }
 
+uint32_t Bus::InterruptFreeCycles() {
+  // An interrupt raised on one of the next three dots is seen after the
+  // CPU's next cycle, so whole CPU cycles are counted down
+  uint32_t nDots = ppu.DotsUntilNMI();
+  uint64_t nCycles = nDots / 3;
+  if (!cpu.GetFlag(CPU6502::I)) {
+    if (cart->GetIRQState())
+      return 0;
+    nCycles = std::min<uint64_t>(nCycles, cart->GetIRQQuietDots() / 3);
+    uint64_t nDeadline = cart->GetIRQDeadline();
+    nCycles = std::min(nCycles,
+                       nDeadline > nCPUCycles ? nDeadline - nCPUCycles : 0);
+  }
+  return (uint32_t)nCycles;
+}
+
 void Bus::write(uint16_t addr, uint8_t data) {
   if (cart->cpuWrite(addr, data)) {
   } else if (addr >= 0x0000 && addr <= 0x1FFF) {
@@ -82,7 +134,16 @@ void Bus::write(uint16_t addr, uint8_t data) {
   } else if (addr == 0x4014) {
     dma_page = data;
     dma_addr = 0x00;
-    dma_transfer = true;
+    // 1 dummy cycle (2 if the next cycle is a put cycle) + 256 read/write
+    // pairs, with the same alignment as the byte-wise transfer
+    uint16_t nStall = ((nSystemClockCounter + 3) % 2 == 1) ? 513 : 514;
+    const uint8_t *src = bBulkDMA ? DMASourcePage(data) : nullptr;
+    if (src && ppu.DotsUntilOAMRead() > nStall * 3u + 3) {
+      ppu.DMAPage(src);
+      nDMAStall = nStall;
+    } else {
+      dma_transfer = true;
+    }
   } else if (addr == 0x4015) {
     apu.cpuWrite(addr, data);
   } else if (addr >= 0x4016 && addr <= 0x4017) {
@@ -93,6 +154,17 @@ void Bus::write(uint16_t addr, uint8_t data) {
   }
 }
 
+const uint8_t *Bus::DMASourcePage(uint8_t page) {
+  // Internal RAM and mapper slots are plain memory; anything else may have
+  // read side effects and goes through the byte-wise path
+  if (page < 0x20)
+    return &ram[(page & 0x07) << 8];
+  if (page >= 0x60)
+    if (const uint8_t *slot = cart->GetPRGPage(page >> 5))
+      return slot + ((page << 8) & 0x1FFF);
+  return nullptr;
+}
+
 uint8_t Bus::read(uint16_t addr, bool bReadOnly) {
   uint8_t data = 0x00;
   if (cart->cpuRead(addr, data)) {
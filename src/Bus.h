@@ -22,6 +22,10 @@ public: // Devices
   // Controllers
   uint8_t controller[2] = {0, 0};
 
+  // OAM DMA from plain memory may copy the page at once (see nDMAStall).
+  // Clearing this keeps every transfer byte-wise, for reference runs.
+  bool bBulkDMA = true;
+
 public: // Bus Read/Write
   void write(uint16_t addr, uint8_t data);
   uint8_t read(uint16_t addr, bool bReadOnly = false);
@@ -30,11 +34,31 @@ public: // Bus Read/Write
   void reset();
   void clock();
 
+  // Save or load the whole machine (see SaveState.h). A load fails, leaving
+  // the machine as it was, for a state of another version or cartridge.
+  void State(SaveState &s);
+
+  // CPU cycles from now in which no interrupt can reach the CPU, so it may
+  // run ahead of the other devices (see CPUJit)
+  uint32_t InterruptFreeCycles();
+
+  // The CPU is between instructions and starts the next one on this dot, so
+  // CPULanes may run it ahead of the bus clock
+  bool CPUStepDue() const {
+    return nSystemClockCounter % 3 == 0 && !dma_transfer && nDMAStall == 0 &&
+           cpu.cycles == 0;
+  }
+
+  // An OAM DMA transfer or its bulk stall is under way; OAM may already
+  // hold the whole page or only part of it
+  bool DMABusy() const { return dma_transfer || nDMAStall > 0; }
+
   // Get audio sample for SDL callback
   double GetAudioSample() { return apu.GetOutputSample(); }
 
 private:
   uint32_t nSystemClockCounter = 0;
+  uint64_t nCPUCycles = 0; // CPU cycles since power on, including DMA
 
   // Controller state
   uint8_t controller_state[2] = {0, 0};
@@ -46,6 +70,12 @@ private:
   bool dma_transfer = false;
   bool dma_dummy = true;
 
+  // Bulk OAM DMA: the page is copied at once and the CPU sits out the
+  // cycles the byte-wise transfer would take. Only taken when the PPU
+  // cannot read OAM before the transfer would have ended.
+  uint16_t nDMAStall = 0;
+  const uint8_t *DMASourcePage(uint8_t page);
+
   // Mapper IRQ edge detection
   bool bPrevMapperIRQ = false;
 };
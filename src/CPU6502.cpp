@@ -1,5 +1,15 @@
 #include "CPU6502.h"
 #include "Bus.h"
+#include "CPUJit.h"
+#include "CPULanes.h"
+#ifdef MGK_CPU_PROFILE
+#include <algorithm>
+#endif
+#if defined(MGK_CPU_PROFILE) || defined(MGK_CPU_TRACE)
+#include <cstdio>
+#endif
+
+using namespace CPUOpcodes;
 
 CPU6502::CPU6502()
 {
@@ -262,9 +272,227 @@ CPU6502::CPU6502()
         {"INC", &a::INC, &a::ABX, 7},
         {"???", &a::XXX, &a::IMP, 7},
     };
+
+#ifdef MGK_CPU_TRACE
+    vTrace.resize(MGK_CPU_TRACE_SIZE);
+#endif
 }
 
-CPU6502::~CPU6502() {}
+CPU6502::~CPU6502()
+{
+}
+
+#ifdef MGK_CPU_TRACE
+void CPU6502::TraceDecode(uint8_t op, const char *&name, uint8_t &mode,
+                          bool &bOfficial) const
+{
+    const INSTRUCTION &ins = lookup[op];
+    bOfficial = ins.name != "???";
+    if (bOfficial)
+    {
+        name = ins.name.c_str();
+        // BRK reads its padding byte as an immediate, but shows bare
+        mode = op == 0x00 ? M_IMP : AddrMode(ins.addrmode);
+        return;
+    }
+
+    // Unofficial opcodes take the addressing mode of their column
+    static const uint8_t column[32] = {
+        M_IMM, M_IZX, M_IMM, M_IZX, M_ZP0, M_ZP0, M_ZP0, M_ZP0,
+        M_IMP, M_IMM, M_IMP, M_IMM, M_ABS, M_ABS, M_ABS, M_ABS,
+        M_REL, M_IZY, M_IMP, M_IZY, M_ZPX, M_ZPX, M_ZPX, M_ZPX,
+        M_IMP, M_ABY, M_IMP, M_ABY, M_ABX, M_ABX, M_ABY, M_ABX,
+    };
+    static const char *const rmw[8] = {"SLO", "RLA", "SRE", "RRA",
+                                       "SAX", "LAX", "DCP", "ISB"};
+    static const char *const imm[8] = {"ANC", "ANC", "ALR", "ARR",
+                                       "XAA", "LAX", "AXS", "SBC"};
+    mode = column[op & 0x1F];
+    int row = op >> 5;
+    if ((op & 0x03) == 0x03)
+    {
+        name = mode == M_IMM ? imm[row] : rmw[row];
+        // SAX and LAX index with Y where the others use X
+        if (row == 4 || row == 5)
+        {
+            if (mode == M_ZPX)
+                mode = M_ZPY;
+            else if (mode == M_ABX)
+                mode = M_ABY;
+        }
+        if (op == 0x93 || op == 0x9F)
+            name = "SHA";
+        else if (op == 0x9B)
+            name = "TAS";
+        else if (op == 0xBB)
+            name = "LAS";
+    }
+    else if (op == 0x9C)
+        name = "SHY";
+    else if (op == 0x9E)
+        name = "SHX";
+    else if ((op & 0x0F) == 0x02 && !(mode == M_IMM && row >= 4))
+    {
+        name = "JAM";
+        mode = M_IMP;
+    }
+    else
+        name = "NOP";
+}
+
+void CPU6502::DumpTrace(const std::string &sFileName)
+{
+    FILE *f = fopen(sFileName.c_str(), "w");
+    if (!f)
+        return;
+
+    uint64_t first = nTraceCount > MGK_CPU_TRACE_SIZE
+                         ? nTraceCount - MGK_CPU_TRACE_SIZE
+                         : 0;
+    for (uint64_t n = first; n < nTraceCount; n++)
+    {
+        const TRACE_ENTRY &t = vTrace[n & (MGK_CPU_TRACE_SIZE - 1)];
+        const char *name;
+        uint8_t mode;
+        bool bOfficial;
+        TraceDecode(t.bytes[0], name, mode, bOfficial);
+        uint16_t abs = (t.bytes[2] << 8) | t.bytes[1];
+        uint8_t zp = t.bytes[1];
+
+        // Operand text follows the addressing mode, with nestest's notes on
+        // where it points and what was there
+        int len = 2;
+        char operand[40] = "";
+        switch (mode)
+        {
+        case M_IMP:
+            len = 1;
+            if (t.bytes[0] == 0x0A || t.bytes[0] == 0x2A ||
+                t.bytes[0] == 0x4A || t.bytes[0] == 0x6A)
+                snprintf(operand, sizeof(operand), "A");
+            break;
+        case M_IMM:
+            snprintf(operand, sizeof(operand), "#$%02X", zp);
+            break;
+        case M_ZP0:
+            snprintf(operand, sizeof(operand), "$%02X = %02X", zp, t.value);
+            break;
+        case M_ZPX:
+        case M_ZPY:
+            snprintf(operand, sizeof(operand), "$%02X,%c @ %02X = %02X", zp,
+                     mode == M_ZPX ? 'X' : 'Y', t.ea, t.value);
+            break;
+        case M_REL:
+            snprintf(operand, sizeof(operand), "$%04X",
+                     (uint16_t)(t.pc + 2 + (int8_t)zp));
+            break;
+        case M_IZX:
+            snprintf(operand, sizeof(operand), "($%02X,X) @ %02X = %04X = %02X",
+                     zp, (uint8_t)(zp + t.x), t.ea, t.value);
+            break;
+        case M_IZY:
+            snprintf(operand, sizeof(operand), "($%02X),Y = %04X @ %04X = %02X",
+                     zp, (uint16_t)(t.ea - t.y), t.ea, t.value);
+            break;
+        case M_ABS:
+            len = 3;
+            if (t.bytes[0] == 0x4C || t.bytes[0] == 0x20) // JMP, JSR
+                snprintf(operand, sizeof(operand), "$%04X", abs);
+            else
+                snprintf(operand, sizeof(operand), "$%04X = %02X", abs,
+                         t.value);
+            break;
+        case M_ABX:
+        case M_ABY:
+            len = 3;
+            snprintf(operand, sizeof(operand), "$%04X,%c @ %04X = %02X", abs,
+                     mode == M_ABX ? 'X' : 'Y', t.ea, t.value);
+            break;
+        case M_IND:
+            len = 3;
+            snprintf(operand, sizeof(operand), "($%04X) = %04X", abs, t.ea);
+            break;
+        }
+
+        const char *fmt = len == 1   ? "%02X      "
+                          : len == 2 ? "%02X %02X   "
+                                     : "%02X %02X %02X";
+        char bytes[9];
+        snprintf(bytes, sizeof(bytes), fmt, t.bytes[0], t.bytes[1], t.bytes[2]);
+
+        char text[48];
+        snprintf(text, sizeof(text), "%s %s", name, operand);
+
+        fprintf(f, "%04X  %s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%u\n",
+                t.pc, bytes, bOfficial ? ' ' : '*', text, t.a, t.x, t.y, t.st,
+                t.sp, t.scanline, t.dot, t.cycle);
+    }
+
+    fclose(f);
+}
+#endif
+
+#ifdef MGK_CPU_PROFILE
+void CPU6502::DumpProfile(const std::string &sFileName)
+{
+    FILE *f = fopen(sFileName.c_str(), "w");
+    if (!f)
+        return;
+
+    uint64_t totalCount = 0, totalCycles = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        totalCount += opcodeProfile[i].count;
+        totalCycles += opcodeProfile[i].cycles;
+    }
+    double pct = totalCycles ? 100.0 / totalCycles : 0.0;
+
+    fprintf(f, "CPU profile: %llu instructions, %llu cycles\n\n",
+            (unsigned long long)totalCount, (unsigned long long)totalCycles);
+
+    // Opcodes, heaviest first
+    std::vector<int> ops;
+    for (int i = 0; i < 256; i++)
+        if (opcodeProfile[i].count)
+            ops.push_back(i);
+    std::sort(ops.begin(), ops.end(), [&](int l, int r) {
+        return opcodeProfile[l].cycles > opcodeProfile[r].cycles;
+    });
+
+    fprintf(f, "Per opcode:\n  OP  NAME        COUNT        CYCLES      %%\n");
+    for (int i : ops)
+    {
+        const PROFILE_ENTRY &e = opcodeProfile[i];
+        fprintf(f, "  %02X  %s %12llu  %12llu  %6.2f\n", i,
+                lookup[i].name.c_str(), (unsigned long long)e.count,
+                (unsigned long long)e.cycles, e.cycles * pct);
+    }
+
+    // Addresses, heaviest first
+    std::vector<std::pair<uint32_t, PROFILE_ENTRY>> addrs(addrProfile.begin(),
+                                                          addrProfile.end());
+    std::sort(addrs.begin(), addrs.end(), [](const auto &l, const auto &r) {
+        return l.second.cycles > r.second.cycles;
+    });
+
+    fprintf(f, "\nPer address:\n  BANK:PC   OP  NAME        COUNT        CYCLES      %%\n");
+    for (const auto &entry : addrs)
+    {
+        uint16_t bank = entry.first >> 16;
+        uint16_t addr = entry.first & 0xFFFF;
+        const PROFILE_ENTRY &e = entry.second;
+        if (bank == 0xFFFF)
+            fprintf(f, "    --:%04X", addr);
+        else
+            fprintf(f, "  %04X:%04X", bank, addr);
+        fprintf(f, "  %02X  %s %12llu  %12llu  %6.2f\n", e.opcode,
+                lookup[e.opcode].name.c_str(), (unsigned long long)e.count,
+                (unsigned long long)e.cycles, e.cycles * pct);
+    }
+
+    fclose(f);
+}
+#endif
 
 uint8_t CPU6502::read(uint16_t addr) { return bus->read(addr, false); }
 
@@ -565,22 +793,274 @@ void CPU6502::clock()
 {
     if (cycles == 0)
     {
-        opcode = read(pc);
-        SetFlag(U, true);
-        pc++;
+#if !defined(MGK_CPU_TRACE) && !defined(MGK_CPU_PROFILE)
+        if (pLanes)
+            cycles = pLanes->Run(nLane);
+        if (cycles == 0 && bJit)
+            cycles = RunJit();
+        if (cycles == 0)
+#endif
+            Step();
+    }
 
-        cycles = lookup[opcode].cycles;
+    clock_count++;
+    cycles--;
+}
 
-        uint8_t additional_cycle1 = (this->*lookup[opcode].addrmode)();
-        uint8_t additional_cycle2 = (this->*lookup[opcode].operate)();
+uint32_t CPU6502::RunJit()
+{
+    if (!pJit)
+        pJit = std::make_unique<CPUJit>(*this, *bus);
+    return pJit->Run(bus->InterruptFreeCycles());
+}
 
-        cycles += (additional_cycle1 & additional_cycle2);
+uint8_t CPU6502::AddrMode(uint8_t (CPU6502::*mode)(void))
+{
+    return mode == &CPU6502::IMM   ? M_IMM
+           : mode == &CPU6502::ZP0 ? M_ZP0
+           : mode == &CPU6502::ZPX ? M_ZPX
+           : mode == &CPU6502::ZPY ? M_ZPY
+           : mode == &CPU6502::REL ? M_REL
+           : mode == &CPU6502::ABS ? M_ABS
+           : mode == &CPU6502::ABX ? M_ABX
+           : mode == &CPU6502::ABY ? M_ABY
+           : mode == &CPU6502::IND ? M_IND
+           : mode == &CPU6502::IZX ? M_IZX
+           : mode == &CPU6502::IZY ? M_IZY
+                                   : M_IMP;
+}
 
-        SetFlag(U, true);
+void CPU6502::DecodeOpcodes(OPCODE *table) const
+{
+    for (int i = 0; i < 256; i++)
+    {
+        const INSTRUCTION &ins = lookup[i];
+        table[i] = OPCODE();
+        table[i].cycles = ins.cycles;
+        for (const OP_NAME &n : kOpNames)
+            if (ins.name == n.name)
+                table[i].op = n.op;
+        table[i].mode = AddrMode(ins.addrmode);
     }
+}
 
-    clock_count++;
-    cycles--;
+const CPU6502::DECODED *CPU6502::Decode(uint16_t addr)
+{
+    Cartridge *cart = bus->cart.get();
+    if (addr < 0x6000 || !cart)
+        return nullptr;
+
+    if (cart != pDecodedCart || cart->GetPRGROMWrites() != nDecodedROMWrites)
+    {
+        vDecoded.clear();
+        vDecoded.resize((cart->GetPRGROM().size() + 0x1FFF) >> 13);
+        for (int i = 0; i < 8; i++)
+        {
+            pDecodedSlot[i] = nullptr;
+            pDecodedPage[i] = nullptr;
+        }
+        pDecodedCart = cart;
+        nDecodedROMWrites = cart->GetPRGROMWrites();
+    }
+
+    int i = addr >> 13;
+    const uint8_t *slot = cart->GetPRGPage(i);
+    if (slot != pDecodedSlot[i])
+        MapDecodedPage(i, slot);
+    if (!pDecodedPage[i])
+        return nullptr;
+
+    DECODED &d = pDecodedPage[i][addr & 0x1FFF];
+    if (d.length == 0)
+    {
+        const uint8_t *src = slot + (addr & 0x1FFF);
+        const INSTRUCTION &ins = lookup[src[0]];
+        uint8_t am = AddrMode(ins.addrmode);
+        uint8_t len = (uint8_t)Length(am);
+
+        // Operand bytes in the next page could change with its bank
+        if ((addr & 0x1FFF) + len > 0x2000)
+            return nullptr;
+
+        d.operate = ins.operate;
+        d.operand = len > 1 ? src[1] : 0;
+        if (len > 2)
+            d.operand |= src[2] << 8;
+        d.opcode = src[0];
+        d.mode = am;
+        d.cycles = ins.cycles;
+        d.length = len;
+    }
+    return &d;
+}
+
+// Point a CPU page at the cache entries of the ROM bank in its slot
+void CPU6502::MapDecodedPage(int i, const uint8_t *slot)
+{
+    pDecodedSlot[i] = slot;
+    pDecodedPage[i] = nullptr;
+
+    const std::vector<uint8_t> &rom = pDecodedCart->GetPRGROM();
+    if (!slot || slot < rom.data() || slot >= rom.data() + rom.size())
+        return;
+    size_t nOffset = slot - rom.data();
+    if (nOffset & 0x1FFF)
+        return;
+
+    std::unique_ptr<DECODED[]> &bank = vDecoded[nOffset >> 13];
+    if (!bank)
+        bank = std::make_unique<DECODED[]>(0x2000);
+    pDecodedPage[i] = bank.get();
+}
+
+// Same as the addressing mode functions, with pc still at the opcode
+uint8_t CPU6502::Resolve(const DECODED &d)
+{
+    uint16_t lo = d.operand & 0x00FF;
+    uint16_t hi = d.operand & 0xFF00;
+    switch (d.mode)
+    {
+    case M_IMP:
+        fetched = a;
+        return 0;
+    case M_IMM:
+        addr_abs = pc + 1;
+        return 0;
+    case M_ZP0:
+        addr_abs = lo;
+        return 0;
+    case M_ZPX:
+        addr_abs = (lo + x) & 0x00FF;
+        return 0;
+    case M_ZPY:
+        addr_abs = (lo + y) & 0x00FF;
+        return 0;
+    case M_REL:
+        addr_rel = lo;
+        if (addr_rel & 0x80)
+            addr_rel |= 0xFF00;
+        return 0;
+    case M_ABS:
+        addr_abs = d.operand;
+        return 0;
+    case M_ABX:
+        addr_abs = d.operand + x;
+        return (addr_abs & 0xFF00) != hi;
+    case M_ABY:
+        addr_abs = d.operand + y;
+        return (addr_abs & 0xFF00) != hi;
+    case M_IND:
+        if (lo == 0x00FF) // Page boundary hardware bug
+            addr_abs = (read(d.operand & 0xFF00) << 8) | read(d.operand);
+        else
+            addr_abs = (read(d.operand + 1) << 8) | read(d.operand);
+        return 0;
+    case M_IZX:
+    {
+        uint16_t ptr_lo = read((lo + x) & 0x00FF);
+        uint16_t ptr_hi = read((lo + x + 1) & 0x00FF);
+        addr_abs = (ptr_hi << 8) | ptr_lo;
+        return 0;
+    }
+    case M_IZY:
+    {
+        uint16_t ptr_lo = read(lo);
+        uint16_t ptr_hi = read((lo + 1) & 0x00FF);
+        addr_abs = ((ptr_hi << 8) | ptr_lo) + y;
+        return (addr_abs & 0xFF00) != (ptr_hi << 8);
+    }
+    }
+    return 0;
+}
+
+void CPU6502::Step()
+{
+#ifdef MGK_CPU_PROFILE
+    uint16_t op_pc = pc;
+#endif
+    const DECODED *d = bDecodeCache ? Decode(pc) : nullptr;
+    opcode = d ? d->opcode : read(pc);
+
+#ifdef MGK_CPU_TRACE
+    TRACE_ENTRY &t = vTrace[nTraceCount++ & (MGK_CPU_TRACE_SIZE - 1)];
+    t.cycle = clock_count;
+    t.pc = pc;
+    t.scanline = bus->ppu.GetScanline();
+    t.dot = bus->ppu.GetCycle();
+    t.bytes[0] = opcode;
+    t.bytes[1] = bus->read(pc + 1, true);
+    t.bytes[2] = bus->read(pc + 2, true);
+    t.a = a;
+    t.x = x;
+    t.y = y;
+    t.st = st;
+    t.sp = sp;
+
+    const char *name;
+    uint8_t mode;
+    bool bOfficial;
+    TraceDecode(opcode, name, mode, bOfficial);
+    uint16_t abs = (t.bytes[2] << 8) | t.bytes[1];
+    uint8_t zp = t.bytes[1];
+    auto peek = [&](uint16_t addr) -> uint8_t {
+        // I/O registers are not read, their reads have side effects
+        return addr >= 0x2000 && addr < 0x6000 ? 0xFF : bus->read(addr, true);
+    };
+    switch (mode)
+    {
+    case M_ZP0: t.ea = zp; break;
+    case M_ZPX: t.ea = (uint8_t)(zp + x); break;
+    case M_ZPY: t.ea = (uint8_t)(zp + y); break;
+    case M_ABS: t.ea = abs; break;
+    case M_ABX: t.ea = abs + x; break;
+    case M_ABY: t.ea = abs + y; break;
+    case M_IND: // Page boundary hardware bug
+        t.ea = peek(abs) | peek((abs & 0xFF00) | ((abs + 1) & 0x00FF)) << 8;
+        break;
+    case M_IZX:
+        t.ea = peek((uint8_t)(zp + x)) | peek((uint8_t)(zp + x + 1)) << 8;
+        break;
+    case M_IZY:
+        t.ea = (peek(zp) | peek((uint8_t)(zp + 1)) << 8) + y;
+        break;
+    default: t.ea = 0; break;
+    }
+    t.value = peek(t.ea);
+#endif
+
+    SetFlag(U, true);
+
+    uint8_t additional_cycle1, additional_cycle2;
+    if (d)
+    {
+        cycles = d->cycles;
+        additional_cycle1 = Resolve(*d);
+        pc += d->length;
+        additional_cycle2 = (this->*d->operate)();
+    }
+    else
+    {
+        pc++;
+        cycles = lookup[opcode].cycles;
+        additional_cycle1 = (this->*lookup[opcode].addrmode)();
+        additional_cycle2 = (this->*lookup[opcode].operate)();
+    }
+
+    cycles += (additional_cycle1 & additional_cycle2);
+
+    SetFlag(U, true);
+
+#ifdef MGK_CPU_PROFILE
+    opcodeProfile[opcode].count++;
+    opcodeProfile[opcode].cycles += cycles;
+
+    int bank = bus->cart ? bus->cart->GetPRGBank(op_pc) : -1;
+    uint32_t key = ((uint32_t)(bank < 0 ? 0xFFFF : bank) << 16) | op_pc;
+    PROFILE_ENTRY &e = addrProfile[key];
+    e.opcode = opcode;
+    e.count++;
+    e.cycles += cycles;
+#endif
 }
 
 void CPU6502::reset()
@@ -603,6 +1083,12 @@ void CPU6502::reset()
     cycles = 8;
 }
 
+void CPU6502::State(SaveState &s)
+{
+    s.Values(a, x, y, st, sp, pc);
+    s.Values(fetched, addr_abs, addr_rel, opcode, cycles, clock_count);
+}
+
 void CPU6502::irq()
 {
     if (GetFlag(I) == 0)
@@ -1,10 +1,27 @@
 #pragma once
+#include "CPUOpcodes.h"
+#include "SaveState.h"
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#ifdef MGK_CPU_PROFILE
+#include <unordered_map>
+#endif
+
+#ifdef MGK_CPU_TRACE
+#ifndef MGK_CPU_TRACE_SIZE
+#define MGK_CPU_TRACE_SIZE 65536
+#endif
+static_assert((MGK_CPU_TRACE_SIZE & (MGK_CPU_TRACE_SIZE - 1)) == 0,
+              "MGK_CPU_TRACE_SIZE must be a power of two");
+#endif
 
 class Bus;
+class Cartridge;
+class CPUJit;
+class CPULanes;
 
 class CPU6502 {
 public:
@@ -38,14 +55,42 @@ public:
     void    irq(); // Interrupt Request
     void    nmi(); // Non-Maskable Interrupt
 
+    // Save or load the registers (see SaveState.h)
+    void    State(SaveState &s);
+
     uint8_t  fetch();
     uint8_t  fetched = 0x00;   // Represents the working input value to the ALU
     uint16_t addr_abs = 0x0000; // All used memory addresses end up in here
     uint16_t addr_rel = 0x0000; // Absolute address after branch calculation
     uint8_t  opcode = 0x00;     // Instruction byte
-    uint8_t  cycles = 0;        // Counts how many cycles the instruction has remaining
+    uint32_t cycles = 0;        // Counts how many cycles the instruction has remaining
     uint32_t clock_count = 0;   // A global accumulation of the number of clocks
 
+    // Run blocks of translated code where the bus allows it (x86-64 hosts,
+    // see CPUJit.h). Ignored in trace and profiling builds.
+    bool bJit = false;
+
+    // Cache decoded instructions from PRG ROM. Clearing this fetches every
+    // byte through the bus, for reference runs.
+    bool bDecodeCache = true;
+
+#ifdef MGK_CPU_TRACE
+    // Trace build (-DMGK_CPU_TRACE): the last MGK_CPU_TRACE_SIZE instructions
+    // are kept in a ring buffer and can be written out in nestest.log format,
+    // with effective addresses and the values there before the instruction.
+    // Unofficial opcodes are shown as the 6502 decodes them, marked with *;
+    // this CPU runs them as one byte NOPs, so traces part from nestest.log
+    // at the first one.
+    void DumpTrace(const std::string &sFileName);
+#endif
+
+#ifdef MGK_CPU_PROFILE
+    // Profiling build (-DMGK_CPU_PROFILE): per-opcode and per-address totals,
+    // written out on request. Every CPU counts on its own, so tools running
+    // several machines choose which report to keep.
+    void DumpProfile(const std::string &sFileName);
+#endif
+
     uint8_t GetFlag(FLAGS6502 f);
     void    SetFlag(FLAGS6502 f, bool v);
 
@@ -87,4 +132,74 @@ private:
     };
 
     std::vector<INSTRUCTION> lookup;
+
+    // Execute the instruction at pc and set cycles to its length
+    void     Step();
+
+    // Decoded instructions in PRG ROM, cached per ROM offset, so the opcode
+    // and operand bytes are not read through the bus again and bank switches
+    // need no invalidation. Code in RAM and instructions that straddle an
+    // 8KB page are decoded every time.
+    struct DECODED {
+        uint8_t  (CPU6502::*operate)(void) = nullptr;
+        uint16_t operand = 0; // Operand bytes, little endian
+        uint8_t  opcode = 0;
+        uint8_t  mode = CPUOpcodes::M_IMP;
+        uint8_t  length = 0;  // 0 until decoded
+        uint8_t  cycles = 0;
+    };
+    std::vector<std::unique_ptr<DECODED[]>> vDecoded; // Per 8KB of ROM
+    const Cartridge *pDecodedCart = nullptr;
+    uint32_t nDecodedROMWrites = 0;  // Flushed when a mapper writes ROM
+    // Entries for each 8KB CPU page, for the slot they were looked up with
+    const uint8_t *pDecodedSlot[8] = {};
+    DECODED *pDecodedPage[8] = {};
+    const DECODED *Decode(uint16_t addr);
+    static uint8_t AddrMode(uint8_t (CPU6502::*mode)(void));
+    // Fill table[256] from lookup, for the translator and the lockstep
+    // engine
+    void     DecodeOpcodes(CPUOpcodes::OPCODE *table) const;
+    void     MapDecodedPage(int i, const uint8_t *slot);
+    uint8_t  Resolve(const DECODED &d); // Addressing mode of a cached entry
+
+    // Block translator, created on first use. RunJit returns the cycles the
+    // translated code took, 0 if the instruction has to be interpreted.
+    std::unique_ptr<CPUJit> pJit;
+    uint32_t RunJit();
+    friend class CPUJit;
+
+    // Lockstep engine this CPU is a lane of (see CPULanes.h), if any
+    CPULanes *pLanes = nullptr;
+    int      nLane = 0;
+    friend class CPULanes;
+
+#ifdef MGK_CPU_TRACE
+    // CPU state before the instruction executes
+    struct TRACE_ENTRY {
+        uint32_t cycle;
+        uint16_t pc;
+        int16_t  scanline;
+        int16_t  dot;
+        uint8_t  bytes[3]; // Opcode and the two bytes following it
+        uint8_t  a, x, y, st, sp;
+        uint16_t ea;       // Effective address, or JMP ($nnnn) target
+        uint8_t  value;    // Byte at ea
+    };
+    // Mnemonic and addressing mode as the 6502 decodes the opcode
+    void TraceDecode(uint8_t op, const char *&name, uint8_t &mode,
+                     bool &bOfficial) const;
+    std::vector<TRACE_ENTRY> vTrace; // Sized once, never reallocated
+    uint64_t nTraceCount = 0;
+#endif
+
+#ifdef MGK_CPU_PROFILE
+    struct PROFILE_ENTRY {
+        uint64_t count = 0;
+        uint64_t cycles = 0;
+        uint8_t  opcode = 0x00; // Last opcode seen (per-address entries)
+    };
+    PROFILE_ENTRY opcodeProfile[256];
+    // Keyed by (8KB PRG bank << 16) | PC, bank 0xFFFF when PC is outside ROM
+    std::unordered_map<uint32_t, PROFILE_ENTRY> addrProfile;
+#endif
 };
@@ -0,0 +1,1044 @@
+#include "CPUJit.h"
+#include "Bus.h"
+#include "CPUOpcodes.h"
+#include <cstring>
+#include <initializer_list>
+#ifdef MGK_CPU_JIT_VERIFY
+#include <cstdio>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MGK_CPU_JIT_X64
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+using namespace CPUOpcodes;
+
+namespace {
+
+const uint32_t kCodeSize = 8 << 20;      // Executable memory for blocks
+const uint32_t kMaxBlockBytes = 32 << 10; // Upper bound for one block
+const int kMaxInstructions = 64;          // Per block
+const uint32_t kMaxWindow = 4096;         // Longest run ahead, CPU cycles
+const uint32_t kLongestInstruction = 7;   // CPU cycles, page crossing included
+
+// Instruction writes memory (stack included)
+bool Writes(uint8_t op, uint8_t mode)
+{
+    return op == OP_STA || op == OP_STX || op == OP_STY || op == OP_PHA ||
+           op == OP_PHP || op == OP_JSR || (IsRMW(op) && mode != M_IMP);
+}
+
+// Whether an instruction can be translated, judged before emitting it.
+// Absolute accesses outside RAM and PRG space may reach registers.
+bool CanTranslate(uint8_t op, uint8_t mode, uint16_t abs)
+{
+    if (op == OP_NONE || ClearsI(op))
+        return false;
+    if (mode == M_ABS && op != OP_JMP && op != OP_JSR)
+    {
+        if (Writes(op, mode))
+            return abs < 0x2000;
+        return abs < 0x2000 || abs >= 0x6000;
+    }
+    if (mode == M_IND)
+        return abs < 0x2000;
+    return true;
+}
+
+} // namespace
+
+#ifdef MGK_CPU_JIT_X64
+namespace {
+
+// x86-64 registers. Translated code keeps the State pointer in r8, the
+// cycles used so far in r9d, the budget in r10d and the RAM base in r11, and
+// only uses registers that are volatile in both the SysV and Windows ABIs.
+enum REG { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11 };
+enum CC { CC_O = 0, CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_A = 7 };
+
+// Memory operand [base + index * (1 << scale) + disp]. base is never rsp or
+// r12, and a displacement is always encoded, so no special cases are needed.
+struct MEM {
+    int base;
+    int32_t disp;
+    int index;
+    int scale;
+};
+
+MEM At(int base, int32_t disp, int index = -1, int scale = 0)
+{
+    return {base, disp, index, scale};
+}
+
+const int32_t F_A = offsetof(CPUJit::State, a);
+const int32_t F_X = offsetof(CPUJit::State, x);
+const int32_t F_Y = offsetof(CPUJit::State, y);
+const int32_t F_ST = offsetof(CPUJit::State, st);
+const int32_t F_SP = offsetof(CPUJit::State, sp);
+const int32_t F_PC = offsetof(CPUJit::State, pc);
+const int32_t F_INSTR = offsetof(CPUJit::State, nInstr);
+const int32_t F_EXTRA = offsetof(CPUJit::State, nExtra);
+const int32_t F_RAM = offsetof(CPUJit::State, ram);
+const int32_t F_SLOT = offsetof(CPUJit::State, prgSlot);
+const int32_t F_NZ = offsetof(CPUJit::State, nz);
+
+class Emitter {
+public:
+    uint8_t *p;
+    explicit Emitter(uint8_t *start) : p(start) {}
+
+    void Byte(uint8_t b) { *p++ = b; }
+    void Word(uint16_t v)
+    {
+        memcpy(p, &v, 2);
+        p += 2;
+    }
+    void Dword(uint32_t v)
+    {
+        memcpy(p, &v, 4);
+        p += 4;
+    }
+
+    // op reg, r/m with a memory operand. reg is a register or a /digit.
+    void Op(std::initializer_list<uint8_t> op, int reg, MEM m, bool w = false)
+    {
+        uint8_t rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) |
+                      ((m.index >= 0 && (m.index & 8)) ? 0x02 : 0) |
+                      ((m.base & 8) ? 0x01 : 0);
+        if (rex != 0x40)
+            Byte(rex);
+        for (uint8_t b : op)
+            Byte(b);
+
+        bool bDisp8 = m.disp >= -128 && m.disp <= 127;
+        uint8_t mod = bDisp8 ? 0x40 : 0x80;
+        if (m.index < 0)
+            Byte(mod | (reg & 7) << 3 | (m.base & 7));
+        else
+        {
+            Byte(mod | (reg & 7) << 3 | 4);
+            Byte(m.scale << 6 | (m.index & 7) << 3 | (m.base & 7));
+        }
+        if (bDisp8)
+            Byte((uint8_t)m.disp);
+        else
+            Dword((uint32_t)m.disp);
+    }
+
+    // op reg, rm with a register operand
+    void OpR(std::initializer_list<uint8_t> op, int reg, int rm, bool w = false)
+    {
+        uint8_t rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) |
+                      ((rm & 8) ? 0x01 : 0);
+        if (rex != 0x40)
+            Byte(rex);
+        for (uint8_t b : op)
+            Byte(b);
+        Byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    // mov r32, imm32
+    void MovImm(int reg, uint32_t imm)
+    {
+        if (reg & 8)
+            Byte(0x41);
+        Byte(0xB8 | (reg & 7));
+        Dword(imm);
+    }
+
+    // rel32 jumps. Forward jumps return the end of the instruction, which
+    // Patch later points at the target.
+    uint8_t *Jcc(int cc)
+    {
+        Byte(0x0F);
+        Byte(0x80 | cc);
+        Dword(0);
+        return p;
+    }
+    uint8_t *Jmp()
+    {
+        Byte(0xE9);
+        Dword(0);
+        return p;
+    }
+    void JccTo(int cc, const uint8_t *target) { Patch(Jcc(cc), target); }
+    void JmpTo(const uint8_t *target) { Patch(Jmp(), target); }
+    static void Patch(uint8_t *end, const uint8_t *target)
+    {
+        int32_t rel = (int32_t)(target - end);
+        memcpy(end - 4, &rel, 4);
+    }
+};
+
+} // namespace
+
+class CPUJit::Compiler {
+public:
+    Compiler(uint8_t *code, const OPCODE *decode) : e(code), decode(decode) {}
+
+    // Translate from src, which has nAvail bytes left in its page. Returns
+    // the number of instructions translated.
+    int Translate(uint16_t pc, const uint8_t *src, uint32_t nAvail, bool bROM);
+    uint8_t *End() const { return e.p; }
+
+private:
+    Emitter e;
+    const OPCODE *decode;
+
+    // Start of each translated instruction, for loops inside the block
+    uint16_t labelPC[kMaxInstructions];
+    uint8_t *labelAt[kMaxInstructions];
+    int nLabels = 0;
+
+    // Jumps to the stub that leaves before an instruction, to have the
+    // interpreter run it (budget used up, or an access that is not RAM/PRG)
+    struct ABORT {
+        uint8_t *patch;
+        uint16_t pc;
+    };
+    std::vector<ABORT> vAbort;
+    uint16_t nPC = 0; // Instruction being translated
+    void Abort(uint8_t *patch) { vAbort.push_back({patch, nPC}); }
+
+    // Where an operand lives. LOC_RAM operands are at m; LOC_SLOT ones at a
+    // fixed address in a PRG slot; LOC_DYN ones at the address left in ecx.
+    enum LOC { LOC_IMM, LOC_RAM, LOC_SLOT, LOC_DYN };
+    struct OPERAND {
+        LOC loc;
+        MEM m;
+        uint16_t addr;
+        uint8_t imm;
+    };
+
+    OPERAND Address(uint8_t mode, uint8_t lo, uint16_t abs, bool bPageCycle);
+    void Read(const OPERAND &o);
+    MEM Writable(const OPERAND &o);
+    bool Emit(const OPCODE &d, uint8_t lo, uint16_t abs, uint32_t len);
+    void Branch(uint8_t op, uint8_t lo);
+    uint8_t *Label(uint16_t pc) const;
+
+    void Prologue();
+    void AddCycles(uint8_t n)
+    {
+        e.OpR({0x83}, 0, R9); // add r9d, imm8
+        e.Byte(n);
+    }
+    void SetNZ(int value, int tmp);
+    void MergeFlags(int flags, uint8_t keep);
+    void Return();
+    void Exit(uint16_t pc);
+    void ExitDynamic();
+};
+
+void CPUJit::Compiler::Prologue()
+{
+#ifdef _WIN32
+    e.OpR({0x89}, RCX, R8, true); // mov r8, rcx
+    e.OpR({0x89}, RDX, R10);      // mov r10d, edx
+#else
+    e.OpR({0x89}, RDI, R8, true); // mov r8, rdi
+    e.OpR({0x89}, RSI, R10);      // mov r10d, esi
+#endif
+    e.OpR({0x31}, R9, R9);                   // xor r9d, r9d
+    e.Op({0x8B}, R11, At(R8, F_RAM), true); // mov r11, [state.ram]
+}
+
+// Set N and Z from the byte zero extended in value, using tmp as scratch
+void CPUJit::Compiler::SetNZ(int value, int tmp)
+{
+    e.Op({0x8A}, tmp, At(R8, F_NZ, value)); // mov tmp8, [nz + value]
+    MergeFlags(tmp, 0x7D);
+}
+
+// st = (st & keep) | flags8
+void CPUJit::Compiler::MergeFlags(int flags, uint8_t keep)
+{
+    e.Op({0x80}, 4, At(R8, F_ST)); // and byte [st], keep
+    e.Byte(keep);
+    e.Op({0x08}, flags, At(R8, F_ST)); // or [st], flags8
+}
+
+void CPUJit::Compiler::Return()
+{
+    e.OpR({0x89}, R9, RAX); // mov eax, r9d
+    e.Byte(0xC3);           // ret
+}
+
+void CPUJit::Compiler::Exit(uint16_t pc)
+{
+    e.Byte(0x66); // mov word [pc], imm16
+    e.Op({0xC7}, 0, At(R8, F_PC));
+    e.Word(pc);
+    Return();
+}
+
+// Leave with the new pc in ax
+void CPUJit::Compiler::ExitDynamic()
+{
+    e.Byte(0x66); // mov [pc], ax
+    e.Op({0x89}, RAX, At(R8, F_PC));
+    Return();
+}
+
+uint8_t *CPUJit::Compiler::Label(uint16_t pc) const
+{
+    for (int i = 0; i < nLabels; i++)
+        if (labelPC[i] == pc)
+            return labelAt[i];
+    return nullptr;
+}
+
+CPUJit::Compiler::OPERAND CPUJit::Compiler::Address(uint8_t mode, uint8_t lo,
+                                                    uint16_t abs,
+                                                    bool bPageCycle)
+{
+    OPERAND o = {LOC_DYN, At(R11, 0, RCX), abs, lo};
+    switch (mode)
+    {
+    case M_IMM:
+        o.loc = LOC_IMM;
+        break;
+
+    case M_ZP0:
+        o.loc = LOC_RAM;
+        o.m = At(R11, lo);
+        break;
+
+    case M_ZPX:
+    case M_ZPY:
+        e.Op({0x0F, 0xB6}, RCX, At(R8, mode == M_ZPX ? F_X : F_Y));
+        e.OpR({0x80}, 0, RCX); // add cl, lo
+        e.Byte(lo);
+        o.loc = LOC_RAM;
+        break;
+
+    case M_ABS:
+        if (abs < 0x2000)
+        {
+            o.loc = LOC_RAM;
+            o.m = At(R11, abs & 0x07FF);
+        }
+        else
+            o.loc = LOC_SLOT;
+        break;
+
+    case M_ABX:
+    case M_ABY:
+        // eax = lo + index, so bit 8 is the page crossing
+        e.Op({0x0F, 0xB6}, RAX, At(R8, mode == M_ABX ? F_X : F_Y));
+        e.OpR({0x81}, 0, RAX); // add eax, abs & 0xFF
+        e.Dword(abs & 0x00FF);
+        e.OpR({0x89}, RAX, RCX); // mov ecx, eax
+        e.OpR({0x81}, 0, RCX);   // add ecx, abs & 0xFF00
+        e.Dword(abs & 0xFF00);
+        e.OpR({0x81}, 4, RCX); // and ecx, 0xFFFF
+        e.Dword(0xFFFF);
+        if (bPageCycle)
+        {
+            e.OpR({0xC1}, 5, RAX); // shr eax, 8
+            e.Byte(8);
+            e.Op({0x89}, RAX, At(R8, F_EXTRA));
+        }
+        break;
+
+    case M_IZX:
+        e.Op({0x0F, 0xB6}, RAX, At(R8, F_X));
+        e.OpR({0x80}, 0, RAX); // add al, lo
+        e.Byte(lo);
+        e.Op({0x0F, 0xB6}, RCX, At(R11, 0, RAX)); // pointer low byte
+        e.OpR({0xFE}, 0, RAX);                    // inc al
+        e.Op({0x0F, 0xB6}, RAX, At(R11, 0, RAX)); // pointer high byte
+        e.OpR({0xC1}, 4, RAX);                    // shl eax, 8
+        e.Byte(8);
+        e.OpR({0x09}, RAX, RCX); // or ecx, eax
+        break;
+
+    case M_IZY:
+        e.Op({0x0F, 0xB6}, RAX, At(R11, lo));
+        e.Op({0x0F, 0xB6}, RDX, At(R8, F_Y));
+        e.OpR({0x01}, RDX, RAX); // add eax, edx
+        e.Op({0x0F, 0xB6}, RCX, At(R11, (uint8_t)(lo + 1)));
+        e.OpR({0xC1}, 4, RCX); // shl ecx, 8
+        e.Byte(8);
+        e.OpR({0x01}, RAX, RCX); // add ecx, eax
+        e.OpR({0x81}, 4, RCX);   // and ecx, 0xFFFF
+        e.Dword(0xFFFF);
+        if (bPageCycle)
+        {
+            e.OpR({0xC1}, 5, RAX); // shr eax, 8
+            e.Byte(8);
+            e.Op({0x89}, RAX, At(R8, F_EXTRA));
+        }
+        break;
+    }
+    return o;
+}
+
+// Load an operand into edx, zero extended
+void CPUJit::Compiler::Read(const OPERAND &o)
+{
+    switch (o.loc)
+    {
+    case LOC_IMM:
+        e.MovImm(RDX, o.imm);
+        break;
+
+    case LOC_RAM:
+        e.Op({0x0F, 0xB6}, RDX, o.m);
+        break;
+
+    case LOC_SLOT:
+        e.Op({0x8B}, RAX, At(R8, F_SLOT), true);
+        e.Op({0x8B}, RAX, At(RAX, (o.addr >> 13) * 8), true);
+        e.OpR({0x85}, RAX, RAX, true); // test rax, rax
+        Abort(e.Jcc(CC_E));
+        e.Op({0x0F, 0xB6}, RDX, At(RAX, o.addr & 0x1FFF));
+        break;
+
+    case LOC_DYN:
+    {
+        e.OpR({0x81}, 7, RCX); // cmp ecx, 0x2000
+        e.Dword(0x2000);
+        uint8_t *notRAM = e.Jcc(CC_AE);
+        e.OpR({0x89}, RCX, RDX); // mov edx, ecx
+        e.OpR({0x81}, 4, RDX);   // and edx, 0x7FF
+        e.Dword(0x07FF);
+        e.Op({0x0F, 0xB6}, RDX, At(R11, 0, RDX));
+        uint8_t *done = e.Jmp();
+
+        // PRG slot, as long as it is plain memory
+        Emitter::Patch(notRAM, e.p);
+        e.OpR({0x81}, 7, RCX); // cmp ecx, 0x6000
+        e.Dword(0x6000);
+        Abort(e.Jcc(CC_B));
+        e.OpR({0x89}, RCX, RDX); // mov edx, ecx
+        e.OpR({0xC1}, 5, RDX);   // shr edx, 13
+        e.Byte(13);
+        e.Op({0x8B}, RAX, At(R8, F_SLOT), true);
+        e.Op({0x8B}, RAX, At(RAX, 0, RDX, 3), true);
+        e.OpR({0x85}, RAX, RAX, true); // test rax, rax
+        Abort(e.Jcc(CC_E));
+        e.OpR({0x89}, RCX, RDX); // mov edx, ecx
+        e.OpR({0x81}, 4, RDX);   // and edx, 0x1FFF
+        e.Dword(0x1FFF);
+        e.Op({0x0F, 0xB6}, RDX, At(RAX, 0, RDX));
+        Emitter::Patch(done, e.p);
+        break;
+    }
+    }
+}
+
+// Memory operand for a store. Only internal RAM is written by translated
+// code; anything else is left to the interpreter.
+MEM CPUJit::Compiler::Writable(const OPERAND &o)
+{
+    if (o.loc == LOC_DYN)
+    {
+        e.OpR({0x81}, 7, RCX); // cmp ecx, 0x2000
+        e.Dword(0x2000);
+        Abort(e.Jcc(CC_AE));
+        e.OpR({0x81}, 4, RCX); // and ecx, 0x7FF
+        e.Dword(0x07FF);
+    }
+    return o.m;
+}
+
+void CPUJit::Compiler::Branch(uint8_t op, uint8_t lo)
+{
+    uint8_t flag = 0;
+    bool bSet = true;
+    switch (op)
+    {
+    case OP_BCC: flag = 0x01; bSet = false; break;
+    case OP_BCS: flag = 0x01; break;
+    case OP_BNE: flag = 0x02; bSet = false; break;
+    case OP_BEQ: flag = 0x02; break;
+    case OP_BVC: flag = 0x40; bSet = false; break;
+    case OP_BVS: flag = 0x40; break;
+    case OP_BPL: flag = 0x80; bSet = false; break;
+    case OP_BMI: flag = 0x80; break;
+    }
+
+    uint16_t next = nPC + 2;
+    uint16_t target = next + (int8_t)lo;
+    uint8_t nTaken = 3 + ((target & 0xFF00) != (next & 0xFF00));
+
+    e.Op({0xF6}, 0, At(R8, F_ST)); // test byte [st], flag
+    e.Byte(flag);
+    uint8_t *notTaken = e.Jcc(bSet ? CC_E : CC_NE);
+    AddCycles(nTaken);
+    if (uint8_t *loop = Label(target))
+        e.JmpTo(loop);
+    else
+        Exit(target);
+    Emitter::Patch(notTaken, e.p);
+    AddCycles(2);
+}
+
+// Emit one instruction, cycles included. Returns true if it ends the block.
+bool CPUJit::Compiler::Emit(const OPCODE &d, uint8_t lo, uint16_t abs,
+                            uint32_t len)
+{
+    bool bPageCycle = HasPageCycle(d.op, d.mode);
+    uint16_t next = nPC + len;
+
+    switch (d.op)
+    {
+    case OP_LDA:
+    case OP_LDX:
+    case OP_LDY:
+    {
+        int32_t reg = d.op == OP_LDA ? F_A : d.op == OP_LDX ? F_X : F_Y;
+        Read(Address(d.mode, lo, abs, bPageCycle));
+        e.Op({0x88}, RDX, At(R8, reg));
+        SetNZ(RDX, RAX);
+        break;
+    }
+
+    case OP_STA:
+    case OP_STX:
+    case OP_STY:
+    {
+        int32_t reg = d.op == OP_STA ? F_A : d.op == OP_STX ? F_X : F_Y;
+        MEM m = Writable(Address(d.mode, lo, abs, false));
+        e.Op({0x8A}, RAX, At(R8, reg));
+        e.Op({0x88}, RAX, m);
+        break;
+    }
+
+    case OP_AND:
+    case OP_ORA:
+    case OP_EOR:
+    {
+        uint8_t alu = d.op == OP_AND ? 0x20 : d.op == OP_ORA ? 0x08 : 0x30;
+        Read(Address(d.mode, lo, abs, bPageCycle));
+        e.Op({0x8A}, RAX, At(R8, F_A));
+        e.OpR({alu}, RDX, RAX); // and/or/xor al, dl
+        e.Op({0x88}, RAX, At(R8, F_A));
+        e.OpR({0x0F, 0xB6}, RAX, RAX); // movzx eax, al
+        SetNZ(RAX, RDX);
+        break;
+    }
+
+    case OP_ADC:
+    case OP_SBC:
+        // SBC is ADC of the inverted operand; x86 carry and overflow then
+        // match the 6502's
+        Read(Address(d.mode, lo, abs, bPageCycle));
+        if (d.op == OP_SBC)
+            e.OpR({0xF6}, 2, RDX); // not dl
+        e.Op({0x8A}, RCX, At(R8, F_ST));
+        e.OpR({0xD0}, 5, RCX); // shr cl, 1: CF = C
+        e.Op({0x8A}, RAX, At(R8, F_A));
+        e.OpR({0x10}, RDX, RAX);       // adc al, dl
+        e.OpR({0x0F, 0x92}, 0, RCX);   // setc cl
+        e.OpR({0x0F, 0x90}, 0, RDX);   // seto dl
+        e.OpR({0xC0}, 4, RDX);         // shl dl, 6
+        e.Byte(6);
+        e.OpR({0x08}, RDX, RCX); // or cl, dl
+        e.Op({0x88}, RAX, At(R8, F_A));
+        e.OpR({0x0F, 0xB6}, RAX, RAX);
+        e.Op({0x0A}, RCX, At(R8, F_NZ, RAX)); // or cl, [nz + rax]
+        MergeFlags(RCX, 0x3C);
+        break;
+
+    case OP_CMP:
+    case OP_CPX:
+    case OP_CPY:
+    {
+        int32_t reg = d.op == OP_CMP ? F_A : d.op == OP_CPX ? F_X : F_Y;
+        Read(Address(d.mode, lo, abs, bPageCycle));
+        e.Op({0x8A}, RAX, At(R8, reg));
+        e.OpR({0x28}, RDX, RAX);     // sub al, dl
+        e.OpR({0x0F, 0x93}, 0, RCX); // setae cl: C = no borrow
+        e.OpR({0x0F, 0xB6}, RAX, RAX);
+        e.Op({0x0A}, RCX, At(R8, F_NZ, RAX));
+        MergeFlags(RCX, 0x7C);
+        break;
+    }
+
+    case OP_BIT:
+        Read(Address(d.mode, lo, abs, false));
+        e.OpR({0x88}, RDX, RCX); // mov cl, dl
+        e.OpR({0x80}, 4, RCX);   // and cl, N | V
+        e.Byte(0xC0);
+        e.Op({0x22}, RDX, At(R8, F_A)); // and dl, [a]
+        e.OpR({0x0F, 0x94}, 0, RAX);    // setz al
+        e.OpR({0x00}, RAX, RAX);        // add al, al: Z
+        e.OpR({0x08}, RAX, RCX);        // or cl, al
+        MergeFlags(RCX, 0x3D);
+        break;
+
+    case OP_ASL:
+    case OP_LSR:
+    case OP_ROL:
+    case OP_ROR:
+    {
+        MEM m = At(R8, F_A);
+        if (d.mode != M_IMP)
+            m = Writable(Address(d.mode, lo, abs, false));
+        if (d.op == OP_ROL || d.op == OP_ROR)
+        {
+            e.Op({0x8A}, RDX, At(R8, F_ST));
+            e.OpR({0xD0}, 5, RDX); // shr dl, 1: CF = C
+        }
+        e.Op({0x8A}, RAX, m);
+        int shift = d.op == OP_ROL   ? 2 // rcl
+                    : d.op == OP_ROR ? 3 // rcr
+                    : d.op == OP_ASL ? 4 // shl
+                                     : 5; // shr
+        e.OpR({0xD0}, shift, RAX);   // al, 1
+        e.OpR({0x0F, 0x92}, 0, RDX); // setc dl
+        e.Op({0x88}, RAX, m);
+        e.OpR({0x0F, 0xB6}, RAX, RAX);
+        e.Op({0x0A}, RDX, At(R8, F_NZ, RAX));
+        MergeFlags(RDX, 0x7C);
+        break;
+    }
+
+    case OP_INC:
+    case OP_DEC:
+    {
+        MEM m = Writable(Address(d.mode, lo, abs, false));
+        e.Op({0x8A}, RAX, m);
+        e.OpR({0xFE}, d.op == OP_INC ? 0 : 1, RAX); // inc/dec al
+        e.Op({0x88}, RAX, m);
+        e.OpR({0x0F, 0xB6}, RAX, RAX);
+        SetNZ(RAX, RDX);
+        break;
+    }
+
+    case OP_INX:
+    case OP_INY:
+    case OP_DEX:
+    case OP_DEY:
+    {
+        int32_t reg = (d.op == OP_INX || d.op == OP_DEX) ? F_X : F_Y;
+        e.Op({0xFE}, (d.op == OP_INX || d.op == OP_INY) ? 0 : 1, At(R8, reg));
+        e.Op({0x0F, 0xB6}, RAX, At(R8, reg));
+        SetNZ(RAX, RDX);
+        break;
+    }
+
+    case OP_TAX:
+    case OP_TAY:
+    case OP_TXA:
+    case OP_TYA:
+    case OP_TSX:
+    case OP_TXS:
+    {
+        int32_t src = F_A, dst = F_X;
+        switch (d.op)
+        {
+        case OP_TAY: dst = F_Y; break;
+        case OP_TXA: src = F_X; dst = F_A; break;
+        case OP_TYA: src = F_Y; dst = F_A; break;
+        case OP_TSX: src = F_SP; break;
+        case OP_TXS: src = F_X; dst = F_SP; break;
+        }
+        e.Op({0x0F, 0xB6}, RAX, At(R8, src));
+        e.Op({0x88}, RAX, At(R8, dst));
+        if (d.op != OP_TXS)
+            SetNZ(RAX, RDX);
+        break;
+    }
+
+    case OP_CLC:
+    case OP_CLD:
+    case OP_CLV:
+    case OP_SEC:
+    case OP_SED:
+    case OP_SEI:
+    {
+        bool bSet = d.op == OP_SEC || d.op == OP_SED || d.op == OP_SEI;
+        uint8_t flag = (d.op == OP_CLC || d.op == OP_SEC)   ? 0x01
+                       : (d.op == OP_CLD || d.op == OP_SED) ? 0x08
+                       : d.op == OP_SEI                     ? 0x04
+                                                            : 0x40;
+        e.Op({0x80}, bSet ? 1 : 4, At(R8, F_ST)); // or/and byte [st]
+        e.Byte(bSet ? flag : (uint8_t)~flag);
+        break;
+    }
+
+    case OP_NOP:
+        break;
+
+    case OP_PHA:
+    case OP_PHP:
+        e.Op({0x8A}, RAX, At(R8, d.op == OP_PHA ? F_A : F_ST));
+        if (d.op == OP_PHP)
+        {
+            e.OpR({0x80}, 1, RAX); // or al, B | U
+            e.Byte(0x30);
+        }
+        e.Op({0x0F, 0xB6}, RCX, At(R8, F_SP));
+        e.Op({0x88}, RAX, At(R11, 0x0100, RCX));
+        e.Op({0xFE}, 1, At(R8, F_SP)); // dec byte [sp]
+        break;
+
+    case OP_PLA:
+        e.Op({0xFE}, 0, At(R8, F_SP)); // inc byte [sp]
+        e.Op({0x0F, 0xB6}, RCX, At(R8, F_SP));
+        e.Op({0x0F, 0xB6}, RAX, At(R11, 0x0100, RCX));
+        e.Op({0x88}, RAX, At(R8, F_A));
+        SetNZ(RAX, RDX);
+        break;
+
+    case OP_BCC:
+    case OP_BCS:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BMI:
+    case OP_BPL:
+    case OP_BVC:
+    case OP_BVS:
+        Branch(d.op, lo);
+        return false;
+
+    case OP_JMP:
+        AddCycles(d.cycles);
+        if (d.mode == M_ABS)
+        {
+            if (uint8_t *loop = Label(abs))
+                e.JmpTo(loop);
+            else
+                Exit(abs);
+        }
+        else
+        {
+            // The pointer's high byte does not carry into the next page
+            uint16_t hi = (abs & 0xFF00) | ((abs + 1) & 0x00FF);
+            e.Op({0x0F, 0xB6}, RAX, At(R11, abs & 0x07FF));
+            e.Op({0x0F, 0xB6}, RCX, At(R11, hi & 0x07FF));
+            e.OpR({0xC1}, 4, RCX); // shl ecx, 8
+            e.Byte(8);
+            e.OpR({0x09}, RCX, RAX); // or eax, ecx
+            ExitDynamic();
+        }
+        return true;
+
+    case OP_JSR:
+    {
+        uint16_t ret = next - 1;
+        e.Op({0x0F, 0xB6}, RCX, At(R8, F_SP));
+        e.Op({0xC6}, 0, At(R11, 0x0100, RCX)); // mov byte [stack], ret >> 8
+        e.Byte(ret >> 8);
+        e.OpR({0xFE}, 1, RCX); // dec cl
+        e.Op({0xC6}, 0, At(R11, 0x0100, RCX));
+        e.Byte(ret & 0xFF);
+        e.OpR({0xFE}, 1, RCX);
+        e.Op({0x88}, RCX, At(R8, F_SP));
+        AddCycles(d.cycles);
+        Exit(abs);
+        return true;
+    }
+
+    case OP_RTS:
+        e.Op({0x0F, 0xB6}, RCX, At(R8, F_SP));
+        e.OpR({0xFE}, 0, RCX); // inc cl
+        e.Op({0x0F, 0xB6}, RAX, At(R11, 0x0100, RCX));
+        e.OpR({0xFE}, 0, RCX);
+        e.Op({0x0F, 0xB6}, RDX, At(R11, 0x0100, RCX));
+        e.Op({0x88}, RCX, At(R8, F_SP));
+        e.OpR({0xC1}, 4, RDX); // shl edx, 8
+        e.Byte(8);
+        e.OpR({0x09}, RDX, RAX); // or eax, edx
+        e.OpR({0xFF}, 0, RAX);   // inc eax
+        AddCycles(d.cycles);
+        ExitDynamic();
+        return true;
+    }
+
+    AddCycles(d.cycles);
+    if (bPageCycle)
+        e.Op({0x03}, R9, At(R8, F_EXTRA)); // add r9d, [extra]
+    return false;
+}
+
+int CPUJit::Compiler::Translate(uint16_t pc, const uint8_t *src,
+                                uint32_t nAvail, bool bROM)
+{
+    Prologue();
+
+    uint32_t off = 0;
+    bool bEnded = false;
+    while (nLabels < kMaxInstructions && !bEnded && off < nAvail)
+    {
+        const OPCODE &d = decode[src[off]];
+        uint32_t len = Length(d.mode);
+        if (off + len > nAvail)
+            break;
+        uint8_t lo = len > 1 ? src[off + 1] : 0;
+        uint16_t abs = len > 2 ? (src[off + 2] << 8 | lo) : lo;
+        if (!CanTranslate(d.op, d.mode, abs))
+            break;
+
+        nPC = pc + off;
+        labelPC[nLabels] = nPC;
+        labelAt[nLabels] = e.p;
+        nLabels++;
+
+#ifdef MGK_CPU_JIT_VERIFY
+        e.Op({0xFF}, 0, At(R8, F_INSTR)); // inc dword [instr]
+#endif
+        // Stop once the budget is used up
+        e.OpR({0x39}, R10, R9); // cmp r9d, r10d
+        Abort(e.Jcc(CC_A));
+
+        bEnded = Emit(d, lo, abs, len);
+        off += len;
+
+        // Code outside ROM may be overwritten by its own stores, so it is
+        // checked again before anything after a store runs
+        if (!bEnded && !bROM && Writes(d.op, d.mode))
+        {
+            Exit(pc + off);
+            bEnded = true;
+        }
+    }
+    if (nLabels == 0)
+        return 0;
+    if (!bEnded)
+        Exit(pc + off);
+
+    // Abort stubs, one per instruction
+    for (size_t i = 0; i < vAbort.size();)
+    {
+        uint16_t at = vAbort[i].pc;
+        uint8_t *stub = e.p;
+#ifdef MGK_CPU_JIT_VERIFY
+        e.Op({0xFF}, 1, At(R8, F_INSTR)); // dec dword [instr]
+#endif
+        Exit(at);
+        for (; i < vAbort.size() && vAbort[i].pc == at; i++)
+            Emitter::Patch(vAbort[i].patch, stub);
+    }
+    return nLabels;
+}
+#endif
+
+CPUJit::CPUJit(CPU6502 &cpu, Bus &bus) : cpu(cpu), bus(bus)
+{
+    using c = CPU6502;
+    cpu.DecodeOpcodes(decode);
+
+    memset(&state, 0, sizeof(state));
+    state.ram = bus.ram.data();
+    for (int v = 0; v < 256; v++)
+        state.nz[v] = (v == 0 ? c::Z : 0) | (v & c::N);
+
+#ifdef MGK_CPU_JIT_X64
+#ifdef _WIN32
+    pCode = (uint8_t *)VirtualAlloc(nullptr, kCodeSize,
+                                    MEM_COMMIT | MEM_RESERVE,
+                                    PAGE_EXECUTE_READWRITE);
+#else
+    void *p = mmap(nullptr, kCodeSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pCode = p == MAP_FAILED ? nullptr : (uint8_t *)p;
+#endif
+#endif
+}
+
+CPUJit::~CPUJit()
+{
+#ifdef MGK_CPU_JIT_X64
+    if (pCode)
+    {
+#ifdef _WIN32
+        VirtualFree(pCode, 0, MEM_RELEASE);
+#else
+        munmap(pCode, kCodeSize);
+#endif
+    }
+#endif
+}
+
+void CPUJit::Flush()
+{
+    vBlocks.clear();
+    mapRAMBlocks.clear();
+    vROMBlocks.assign(nPRGROMSize, -1);
+    nCodeUsed = 0;
+}
+
+int32_t CPUJit::Translate(uint16_t pc, const uint8_t *src, uint32_t nAvail,
+                          bool bROM)
+{
+    Block b;
+    b.pc = pc;
+#ifdef MGK_CPU_JIT_X64
+    Compiler c(pCode + nCodeUsed, decode);
+    if (c.Translate(pc, src, nAvail, bROM) > 0)
+    {
+        b.fn = (BlockFn)(pCode + nCodeUsed);
+        nCodeUsed = (c.End() - pCode + 15) & ~(size_t)15;
+    }
+#endif
+    if (!bROM)
+    {
+        // Keep enough bytes to cover every instruction translated
+        uint32_t n = 3 * kMaxInstructions;
+        if (nAvail < n)
+            n = nAvail;
+        b.src.assign(src, src + n);
+    }
+    vBlocks.push_back(std::move(b));
+    return (int32_t)vBlocks.size() - 1;
+}
+
+uint32_t CPUJit::Run(uint32_t nWindow)
+{
+    // Every instruction of a block has to complete inside the window
+    if (!pCode || nWindow < kLongestInstruction)
+        return 0;
+
+    Cartridge *cart = bus.cart.get();
+    if (cart != pCart)
+    {
+        pCart = cart;
+        pPRGROM = cart ? cart->GetPRGROM().data() : nullptr;
+        nPRGROMSize = cart ? cart->GetPRGROM().size() : 0;
+        state.prgSlot = cart ? cart->GetPRGSlots() : nullptr;
+        Flush();
+    }
+    if (cart && cart->GetPRGROMWrites() != nPRGROMWrites)
+    {
+        nPRGROMWrites = cart->GetPRGROMWrites();
+        Flush();
+    }
+    if (nCodeUsed + kMaxBlockBytes > kCodeSize)
+        Flush();
+
+    // Host address of the code and the bytes left in its page
+    uint16_t pc = cpu.pc;
+    const uint8_t *src;
+    uint32_t nAvail;
+    if (pc < 0x2000)
+    {
+        src = &bus.ram[pc & 0x07FF];
+        nAvail = 0x0800 - (pc & 0x07FF);
+    }
+    else if (pc >= 0x6000 && state.prgSlot && state.prgSlot[pc >> 13])
+    {
+        src = state.prgSlot[pc >> 13] + (pc & 0x1FFF);
+        nAvail = 0x2000 - (pc & 0x1FFF);
+    }
+    else
+        return 0;
+
+    // Find the block translated for this address and pc
+    bool bROM = src >= pPRGROM && src < pPRGROM + nPRGROMSize;
+    int32_t *pHead;
+    if (bROM)
+        pHead = &vROMBlocks[src - pPRGROM];
+    else
+        pHead = &mapRAMBlocks.emplace(src, -1).first->second;
+
+    int32_t i = *pHead;
+    while (i >= 0 && vBlocks[i].pc != pc)
+        i = vBlocks[i].next;
+    if (i >= 0 && !bROM &&
+        memcmp(vBlocks[i].src.data(), src, vBlocks[i].src.size()) != 0)
+        i = -1;
+    if (i < 0)
+    {
+        i = Translate(pc, src, nAvail, bROM);
+        vBlocks[i].next = *pHead;
+        *pHead = i;
+    }
+
+    BlockFn fn = vBlocks[i].fn;
+    if (!fn)
+        return 0;
+
+    state.a = cpu.a;
+    state.x = cpu.x;
+    state.y = cpu.y;
+    state.st = cpu.st | CPU6502::U;
+    state.sp = cpu.sp;
+    state.pc = pc;
+#ifdef MGK_CPU_JIT_VERIFY
+    State before = state;
+    uint8_t ramBefore[2048];
+    memcpy(ramBefore, bus.ram.data(), sizeof(ramBefore));
+    state.nInstr = 0;
+#endif
+
+    if (nWindow > kMaxWindow)
+        nWindow = kMaxWindow;
+    uint32_t nCycles = fn(&state, nWindow - kLongestInstruction);
+
+#ifdef MGK_CPU_JIT_VERIFY
+    nCycles = Verify(before, ramBefore, nCycles);
+#endif
+    cpu.a = state.a;
+    cpu.x = state.x;
+    cpu.y = state.y;
+    cpu.st = state.st;
+    cpu.sp = state.sp;
+    cpu.pc = state.pc;
+    return nCycles;
+}
+
+#ifdef MGK_CPU_JIT_VERIFY
+// Replay the block's instructions in the interpreter from the same state and
+// report any difference. The interpreter's result is kept.
+uint32_t CPUJit::Verify(const State &before, const uint8_t *ramBefore,
+                        uint32_t nCycles)
+{
+    State after = state;
+    uint8_t ramAfter[2048];
+    memcpy(ramAfter, bus.ram.data(), sizeof(ramAfter));
+
+    memcpy(bus.ram.data(), ramBefore, sizeof(ramAfter));
+    cpu.a = before.a;
+    cpu.x = before.x;
+    cpu.y = before.y;
+    cpu.st = before.st;
+    cpu.sp = before.sp;
+    cpu.pc = before.pc;
+    uint32_t nInterp = 0;
+    for (uint32_t n = 0; n < after.nInstr; n++)
+    {
+        cpu.Step();
+        nInterp += cpu.cycles;
+    }
+
+    int nRAM = -1;
+    for (int n = 0; n < 2048 && nRAM < 0; n++)
+        if (bus.ram[n] != ramAfter[n])
+            nRAM = n;
+    if (cpu.a != after.a || cpu.x != after.x || cpu.y != after.y ||
+        cpu.st != after.st || cpu.sp != after.sp || cpu.pc != after.pc ||
+        nInterp != nCycles || nRAM >= 0)
+    {
+        fprintf(stderr,
+                "JIT $%04X (%u instructions): A:%02X/%02X X:%02X/%02X "
+                "Y:%02X/%02X P:%02X/%02X SP:%02X/%02X PC:%04X/%04X "
+                "CYC:%u/%u",
+                before.pc, after.nInstr, after.a, cpu.a, after.x, cpu.x,
+                after.y, cpu.y, after.st, cpu.st, after.sp, cpu.sp, after.pc,
+                cpu.pc, nCycles, nInterp);
+        if (nRAM >= 0)
+            fprintf(stderr, " RAM $%04X:%02X/%02X", nRAM, ramAfter[nRAM],
+                    bus.ram[nRAM]);
+        fprintf(stderr, "\n");
+    }
+
+    state.a = cpu.a;
+    state.x = cpu.x;
+    state.y = cpu.y;
+    state.st = cpu.st;
+    state.sp = cpu.sp;
+    state.pc = cpu.pc;
+    return nInterp;
+}
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+#include "CPUOpcodes.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Bus;
+class Cartridge;
+class CPU6502;
+
+// Block translator for CPU6502 (x86-64 hosts; elsewhere every instruction is
+// interpreted).
+//
+// Runs of instructions that only touch internal RAM and plain PRG memory are
+// translated to native code and executed in one go, ahead of the rest of the
+// system. Nothing else can see those accesses, so this is exact as long as no
+// interrupt arrives in between: blocks get the bus's interrupt free window and
+// stop before any instruction that might not complete inside it.
+// Instructions that may reach PPU, APU or mapper registers end a block and
+// are left to the interpreter, so I/O still happens on its exact cycle.
+//
+// ROM blocks are keyed by PRG ROM offset, so a bank switch selects other
+// blocks instead of invalidating them. Code in RAM is compared with the bytes
+// it was translated from each time it is entered.
+class CPUJit {
+public:
+    CPUJit(CPU6502 &cpu, Bus &bus);
+    ~CPUJit();
+
+    // Run translated code at cpu.pc for at most nWindow cycles, the time
+    // before an interrupt could arrive. Returns the cycles taken, or 0 if the
+    // instruction at pc has to be interpreted.
+    uint32_t Run(uint32_t nWindow);
+
+    // Drop every translated block
+    void Flush();
+
+    // CPU state as seen by translated code
+    struct State {
+        uint8_t  a, x, y, st, sp;
+        uint8_t  pad0[3];
+        uint16_t pc;
+        uint16_t pad1;
+        uint32_t nInstr; // Instructions run (MGK_CPU_JIT_VERIFY builds)
+        uint32_t nExtra; // Page crossing cycle of the current instruction
+        uint8_t  *ram;
+        uint8_t  *const *prgSlot;
+        uint8_t  nz[256]; // N and Z flags for each result
+    };
+
+private:
+    CPU6502 &cpu;
+    Bus &bus;
+
+    // Decoded form of the interpreter's opcode table
+    typedef CPUOpcodes::OPCODE OPCODE;
+
+    typedef uint32_t (*BlockFn)(State *, uint32_t);
+    struct Block {
+        uint16_t pc = 0;
+        int32_t  next = -1;       // Next block at the same host address
+        BlockFn  fn = nullptr;    // nullptr: interpret the first instruction
+        std::vector<uint8_t> src; // Bytes translated, for code outside ROM
+    };
+    std::vector<Block> vBlocks;
+
+    // Head of the block list for each PRG ROM byte, and for other memory
+    std::vector<int32_t> vROMBlocks;
+    std::unordered_map<const uint8_t *, int32_t> mapRAMBlocks;
+
+    State state;
+    OPCODE decode[256];
+
+    // Cartridge the cache was built for
+    Cartridge *pCart = nullptr;
+    const uint8_t *pPRGROM = nullptr;
+    size_t nPRGROMSize = 0;
+    uint32_t nPRGROMWrites = 0;
+
+    // Executable memory for translated code
+    uint8_t *pCode = nullptr;
+    size_t nCodeUsed = 0;
+
+    class Compiler;
+    int32_t Translate(uint16_t pc, const uint8_t *src, uint32_t nAvail,
+                      bool bROM);
+
+#ifdef MGK_CPU_JIT_VERIFY
+    uint32_t Verify(const State &before, const uint8_t *ramBefore,
+                    uint32_t nCycles);
+#endif
+};
@@ -0,0 +1,746 @@
+#include "CPULanes.h"
+#include "Bus.h"
+#include "CPUOpcodes.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace CPUOpcodes;
+
+namespace {
+
+const uint32_t kLongestInstruction = 7; // CPU cycles, page crossing included
+
+const uint8_t C = CPU6502::C, Z = CPU6502::Z, I = CPU6502::I;
+const uint8_t D = CPU6502::D, B = CPU6502::B, U = CPU6502::U;
+const uint8_t V = CPU6502::V, N = CPU6502::N;
+
+// Operations that read their operand from memory
+bool Reads(uint8_t op, uint8_t mode)
+{
+    switch (op)
+    {
+    case OP_ADC: case OP_AND: case OP_BIT: case OP_CMP: case OP_CPX:
+    case OP_CPY: case OP_EOR: case OP_LDA: case OP_LDX: case OP_LDY:
+    case OP_ORA: case OP_SBC:
+        return mode != M_IMM;
+    default:
+        return IsRMW(op) && mode != M_IMP;
+    }
+}
+
+bool Writes(uint8_t op, uint8_t mode)
+{
+    return op == OP_STA || op == OP_STX || op == OP_STY ||
+           (IsRMW(op) && mode != M_IMP);
+}
+
+// Host byte behind a CPU address if reading it has no side effects:
+// internal RAM or a plain PRG slot
+inline uint8_t *Plain(uint8_t *ram, uint8_t *const *slot, uint16_t addr)
+{
+    if (addr < 0x2000)
+        return ram + (addr & 0x07FF);
+    if (addr >= 0x6000 && slot && slot[addr >> 13])
+        return slot[addr >> 13] + (addr & 0x1FFF);
+    return nullptr;
+}
+
+inline uint8_t NZ(uint8_t v) { return (v == 0 ? Z : 0) | (v & N); }
+
+} // namespace
+
+CPULanes::CPULanes()
+{
+    // Decoded from a CPU's table, so both always agree
+    CPU6502().DecodeOpcodes(decode);
+}
+
+CPULanes::~CPULanes()
+{
+    for (LANE &l : vLanes)
+        l.bus->cpu.pLanes = nullptr;
+}
+
+void CPULanes::Attach(Bus &bus)
+{
+    LANE l;
+    l.bus = &bus;
+    if (bus.cart)
+    {
+        l.nPRGROMWrites = bus.cart->GetPRGROMWrites();
+        // Code in ROM is compared by offset only if every lane has the same
+        const Bus *first = vLanes.empty() ? &bus : vLanes[0].bus;
+        l.bSameROM = first->cart &&
+                     first->cart->GetPRGROM() == bus.cart->GetPRGROM();
+    }
+    bus.cpu.pLanes = this;
+    bus.cpu.nLane = (int)vLanes.size();
+    vLanes.push_back(l);
+}
+
+void CPULanes::Clock()
+{
+    nDot++;
+    for (LANE &l : vLanes)
+        l.bus->clock();
+}
+
+void CPULanes::Frame()
+{
+    size_t nDone = 0;
+    std::vector<bool> vDone(vLanes.size());
+    while (nDone < vLanes.size())
+    {
+        Clock();
+        for (size_t i = 0; i < vLanes.size(); i++)
+        {
+            if (!vDone[i] && vLanes[i].bus->ppu.frame_complete)
+            {
+                vDone[i] = true;
+                nDone++;
+            }
+        }
+    }
+    for (LANE &l : vLanes)
+        l.bus->ppu.frame_complete = false;
+}
+
+uint32_t CPULanes::Run(int nLane)
+{
+    if (nScheduled != nDot)
+    {
+        nScheduled = nDot;
+        Schedule(nLane);
+    }
+    uint32_t nCycles = vLanes[nLane].nPending;
+    vLanes[nLane].nPending = 0;
+    return nCycles;
+}
+
+// Group the lanes that start an instruction on this dot by pc. nFirst is the
+// lane asking, inside its bus clock; the later lanes have not been clocked
+// for this dot yet.
+void CPULanes::Schedule(int nFirst)
+{
+    // Most boundaries in a wait loop are at a register access, which no group
+    // could run; those are turned away before looking at the other lanes
+    Bus &first = *vLanes[nFirst].bus;
+    if (!first.cart || !Groupable(first))
+        return;
+
+    vDue.clear();
+    for (size_t i = nFirst; i < vLanes.size(); i++)
+    {
+        Bus &bus = *vLanes[i].bus;
+        if (!bus.cart || ((int)i != nFirst && !bus.CPUStepDue()))
+            continue;
+        vDue.push_back((uint32_t)bus.cpu.pc << 16 | (uint32_t)i);
+    }
+    if (vDue.size() < 2)
+        return;
+    std::sort(vDue.begin(), vDue.end());
+
+    for (size_t i = 0; i < vDue.size();)
+    {
+        size_t end = i + 1;
+        while (end < vDue.size() && (vDue[end] >> 16) == (vDue[i] >> 16))
+            end++;
+
+        uint16_t pc = vDue[i] >> 16;
+        g.n = 0;
+        for (; i < end; i++)
+        {
+            int nLane = vDue[i] & 0xFFFF;
+            Bus &bus = *vLanes[nLane].bus;
+            // A later lane's PPU has yet to run this dot, which can bring an
+            // interrupt one cycle closer than its bus reports
+            uint32_t nWindow = bus.InterruptFreeCycles();
+            if (nLane != nFirst && nWindow > 0)
+                nWindow--;
+            if (nWindow < kLongestInstruction)
+                continue;
+
+            int k = g.n++;
+            g.pc = pc;
+            g.a[k] = bus.cpu.a;
+            g.x[k] = bus.cpu.x;
+            g.y[k] = bus.cpu.y;
+            g.st[k] = bus.cpu.st | U;
+            g.sp[k] = bus.cpu.sp;
+            g.used[k] = 0;
+            g.window[k] = nWindow;
+            g.ram[k] = bus.ram.data();
+            g.slot[k] = bus.cart->GetPRGSlots();
+            g.lane[k] = nLane;
+            if (g.n == MAX_GROUP)
+            {
+                RunGroup();
+                g.n = 0;
+            }
+        }
+        if (g.n >= 2)
+            RunGroup();
+    }
+}
+
+// Whether the instruction at the lane's pc could run in a group, as far as
+// can be told without its index registers
+bool CPULanes::Groupable(Bus &bus) const
+{
+    uint8_t *const *slot = bus.cart->GetPRGSlots();
+    uint16_t pc = bus.cpu.pc;
+    const uint8_t *code = Plain(bus.ram.data(), slot, pc);
+    if (!code)
+        return false;
+    const OPCODE &d = decode[*code];
+    if (d.op == OP_NONE || d.op == OP_CLI || d.op == OP_PLP || d.op == OP_RTI)
+        return false;
+    if (d.mode != M_ABS || d.op == OP_JMP || d.op == OP_JSR)
+        return true;
+    const uint8_t *lo = Plain(bus.ram.data(), slot, pc + 1);
+    const uint8_t *hi = Plain(bus.ram.data(), slot, pc + 2);
+    if (!lo || !hi)
+        return false;
+    uint16_t addr = *lo | *hi << 8;
+    return Writes(d.op, d.mode) ? addr < 0x2000
+                                : Plain(bus.ram.data(), slot, addr) != nullptr;
+}
+
+// Members whose code at pc differs from the first member's leave
+void CPULanes::SameCode(uint32_t nBytes)
+{
+    // ROM mapped at the same offset in every member holds the same code
+    int nPage = g.pc >> 13;
+    if (nPage >= 3 && (int)((g.pc + nBytes - 1) >> 13) == nPage)
+    {
+        if (nPage != nROMPage)
+        {
+            nROMPage = -1;
+            bool bSame = true;
+            size_t nOffset = 0;
+            for (int k = 0; k < g.n && bSame; k++)
+            {
+                const LANE &l = vLanes[g.lane[k]];
+                const std::vector<uint8_t> &rom = l.bus->cart->GetPRGROM();
+                const uint8_t *p = g.slot[k][nPage];
+                bSame = l.bSameROM && p >= rom.data() &&
+                        p < rom.data() + rom.size() &&
+                        l.bus->cart->GetPRGROMWrites() == l.nPRGROMWrites;
+                if (k == 0)
+                    nOffset = p - rom.data();
+                else if (bSame)
+                    bSame = (size_t)(p - rom.data()) == nOffset;
+            }
+            if (bSame)
+                nROMPage = nPage;
+        }
+        if (nPage == nROMPage)
+            return;
+    }
+
+    uint8_t code[3];
+    for (uint32_t i = 0; i < nBytes; i++)
+        code[i] = *Plain(g.ram[0], g.slot[0], g.pc + i);
+    bool bAll = true;
+    for (int k = 1; k < g.n; k++)
+    {
+        g.keep[k] = true;
+        for (uint32_t i = 0; i < nBytes && g.keep[k]; i++)
+        {
+            const uint8_t *p = Plain(g.ram[k], g.slot[k], g.pc + i);
+            g.keep[k] = p && *p == code[i];
+        }
+        bAll &= g.keep[k];
+    }
+    if (!bAll)
+    {
+        g.keep[0] = true;
+        Compact(nullptr);
+    }
+}
+
+// Effective address (and operand, if read) of the current instruction for
+// each member. Members for which it is not plain memory leave before it.
+void CPULanes::Load(const OPCODE &d, uint16_t operand)
+{
+    uint8_t lo = operand & 0xFF;
+    bool bRead = Reads(d.op, d.mode);
+    bool bWrite = Writes(d.op, d.mode);
+    bool bAll = true;
+    for (int k = 0; k < g.n; k++)
+    {
+        uint16_t ea = operand;
+        uint8_t extra = 0;
+        switch (d.mode)
+        {
+        case M_ZP0:
+            ea = lo;
+            break;
+        case M_ZPX:
+            ea = (uint8_t)(lo + g.x[k]);
+            break;
+        case M_ZPY:
+            ea = (uint8_t)(lo + g.y[k]);
+            break;
+        case M_ABX:
+            ea = operand + g.x[k];
+            extra = (ea & 0xFF00) != (operand & 0xFF00);
+            break;
+        case M_ABY:
+            ea = operand + g.y[k];
+            extra = (ea & 0xFF00) != (operand & 0xFF00);
+            break;
+        case M_IZX:
+        {
+            uint8_t ptr = lo + g.x[k];
+            ea = g.ram[k][ptr] | g.ram[k][(uint8_t)(ptr + 1)] << 8;
+            break;
+        }
+        case M_IZY:
+        {
+            uint16_t base = g.ram[k][lo] | g.ram[k][(uint8_t)(lo + 1)] << 8;
+            ea = base + g.y[k];
+            extra = (ea & 0xFF00) != (base & 0xFF00);
+            break;
+        }
+        }
+        g.ea[k] = ea;
+        g.extra[k] = extra;
+
+        const uint8_t *p = Plain(g.ram[k], g.slot[k], ea);
+        g.keep[k] = p && (!bWrite || ea < 0x2000);
+        if (g.keep[k] && bRead)
+            g.v[k] = *p;
+        bAll &= g.keep[k];
+    }
+    if (!bAll)
+        Compact(nullptr);
+}
+
+// Member k stops here: its state goes back to its CPU, with the cycles run
+// handed over when its bus asks
+void CPULanes::Leave(int k, uint16_t pc)
+{
+    LANE &l = vLanes[g.lane[k]];
+    CPU6502 &cpu = l.bus->cpu;
+    cpu.a = g.a[k];
+    cpu.x = g.x[k];
+    cpu.y = g.y[k];
+    cpu.st = g.st[k];
+    cpu.sp = g.sp[k];
+    cpu.pc = pc;
+    l.nPending = g.used[k];
+}
+
+// Members with keep clear leave, at pcOut[k] or the group's pc
+void CPULanes::Compact(const uint16_t *pcOut)
+{
+    int n = 0;
+    for (int k = 0; k < g.n; k++)
+    {
+        if (!g.keep[k])
+        {
+            Leave(k, pcOut ? pcOut[k] : g.pc);
+            continue;
+        }
+        if (n != k)
+        {
+            g.a[n] = g.a[k];
+            g.x[n] = g.x[k];
+            g.y[n] = g.y[k];
+            g.st[n] = g.st[k];
+            g.sp[n] = g.sp[k];
+            g.v[n] = g.v[k];
+            g.extra[n] = g.extra[k];
+            g.ea[n] = g.ea[k];
+            g.used[n] = g.used[k];
+            g.window[n] = g.window[k];
+            g.ram[n] = g.ram[k];
+            g.slot[n] = g.slot[k];
+            g.lane[n] = g.lane[k];
+        }
+        n++;
+    }
+    g.n = n;
+}
+
+// Each member has its next pc in ea. The most common one is kept, the others
+// leave.
+void CPULanes::Split()
+{
+    uint16_t pc = g.ea[0];
+    int nVotes = 0;
+    for (int k = 0; k < g.n; k++)
+    {
+        if (nVotes == 0)
+            pc = g.ea[k];
+        nVotes += g.ea[k] == pc ? 1 : -1;
+    }
+
+    bool bAll = true;
+    for (int k = 0; k < g.n; k++)
+    {
+        g.keep[k] = g.ea[k] == pc;
+        bAll &= g.keep[k];
+    }
+    if (!bAll)
+        Compact(g.ea);
+    g.pc = pc;
+}
+
+void CPULanes::RunGroup()
+{
+    nROMPage = -1;
+    while (g.n >= 2)
+    {
+        // Every instruction has to complete inside each member's window
+        bool bAll = true;
+        for (int k = 0; k < g.n; k++)
+        {
+            g.keep[k] = g.used[k] + kLongestInstruction <= g.window[k];
+            bAll &= g.keep[k];
+        }
+        if (!bAll)
+        {
+            Compact(nullptr);
+            if (g.n < 2)
+                break;
+        }
+
+        const uint8_t *code = Plain(g.ram[0], g.slot[0], g.pc);
+        if (!code)
+            break;
+        const OPCODE &d = decode[*code];
+        uint32_t len = Length(d.mode);
+        if (d.op == OP_NONE || ClearsI(d.op))
+            break;
+        uint16_t operand = 0;
+        bool bPlain = true;
+        for (uint32_t i = 1; i < len && bPlain; i++)
+        {
+            const uint8_t *p = Plain(g.ram[0], g.slot[0], g.pc + i);
+            bPlain = p != nullptr;
+            if (p)
+                operand |= *p << (8 * (i - 1));
+        }
+        if (!bPlain)
+            break;
+        SameCode(len);
+        if (g.n < 2)
+            break;
+
+        if (d.mode != M_IMP && d.mode != M_IMM && d.mode != M_REL &&
+            d.mode != M_IND && d.op != OP_JMP && d.op != OP_JSR)
+        {
+            Load(d, operand);
+            if (g.n < 2)
+                break;
+        }
+        if (d.mode == M_IMM)
+            for (int k = 0; k < g.n; k++)
+                g.v[k] = operand & 0xFF;
+        if (d.mode == M_IMP)
+            for (int k = 0; k < g.n; k++)
+                g.v[k] = g.a[k];
+
+        nGroupInstructions++;
+        nLaneInstructions += g.n;
+
+        const int n = g.n;
+        uint16_t next = g.pc + len;
+        uint32_t nCycles = d.cycles;
+        bool bPageCycle = HasPageCycle(d.op, d.mode);
+        bool bJump = false;
+
+        switch (d.op)
+        {
+        case OP_LDA:
+            for (int k = 0; k < n; k++)
+            {
+                g.a[k] = g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.v[k]);
+            }
+            break;
+        case OP_LDX:
+            for (int k = 0; k < n; k++)
+            {
+                g.x[k] = g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.v[k]);
+            }
+            break;
+        case OP_LDY:
+            for (int k = 0; k < n; k++)
+            {
+                g.y[k] = g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.v[k]);
+            }
+            break;
+
+        case OP_STA:
+        case OP_STX:
+        case OP_STY:
+        {
+            const uint8_t *r = d.op == OP_STA ? g.a : d.op == OP_STX ? g.x : g.y;
+            for (int k = 0; k < n; k++)
+                g.ram[k][g.ea[k] & 0x07FF] = r[k];
+            break;
+        }
+
+        case OP_AND:
+            for (int k = 0; k < n; k++)
+            {
+                g.a[k] &= g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.a[k]);
+            }
+            break;
+        case OP_ORA:
+            for (int k = 0; k < n; k++)
+            {
+                g.a[k] |= g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.a[k]);
+            }
+            break;
+        case OP_EOR:
+            for (int k = 0; k < n; k++)
+            {
+                g.a[k] ^= g.v[k];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.a[k]);
+            }
+            break;
+
+        case OP_ADC:
+        case OP_SBC:
+        {
+            // SBC is ADC of the inverted operand
+            uint8_t inv = d.op == OP_SBC ? 0xFF : 0x00;
+            for (int k = 0; k < n; k++)
+            {
+                uint8_t v = g.v[k] ^ inv;
+                uint16_t t = g.a[k] + v + (g.st[k] & C);
+                uint8_t r = (uint8_t)t;
+                uint8_t ov = (~(g.a[k] ^ v) & (g.a[k] ^ r) & 0x80) ? V : 0;
+                g.st[k] = (g.st[k] & ~(N | V | Z | C)) | NZ(r) | ov | (t >> 8);
+                g.a[k] = r;
+            }
+            break;
+        }
+
+        case OP_CMP:
+        case OP_CPX:
+        case OP_CPY:
+        {
+            const uint8_t *r = d.op == OP_CMP ? g.a : d.op == OP_CPX ? g.x : g.y;
+            for (int k = 0; k < n; k++)
+                g.st[k] = (g.st[k] & ~(N | Z | C)) |
+                          NZ((uint8_t)(r[k] - g.v[k])) |
+                          (r[k] >= g.v[k] ? C : 0);
+            break;
+        }
+
+        case OP_BIT:
+            for (int k = 0; k < n; k++)
+                g.st[k] = (g.st[k] & ~(N | V | Z)) | (g.v[k] & (N | V)) |
+                          ((g.a[k] & g.v[k]) == 0 ? Z : 0);
+            break;
+
+        case OP_ASL:
+        case OP_LSR:
+        case OP_ROL:
+        case OP_ROR:
+        case OP_INC:
+        case OP_DEC:
+            for (int k = 0; k < n; k++)
+            {
+                uint8_t v = g.v[k], r, c = g.st[k] & C;
+                switch (d.op)
+                {
+                case OP_ASL: r = v << 1; c = v >> 7; break;
+                case OP_LSR: r = v >> 1; c = v & 1; break;
+                case OP_ROL: r = v << 1 | c; c = v >> 7; break;
+                case OP_ROR: r = v >> 1 | c << 7; c = v & 1; break;
+                case OP_INC: r = v + 1; break;
+                default: r = v - 1; break;
+                }
+                g.st[k] = (g.st[k] & ~(N | Z | C)) | NZ(r) | c;
+                if (d.mode == M_IMP)
+                    g.a[k] = r;
+                else
+                    g.ram[k][g.ea[k] & 0x07FF] = r;
+            }
+            break;
+
+        case OP_INX:
+        case OP_DEX:
+            for (int k = 0; k < n; k++)
+            {
+                g.x[k] += d.op == OP_INX ? 1 : -1;
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.x[k]);
+            }
+            break;
+        case OP_INY:
+        case OP_DEY:
+            for (int k = 0; k < n; k++)
+            {
+                g.y[k] += d.op == OP_INY ? 1 : -1;
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.y[k]);
+            }
+            break;
+
+        case OP_TAX:
+        case OP_TAY:
+        case OP_TXA:
+        case OP_TYA:
+        case OP_TSX:
+        case OP_TXS:
+        {
+            uint8_t *src = g.a, *dst = g.x;
+            switch (d.op)
+            {
+            case OP_TAY: dst = g.y; break;
+            case OP_TXA: src = g.x; dst = g.a; break;
+            case OP_TYA: src = g.y; dst = g.a; break;
+            case OP_TSX: src = g.sp; break;
+            case OP_TXS: src = g.x; dst = g.sp; break;
+            }
+            for (int k = 0; k < n; k++)
+                dst[k] = src[k];
+            if (d.op != OP_TXS)
+                for (int k = 0; k < n; k++)
+                    g.st[k] = (g.st[k] & ~(N | Z)) | NZ(dst[k]);
+            break;
+        }
+
+        case OP_CLC:
+        case OP_CLD:
+        case OP_CLV:
+        case OP_SEC:
+        case OP_SED:
+        case OP_SEI:
+        {
+            bool bSet = d.op == OP_SEC || d.op == OP_SED || d.op == OP_SEI;
+            uint8_t flag = (d.op == OP_CLC || d.op == OP_SEC)   ? C
+                           : (d.op == OP_CLD || d.op == OP_SED) ? D
+                           : d.op == OP_SEI                     ? I
+                                                                : V;
+            for (int k = 0; k < n; k++)
+                g.st[k] = bSet ? g.st[k] | flag : g.st[k] & ~flag;
+            break;
+        }
+
+        case OP_NOP:
+            break;
+
+        case OP_PHA:
+        case OP_PHP:
+            for (int k = 0; k < n; k++)
+            {
+                g.ram[k][0x100 + g.sp[k]] =
+                    d.op == OP_PHA ? g.a[k] : g.st[k] | B | U;
+                g.sp[k]--;
+            }
+            break;
+
+        case OP_PLA:
+            for (int k = 0; k < n; k++)
+            {
+                g.sp[k]++;
+                g.a[k] = g.ram[k][0x100 + g.sp[k]];
+                g.st[k] = (g.st[k] & ~(N | Z)) | NZ(g.a[k]);
+            }
+            break;
+
+        case OP_BCC:
+        case OP_BCS:
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BMI:
+        case OP_BPL:
+        case OP_BVC:
+        case OP_BVS:
+        {
+            uint8_t flag = (d.op == OP_BCC || d.op == OP_BCS)   ? C
+                           : (d.op == OP_BEQ || d.op == OP_BNE) ? Z
+                           : (d.op == OP_BMI || d.op == OP_BPL) ? N
+                                                                : V;
+            uint8_t want = (d.op == OP_BCS || d.op == OP_BEQ ||
+                            d.op == OP_BMI || d.op == OP_BVS)
+                               ? flag
+                               : 0;
+            uint16_t target = next + (int8_t)(operand & 0xFF);
+            uint8_t nTaken = (target & 0xFF00) != (next & 0xFF00) ? 2 : 1;
+            for (int k = 0; k < n; k++)
+            {
+                bool bTaken = (g.st[k] & flag) == want;
+                g.ea[k] = bTaken ? target : next;
+                g.extra[k] = bTaken ? nTaken : 0;
+            }
+            bPageCycle = true;
+            bJump = true;
+            break;
+        }
+
+        case OP_JMP:
+            if (d.mode == M_ABS)
+            {
+                for (int k = 0; k < n; k++)
+                    g.ea[k] = operand;
+            }
+            else
+            {
+                // The pointer's high byte does not carry into the next page
+                uint16_t hi = (operand & 0xFF00) | ((operand + 1) & 0x00FF);
+                bool bAll = true;
+                for (int k = 0; k < n; k++)
+                {
+                    const uint8_t *pl = Plain(g.ram[k], g.slot[k], operand);
+                    const uint8_t *ph = Plain(g.ram[k], g.slot[k], hi);
+                    g.keep[k] = pl && ph;
+                    if (g.keep[k])
+                        g.ea[k] = *pl | *ph << 8;
+                    bAll &= g.keep[k];
+                }
+                // Nothing has changed yet for those that leave
+                if (!bAll)
+                    Compact(nullptr);
+            }
+            bJump = true;
+            break;
+
+        case OP_JSR:
+        {
+            uint16_t ret = next - 1;
+            for (int k = 0; k < n; k++)
+            {
+                g.ram[k][0x100 + g.sp[k]] = ret >> 8;
+                g.ram[k][0x100 + (uint8_t)(g.sp[k] - 1)] = ret & 0xFF;
+                g.sp[k] -= 2;
+                g.ea[k] = operand;
+            }
+            bJump = true;
+            break;
+        }
+
+        case OP_RTS:
+            for (int k = 0; k < n; k++)
+            {
+                uint8_t lo = g.ram[k][0x100 + (uint8_t)(g.sp[k] + 1)];
+                uint8_t hi = g.ram[k][0x100 + (uint8_t)(g.sp[k] + 2)];
+                g.sp[k] += 2;
+                g.ea[k] = (uint16_t)((hi << 8 | lo) + 1);
+            }
+            bJump = true;
+            break;
+        }
+
+        for (int k = 0; k < g.n; k++)
+            g.used[k] += nCycles + (bPageCycle ? g.extra[k] : 0);
+        if (bJump)
+            Split();
+        else
+            g.pc = next;
+    }
+
+    for (int k = 0; k < g.n; k++)
+        Leave(k, g.pc);
+    g.n = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "CPUOpcodes.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Bus;
+
+// Lockstep execution of several machines running the same ROM
+// (experimental).
+//
+// Copies of one game driven with different input spend much of their time
+// executing the same instructions on the same cycle: every NMI starts all of
+// them in the same handler at once. Lanes whose CPUs reach an instruction
+// boundary on the same dot with the same pc run as a group. Each instruction
+// is fetched and decoded once and then applied to every member, with the
+// registers held as arrays over the group so the per-lane loops vectorize.
+//
+// Like CPUJit blocks, a group only runs instructions that touch internal RAM
+// and plain PRG memory, inside every member's interrupt free window, so
+// running ahead of the other devices is invisible. A lane leaves the group
+// when a branch or return takes it elsewhere than the majority, when its
+// window runs out or when it would touch anything else, and continues on its
+// own (translator or interpreter) from there.
+class CPULanes {
+public:
+    CPULanes();
+    ~CPULanes();
+
+    // Add a machine. Lanes must be reset together and from then on only be
+    // clocked through Clock() or Frame(), so they stay in the same bus phase.
+    void Attach(Bus &bus);
+    size_t Size() const { return vLanes.size(); }
+
+    // One PPU dot on every lane
+    void Clock();
+
+    // Clock every lane until each has completed a frame, then clear the
+    // flags. Lanes that got there first have run a dot or so of the next one.
+    void Frame();
+
+    // Called by a lane's CPU between instructions. Returns the cycles of the
+    // instructions the lane ran in a group this dot, 0 if it runs alone.
+    uint32_t Run(int nLane);
+
+    // Instructions run in groups, counted once per group and once per lane
+    uint64_t nGroupInstructions = 0;
+    uint64_t nLaneInstructions = 0;
+
+private:
+    struct LANE {
+        Bus *bus = nullptr;
+        uint32_t nPending = 0;      // Cycles run ahead, handed over by Run()
+        uint32_t nPRGROMWrites = 0; // At attach; PRG ROM unchanged while equal
+        bool bSameROM = false;      // PRG ROM identical to the first lane's
+    };
+    std::vector<LANE> vLanes;
+
+    // Groups are formed once per dot, at the first lane to ask
+    uint64_t nDot = 0;
+    uint64_t nScheduled = UINT64_MAX;
+    std::vector<uint32_t> vDue; // pc << 16 | lane
+    void Schedule(int nFirst);
+    bool Groupable(Bus &bus) const;
+
+    // A group, one array entry per member
+    static const int MAX_GROUP = 64;
+    struct GROUP {
+        int n = 0;
+        uint16_t pc = 0;
+        uint8_t a[MAX_GROUP], x[MAX_GROUP], y[MAX_GROUP];
+        uint8_t st[MAX_GROUP], sp[MAX_GROUP];
+        uint8_t v[MAX_GROUP];      // Operand of the current instruction
+        uint8_t extra[MAX_GROUP];  // Its page crossing cycle
+        uint16_t ea[MAX_GROUP];    // Its effective address, or new pc
+        uint32_t used[MAX_GROUP];  // Cycles run
+        uint32_t window[MAX_GROUP];
+        uint8_t *ram[MAX_GROUP];
+        uint8_t *const *slot[MAX_GROUP];
+        int lane[MAX_GROUP];
+        bool keep[MAX_GROUP];
+    };
+    GROUP g;
+
+    // Decoded form of the interpreter's opcode table
+    typedef CPUOpcodes::OPCODE OPCODE;
+    OPCODE decode[256];
+
+    // 8KB page whose code was found at the same ROM offset for the group
+    int nROMPage = -1;
+
+    void RunGroup();
+    void SameCode(uint32_t nBytes);
+    void Load(const OPCODE &d, uint16_t operand);
+    void Leave(int k, uint16_t pc);
+    void Compact(const uint16_t *pcOut);
+    void Split();
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+
+// Operations and addressing modes of the 6502 opcode table, as the decode
+// cache, the block translator and the lockstep engine see it.
+// CPU6502::DecodeOpcodes fills a table of OPCODEs from the interpreter's
+// lookup, so the three cannot disagree about what an opcode does.
+namespace CPUOpcodes {
+
+enum OP : uint8_t {
+    OP_NONE, OP_ADC, OP_AND, OP_ASL, OP_BCC, OP_BCS, OP_BEQ, OP_BIT, OP_BMI,
+    OP_BNE, OP_BPL, OP_BVC, OP_BVS, OP_CLC, OP_CLD, OP_CLI, OP_CLV, OP_CMP,
+    OP_CPX, OP_CPY, OP_DEC, OP_DEX, OP_DEY, OP_EOR, OP_INC, OP_INX, OP_INY,
+    OP_JMP, OP_JSR, OP_LDA, OP_LDX, OP_LDY, OP_LSR, OP_NOP, OP_ORA, OP_PHA,
+    OP_PHP, OP_PLA, OP_PLP, OP_ROL, OP_ROR, OP_RTI, OP_RTS, OP_SBC, OP_SEC,
+    OP_SED, OP_SEI, OP_STA, OP_STX, OP_STY, OP_TAX, OP_TAY, OP_TSX, OP_TXA,
+    OP_TXS, OP_TYA,
+};
+
+enum MODE : uint8_t {
+    M_IMP, M_IMM, M_ZP0, M_ZPX, M_ZPY, M_REL, M_ABS, M_ABX, M_ABY, M_IND,
+    M_IZX, M_IZY,
+};
+
+// Official opcodes only; BRK and the illegal opcodes are always interpreted
+struct OP_NAME {
+    const char *name;
+    uint8_t op;
+};
+inline constexpr OP_NAME kOpNames[] = {
+    {"ADC", OP_ADC}, {"AND", OP_AND}, {"ASL", OP_ASL}, {"BCC", OP_BCC},
+    {"BCS", OP_BCS}, {"BEQ", OP_BEQ}, {"BIT", OP_BIT}, {"BMI", OP_BMI},
+    {"BNE", OP_BNE}, {"BPL", OP_BPL}, {"BVC", OP_BVC}, {"BVS", OP_BVS},
+    {"CLC", OP_CLC}, {"CLD", OP_CLD}, {"CLI", OP_CLI}, {"CLV", OP_CLV},
+    {"CMP", OP_CMP}, {"CPX", OP_CPX}, {"CPY", OP_CPY}, {"DEC", OP_DEC},
+    {"DEX", OP_DEX}, {"DEY", OP_DEY}, {"EOR", OP_EOR}, {"INC", OP_INC},
+    {"INX", OP_INX}, {"INY", OP_INY}, {"JMP", OP_JMP}, {"JSR", OP_JSR},
+    {"LDA", OP_LDA}, {"LDX", OP_LDX}, {"LDY", OP_LDY}, {"LSR", OP_LSR},
+    {"NOP", OP_NOP}, {"ORA", OP_ORA}, {"PHA", OP_PHA}, {"PHP", OP_PHP},
+    {"PLA", OP_PLA}, {"PLP", OP_PLP}, {"ROL", OP_ROL}, {"ROR", OP_ROR},
+    {"RTI", OP_RTI}, {"RTS", OP_RTS}, {"SBC", OP_SBC}, {"SEC", OP_SEC},
+    {"SED", OP_SED}, {"SEI", OP_SEI}, {"STA", OP_STA}, {"STX", OP_STX},
+    {"STY", OP_STY}, {"TAX", OP_TAX}, {"TAY", OP_TAY}, {"TSX", OP_TSX},
+    {"TXA", OP_TXA}, {"TXS", OP_TXS}, {"TYA", OP_TYA},
+};
+
+// Decoded form of one entry of the interpreter's opcode table
+struct OPCODE {
+    uint8_t op = OP_NONE;
+    uint8_t mode = M_IMP;
+    uint8_t cycles = 0;
+};
+
+// Instruction length in bytes
+inline uint32_t Length(uint8_t mode)
+{
+    switch (mode)
+    {
+    case M_IMP:
+        return 1;
+    case M_ABS:
+    case M_ABX:
+    case M_ABY:
+    case M_IND:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+inline bool IsRMW(uint8_t op)
+{
+    return op == OP_ASL || op == OP_LSR || op == OP_ROL || op == OP_ROR ||
+           op == OP_INC || op == OP_DEC;
+}
+
+// Operations whose interpreter function returns 1, so ABX/ABY/IZY add a
+// cycle when the indexed address crosses a page
+inline bool HasPageCycle(uint8_t op, uint8_t mode)
+{
+    bool bOp = op == OP_ADC || op == OP_SBC || op == OP_AND || op == OP_ORA ||
+               op == OP_EOR || op == OP_LDA || op == OP_LDX || op == OP_LDY ||
+               op == OP_CMP;
+    return bOp && (mode == M_ABX || mode == M_ABY || mode == M_IZY);
+}
+
+// Instructions that can clear I change when a pending IRQ is taken, which
+// only the interpreter can get right
+inline bool ClearsI(uint8_t op)
+{
+    return op == OP_CLI || op == OP_PLP || op == OP_RTI;
+}
+
+} // namespace CPUOpcodes
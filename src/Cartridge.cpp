@@ -5,10 +5,24 @@
 #include "Mapper_004.h"
 #include "Mapper_005.h"
 #include "Mapper_069.h"
+#include <cstring>
 #include <fstream>
-#include <iostream>
+#include <sstream>
 
 Cartridge::Cartridge(const std::string &sFileName) {
+  std::ifstream ifs(sFileName, std::ifstream::binary);
+  if (ifs.is_open()) {
+    Load(ifs);
+    ifs.close();
+  }
+}
+
+Cartridge::Cartridge(const uint8_t *pImage, size_t nSize) {
+  std::istringstream iss(std::string((const char *)pImage, nSize));
+  Load(iss);
+}
+
+void Cartridge::Load(std::istream &ifs) {
   struct sHeader {
     char name[4];
     uint8_t prg_rom_chunks;
@@ -23,96 +37,71 @@ Cartridge::Cartridge(const std::string &sFileName) {
 
   bImageValid = false;
 
-  std::ifstream ifs(sFileName, std::ifstream::binary);
-  if (ifs.is_open()) {
-    ifs.read((char *)&header, sizeof(sHeader));
-
-    if (header.mapper1 & 0x04)
-      ifs.seekg(512, std::ios_base::cur);
-
-    nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-    nPRGBanks = header.prg_rom_chunks;
-    nCHRBanks = header.chr_rom_chunks;
-
-    // Read hardware mirroring from ROM header (bit 0 of mapper1)
-    MIRROR hwMirror =
-        (header.mapper1 & 0x01) ? MIRROR::VERTICAL : MIRROR::HORIZONTAL;
-
-    std::cout << "Mapper ID: " << (int)nMapperID << std::endl;
-    std::cout << "PRG Banks: " << (int)nPRGBanks << std::endl;
-    std::cout << "CHR Banks: " << (int)nCHRBanks << std::endl;
-    std::cout << "Mirroring: "
-              << (hwMirror == MIRROR::VERTICAL ? "Vertical" : "Horizontal")
-              << std::endl;
-
-    // Debug log to file
-    std::ofstream debugLog("nes_debug.log", std::ios::app);
-    debugLog << "Loading ROM - Mapper: " << (int)nMapperID
-             << ", PRG: " << (int)nPRGBanks << ", CHR: " << (int)nCHRBanks
-             << std::endl;
-    debugLog.close();
-
-    vPRGMemory.resize(nPRGBanks * 16384);
-    ifs.read((char *)vPRGMemory.data(), vPRGMemory.size());
-
-    if (nCHRBanks == 0) {
-      // CHR RAM - allocate 8KB
-      vCHRMemory.resize(8192);
-    } else {
-      vCHRMemory.resize(nCHRBanks * 8192);
-      ifs.read((char *)vCHRMemory.data(), vCHRMemory.size());
-    }
+  ifs.read((char *)&header, sizeof(sHeader));
+  if (!ifs || memcmp(header.name, "NES\x1A", 4) != 0)
+    return;
 
-    switch (nMapperID) {
-    case 0:
-      pMapper = std::make_shared<Mapper_000>(nPRGBanks, nCHRBanks, hwMirror);
-      break;
-    case 1:
-      pMapper = std::make_shared<Mapper_001>(nPRGBanks, nCHRBanks);
-      break;
-    case 2:
-      pMapper = std::make_shared<Mapper_002>(nPRGBanks, nCHRBanks, hwMirror);
-      break;
-    case 4:
-      pMapper = std::make_shared<Mapper_004>(nPRGBanks, nCHRBanks);
-      break;
-    case 5: {
-      std::ofstream debugLog("nes_debug.log", std::ios::app);
-      debugLog << "Creating Mapper 5 (MMC5)..." << std::endl;
-      debugLog.close();
-    }
-      pMapper = std::make_shared<Mapper_005>(nPRGBanks, nCHRBanks);
-      {
-        std::ofstream debugLog("nes_debug.log", std::ios::app);
-        debugLog << "Mapper 5 created successfully" << std::endl;
-        debugLog.close();
-      }
-      break;
-    case 69:
-      pMapper = std::make_shared<Mapper_069>(nPRGBanks, nCHRBanks);
-      {
-        std::ofstream debugLog("nes_debug.log", std::ios::app);
-        debugLog << "Mapper 69 (Sunsoft FME-7) created successfully"
-                 << std::endl;
-        debugLog.close();
-      }
-      break;
-    default:
-      std::cerr << "Unsupported Mapper: " << (int)nMapperID << std::endl;
-      {
-        std::ofstream debugLog("nes_debug.log", std::ios::app);
-        debugLog << "UNSUPPORTED Mapper: " << (int)nMapperID << std::endl;
-        debugLog.close();
-      }
-      pMapper = nullptr;
-      bImageValid = false;
-      ifs.close();
-      return;
-    }
+  if (header.mapper1 & 0x04)
+    ifs.seekg(512, std::ios_base::cur);
 
-    bImageValid = true;
-    ifs.close();
+  nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
+  nPRGBanks = header.prg_rom_chunks;
+  nCHRBanks = header.chr_rom_chunks;
+
+  // Read hardware mirroring from ROM header (bit 0 of mapper1)
+  hwMirror = (header.mapper1 & 0x01) ? MIRROR::VERTICAL : MIRROR::HORIZONTAL;
+
+  vPRGMemory.resize(nPRGBanks * 16384);
+  ifs.read((char *)vPRGMemory.data(), vPRGMemory.size());
+
+  if (nCHRBanks == 0) {
+    // CHR RAM - allocate 8KB
+    vCHRMemory.resize(8192);
+  } else {
+    vCHRMemory.resize(nCHRBanks * 8192);
+    ifs.read((char *)vCHRMemory.data(), vCHRMemory.size());
   }
+
+  // FNV-1a, before any write a mapper lets through to PRG ROM
+  nROMHash = 1469598103934665603ull;
+  auto Hash = [&](const std::vector<uint8_t> &v) {
+    for (uint8_t b : v) {
+      nROMHash ^= b;
+      nROMHash *= 1099511628211ull;
+    }
+  };
+  Hash(vPRGMemory);
+  if (nCHRBanks != 0)
+    Hash(vCHRMemory);
+
+  switch (nMapperID) {
+  case 0:
+    pMapper = std::make_shared<Mapper_000>(nPRGBanks, nCHRBanks, hwMirror);
+    break;
+  case 1:
+    pMapper = std::make_shared<Mapper_001>(nPRGBanks, nCHRBanks);
+    break;
+  case 2:
+    pMapper = std::make_shared<Mapper_002>(nPRGBanks, nCHRBanks, hwMirror);
+    break;
+  case 4:
+    pMapper = std::make_shared<Mapper_004>(nPRGBanks, nCHRBanks);
+    break;
+  case 5:
+    pMapper = std::make_shared<Mapper_005>(nPRGBanks, nCHRBanks);
+    break;
+  case 69:
+    pMapper = std::make_shared<Mapper_069>(nPRGBanks, nCHRBanks);
+    break;
+  default:
+    pMapper = nullptr;
+    bImageValid = false;
+    return;
+  }
+
+  pMapper->ConnectMemory(vPRGMemory, vCHRMemory);
+
+  bImageValid = true;
 }
 
 Cartridge::~Cartridge() {}
@@ -122,13 +111,34 @@ void Cartridge::reset() {
     pMapper->reset();
 }
 
-bool Cartridge::ImageValid() { return bImageValid; }
+bool Cartridge::ImageValid() const { return bImageValid; }
+
+void Cartridge::State(SaveState &s) {
+  uint8_t nMapper = nMapperID;
+  uint32_t nPRGSize = (uint32_t)vPRGMemory.size();
+  uint32_t nCHRSize = (uint32_t)vCHRMemory.size();
+  uint64_t nHash = nROMHash;
+  s.Values(nMapper, nPRGSize, nCHRSize, nHash);
+  if (nMapper != nMapperID || nPRGSize != vPRGMemory.size() ||
+      nCHRSize != vCHRMemory.size() || nHash != nROMHash || !pMapper) {
+    s.Fail();
+    return;
+  }
+  if (nCHRBanks == 0)
+    s.Value(vCHRMemory);
+  pMapper->State(s);
+}
 
-bool Cartridge::cpuRead(uint16_t addr, uint8_t &data) {
+bool Cartridge::cpuReadMapper(uint16_t addr, uint8_t &data) {
   uint32_t mapped_addr = 0;
   if (pMapper && pMapper->cpuMapRead(addr, mapped_addr)) {
     if (mapped_addr == 0xFFFFFFFF) {
       // PRG RAM or register access
+      Mapper_000 *m0 = dynamic_cast<Mapper_000 *>(pMapper.get());
+      if (m0) {
+        data = m0->GetPRGRAM()[addr & 0x1FFF];
+        return true;
+      }
       Mapper_001 *m1 = dynamic_cast<Mapper_001 *>(pMapper.get());
       if (m1) {
         data = m1->GetPRGRAM()[addr & 0x1FFF];
@@ -168,7 +178,19 @@ bool Cartridge::cpuRead(uint16_t addr, uint8_t &data) {
   return false;
 }
 
+int Cartridge::GetPRGBank(uint16_t addr) {
+  // Only $8000+ is looked up, so no mapper register reads are triggered
+  uint32_t mapped_addr = 0;
+  if (addr >= 0x8000 && pMapper && pMapper->cpuMapRead(addr, mapped_addr) &&
+      mapped_addr != 0xFFFFFFFF)
+    return (int)(mapped_addr >> 13);
+  return -1;
+}
+
 bool Cartridge::cpuWrite(uint16_t addr, uint8_t data) {
+  if (addr < 0x4020)
+    return false;
+
   uint32_t mapped_addr = 0;
   if (pMapper && pMapper->cpuMapWrite(addr, mapped_addr, data)) {
     if (mapped_addr == 0xFFFFFFFF) {
@@ -177,18 +199,19 @@ bool Cartridge::cpuWrite(uint16_t addr, uint8_t data) {
     }
     if (mapped_addr < vPRGMemory.size()) {
       vPRGMemory[mapped_addr] = data;
+      nPRGROMWrites++;
     }
     return true;
   }
   return false;
 }
 
-bool Cartridge::ppuRead(uint16_t addr, uint8_t &data) {
+bool Cartridge::ppuReadMapper(uint16_t addr, uint8_t &data) {
   uint32_t mapped_addr = 0;
-  if (pMapper->ppuReadCustom(addr, data)) {
+  if (pMapper->HasCustomPPU() && pMapper->ppuReadCustom(addr, data)) {
     return true;
   }
-  if (pMapper && pMapper->ppuMapRead(addr, mapped_addr)) {
+  if (pMapper->ppuMapRead(addr, mapped_addr)) {
     if (mapped_addr < vCHRMemory.size()) {
       data = vCHRMemory[mapped_addr];
     }
@@ -198,11 +221,14 @@ bool Cartridge::ppuRead(uint16_t addr, uint8_t &data) {
 }
 
 bool Cartridge::ppuWrite(uint16_t addr, uint8_t data) {
+  if (!pMapper)
+    return false;
+
   uint32_t mapped_addr = 0;
-  if (pMapper->ppuWriteCustom(addr, data)) {
+  if (pMapper->HasCustomPPU() && pMapper->ppuWriteCustom(addr, data)) {
     return true;
   }
-  if (pMapper && pMapper->ppuMapWrite(addr, mapped_addr)) {
+  if (pMapper->ppuMapWrite(addr, mapped_addr)) {
     if (mapped_addr < vCHRMemory.size()) {
       vCHRMemory[mapped_addr] = data;
     }
@@ -1,23 +1,69 @@
 #pragma once
 #include "Mapper.h"
 #include <cstdint>
+#include <functional>
+#include <istream>
 #include <memory>
 #include <string>
 #include <vector>
 
 class Cartridge {
 public:
+  // Loading writes nothing to the console or to files; a frontend reports
+  // the header from the getters below
   Cartridge(const std::string &sFileName);
+  // An iNES image in memory
+  Cartridge(const uint8_t *pImage, size_t nSize);
   ~Cartridge();
 
-  bool cpuRead(uint16_t addr, uint8_t &data);
+  // Banked reads are resolved inline from the mapper's slots, so Bus::read
+  // and PPU2C02::ppuRead only call into the mapper for registers, RAM hooks
+  // and MMC5 nametables
+  bool cpuRead(uint16_t addr, uint8_t &data) {
+    // Internal RAM, PPU and APU/IO registers are never cartridge space
+    if (addr < 0x4020 || !pMapper)
+      return false;
+    if (uint8_t *slot = pMapper->prgSlot[addr >> 13]) {
+      data = slot[addr & 0x1FFF];
+      return true;
+    }
+    return cpuReadMapper(addr, data);
+  }
   bool cpuWrite(uint16_t addr, uint8_t data);
 
-  bool ppuRead(uint16_t addr, uint8_t &data);
+  // 8KB PRG ROM bank currently mapped at addr, or -1 if it is not ROM
+  int GetPRGBank(uint16_t addr);
+
+  bool ppuRead(uint16_t addr, uint8_t &data) {
+    if (!pMapper)
+      return false;
+    if (addr < 0x2000) {
+      if (uint8_t *slot = pMapper->chrSlot[addr >> 10]) {
+        data = slot[addr & 0x03FF];
+        return true;
+      }
+    } else if (!pMapper->HasCustomPPU()) {
+      // Nametables and palette stay inside the PPU
+      return false;
+    }
+    return ppuReadMapper(addr, data);
+  }
   bool ppuWrite(uint16_t addr, uint8_t data);
 
   void reset();
-  bool ImageValid();
+  bool ImageValid() const;
+
+  // iNES header fields, also set when the mapper is not supported. PRG banks
+  // is 0 if the header could not be read.
+  uint8_t GetMapperID() const { return nMapperID; }
+  uint8_t GetPRGBanks() const { return nPRGBanks; }
+  uint8_t GetCHRBanks() const { return nCHRBanks; }
+  MIRROR GetHeaderMirror() const { return hwMirror; }
+
+  // Save or load CHR RAM and the mapper (see SaveState.h). Fails for a state
+  // saved with another ROM image. PRG ROM bytes a mapper let writes through
+  // to are not part of it.
+  void State(SaveState &s);
 
   // Get current mirroring mode from mapper
   MIRROR GetMirror() {
@@ -26,29 +72,79 @@ public:
     return MIRROR::HORIZONTAL;
   }
 
-  // IRQ interface (forwarded to mapper)
-  bool GetIRQState() {
+  // Host pointer for an 8KB CPU page (addr >> 13), nullptr if not plain memory
+  uint8_t *GetPRGPage(int i) { return pMapper ? pMapper->prgSlot[i] : nullptr; }
+
+  // For the CPU block translator: PRG ROM, the page pointers into it (or
+  // into RAM), and a count of the writes a mapper let through to PRG ROM
+  const std::vector<uint8_t> &GetPRGROM() const { return vPRGMemory; }
+  uint8_t *const *GetPRGSlots() { return pMapper ? pMapper->prgSlot : nullptr; }
+  uint32_t GetPRGROMWrites() const { return nPRGROMWrites; }
+
+  // Page table sources for the PPU, and the memory CHR pages point into
+  uint8_t *GetCHRPage(int i) { return pMapper ? pMapper->chrSlot[i] : nullptr; }
+  const std::vector<uint8_t> &GetCHRMemory() const { return vCHRMemory; }
+  uint8_t *GetNTPage(int i) { return pMapper ? pMapper->ntSlot[i] : nullptr; }
+  uint8_t *GetNTWritePage(int i) {
+    return pMapper ? pMapper->ntWriteSlot[i] : nullptr;
+  }
+  bool HasCustomPPU() { return pMapper && pMapper->HasCustomPPU(); }
+  void ConnectCIRAM(uint8_t *ciram) {
+    if (pMapper)
+      pMapper->ConnectCIRAM(ciram);
+  }
+  void SetBankChangeCallback(std::function<void()> callback) {
     if (pMapper)
-      return pMapper->irqState();
-    return false;
+      pMapper->SetBankChangeCallback(callback);
   }
+  void SetMirrorChangeCallback(std::function<void()> callback) {
+    if (pMapper)
+      pMapper->SetMirrorChangeCallback(callback);
+  }
+
+  // IRQ interface (forwarded to mapper)
+  bool GetIRQState() { return pMapper && pMapper->irqState(); }
   void ClearIRQ() {
     if (pMapper)
       pMapper->irqClear();
   }
-  void Scanline() {
+  uint32_t GetIRQQuietDots() {
+    return pMapper ? pMapper->irqQuietDots() : UINT32_MAX;
+  }
+  uint64_t GetIRQDeadline() {
+    return pMapper ? pMapper->IRQDeadline() : UINT64_MAX;
+  }
+  void IRQDeadlineReached() { pMapper->irqDeadlineReached(); }
+  void ConnectCPUClock(const uint64_t *pCycles) {
     if (pMapper)
-      pMapper->scanline();
+      pMapper->ConnectCPUClock(pCycles);
+  }
+
+  // PPU bus observers (forwarded to mapper)
+  uint8_t GetPPUObserveMask() {
+    return pMapper ? pMapper->PPUObserveMask() : 0;
   }
+  void PPUA12Rise(uint32_t nLowDots) { pMapper->ppuA12Rise(nLowDots); }
+  void PPUNTFetch(uint16_t addr) { pMapper->ppuNTFetch(addr); }
+  void PPUIdle() { pMapper->ppuIdle(); }
 
 private:
+  void Load(std::istream &ifs);
+
+  // Slow paths behind the inline slot lookups
+  bool cpuReadMapper(uint16_t addr, uint8_t &data);
+  bool ppuReadMapper(uint16_t addr, uint8_t &data);
+
   bool bImageValid = false;
   std::vector<uint8_t> vPRGMemory;
   std::vector<uint8_t> vCHRMemory;
+  uint32_t nPRGROMWrites = 0;
+  uint64_t nROMHash = 0; // PRG and CHR ROM as loaded, identifies saved states
 
   uint8_t nMapperID = 0;
   uint8_t nPRGBanks = 0;
   uint8_t nCHRBanks = 0;
+  MIRROR hwMirror = MIRROR::HORIZONTAL;
 
   std::shared_ptr<Mapper> pMapper;
 };
@@ -42,8 +42,20 @@ void Config::Load(const std::string &filename) {
       keys.start = (SDL_Keycode)std::stoi(value);
     else if (key == "select")
       keys.select = (SDL_Keycode)std::stoi(value);
+    else if (key == "turbo")
+      keys.turbo = (SDL_Keycode)std::stoi(value);
+    else if (key == "turbotoggle")
+      keys.turboToggle = (SDL_Keycode)std::stoi(value);
     else if (key == "scale")
       windowScale = std::stoi(value);
+    else if (key == "nospritelimit")
+      noSpriteLimit = std::stoi(value) != 0;
+    else if (key == "turbospeed")
+      turboSpeed = std::stoi(value);
+    else if (key == "jit")
+      jit = std::stoi(value) != 0;
+    else if (key == "ppu_thread")
+      ppuThread = std::stoi(value) != 0;
     else if (key == "lastrom")
       lastRomPath = value;
   }
@@ -65,8 +77,15 @@ void Config::Save(const std::string &filename) {
   file << "b=" << keys.b << "\n";
   file << "start=" << keys.start << "\n";
   file << "select=" << keys.select << "\n";
+  file << "turbo=" << keys.turbo << "\n";
+  file << "turbotoggle=" << keys.turboToggle << "\n";
   file << "\n[Display]\n";
   file << "scale=" << windowScale << "\n";
+  file << "nospritelimit=" << noSpriteLimit << "\n";
+  file << "\n[Emulation]\n";
+  file << "turbospeed=" << turboSpeed << "\n";
+  file << "jit=" << jit << "\n";
+  file << "ppu_thread=" << ppuThread << "\n";
   file << "\n[Misc]\n";
   file << "lastrom=" << lastRomPath << "\n";
 
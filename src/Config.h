@@ -14,6 +14,10 @@ struct KeyBindings {
   SDL_Keycode b = SDLK_z;
   SDL_Keycode start = SDLK_s;
   SDL_Keycode select = SDLK_a;
+
+  // Fast-forward (hold / toggle)
+  SDL_Keycode turbo = SDLK_TAB;
+  SDL_Keycode turboToggle = SDLK_BACKQUOTE;
 };
 
 class Config {
@@ -25,5 +29,17 @@ public:
 
   KeyBindings keys;
   int windowScale = 3;
+
+  // Draw more than 8 sprites per line (less flicker, not hardware accurate)
+  bool noSpriteLimit = false;
+
+  // Fast-forward speed multiplier (0 = uncapped)
+  int turboSpeed = 0;
+
+  // Run CPU code through the block translator (x86-64 only)
+  bool jit = false;
+
+  // Draw frames on a second thread, presented one frame late (experimental)
+  bool ppuThread = false;
   std::string lastRomPath = "";
 };
@@ -52,12 +52,13 @@ bool Display::Init(const char *title, int width, int height, int scale) {
   // Set render draw color for letterbox bars
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
-                              SDL_TEXTUREACCESS_STREAMING, width, height);
-
-  if (!texture) {
-    std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
-    return false;
+  for (SDL_Texture *&texture : textures) {
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                                SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!texture) {
+      std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
+      return false;
+    }
   }
 
   return true;
@@ -72,8 +73,37 @@ void Display::SetScale(int scale) {
   }
 }
 
+Pixel *Display::LockFrame() {
+  if (!bZeroCopy)
+    return nullptr;
+  if (bLocked)
+    SDL_UnlockTexture(textures[nShown ^ 1]);
+
+  void *pixels = nullptr;
+  int pitch = 0;
+  bLocked =
+      SDL_LockTexture(textures[nShown ^ 1], nullptr, &pixels, &pitch) == 0;
+  if (bLocked && pitch == screenWidth * (int)sizeof(Pixel))
+    return (Pixel *)pixels;
+
+  // Padded rows (or no locking): copy from the PPU's buffer from now on
+  if (bLocked)
+    SDL_UnlockTexture(textures[nShown ^ 1]);
+  bLocked = false;
+  bZeroCopy = false;
+  return nullptr;
+}
+
 void Display::Update(Pixel *screen) {
-  SDL_UpdateTexture(texture, nullptr, screen, screenWidth * sizeof(Pixel));
+  if (bLocked) {
+    // The emulator rendered into the locked texture, which becomes current
+    SDL_UnlockTexture(textures[nShown ^ 1]);
+    nShown ^= 1;
+    bLocked = false;
+  } else if (!bZeroCopy) {
+    SDL_UpdateTexture(textures[nShown], nullptr, screen,
+                      screenWidth * sizeof(Pixel));
+  }
 
   // Clear with black for letterbox bars
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
@@ -104,13 +134,13 @@ void Display::Update(Pixel *screen) {
     destRect.y = (windowH - destRect.h) / 2;
   }
 
-  SDL_RenderCopy(renderer, texture, nullptr, &destRect);
+  SDL_RenderCopy(renderer, textures[nShown], nullptr, &destRect);
   SDL_RenderPresent(renderer);
 }
 
 void Display::HandleEvents(bool &running, uint8_t &controller, Config &config,
                            bool &loadNewRom, std::string &newRomPath,
-                           int &menuCommand) {
+                           int &menuCommand, bool &turboHeld) {
   menuCommand = 0;
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
@@ -159,6 +189,22 @@ void Display::HandleEvents(bool &running, uint8_t &controller, Config &config,
       } else if (key == SDLK_p) {
         // P key for pause - pass command to main
         menuCommand = ID_EMU_PAUSE;
+#ifdef MGK_CPU_TRACE
+      } else if (key == SDLK_F9) {
+        // F9 writes the CPU trace ring buffer to disk
+        menuCommand = ID_DEBUG_TRACE;
+#endif
+#ifdef MGK_CPU_PROFILE
+      } else if (key == SDLK_F10) {
+        // F10 writes the CPU profile so far to disk
+        menuCommand = ID_DEBUG_PROFILE;
+#endif
+      } else if (key == config.keys.turbo) {
+        // Fast-forward while held
+        turboHeld = true;
+      } else if (key == config.keys.turboToggle) {
+        if (!event.key.repeat)
+          menuCommand = ID_EMU_TURBO;
       } else if (key == config.keys.a)
         controller |= 0x80;
       else if (key == config.keys.b)
@@ -180,7 +226,9 @@ void Display::HandleEvents(bool &running, uint8_t &controller, Config &config,
     if (event.type == SDL_KEYUP) {
       SDL_Keycode key = event.key.keysym.sym;
 
-      if (key == config.keys.a)
+      if (key == config.keys.turbo)
+        turboHeld = false;
+      else if (key == config.keys.a)
         controller &= ~0x80;
       else if (key == config.keys.b)
         controller &= ~0x40;
@@ -201,9 +249,11 @@ void Display::HandleEvents(bool &running, uint8_t &controller, Config &config,
 }
 
 void Display::Close() {
-  if (texture) {
-    SDL_DestroyTexture(texture);
-    texture = nullptr;
+  for (SDL_Texture *&texture : textures) {
+    if (texture) {
+      SDL_DestroyTexture(texture);
+      texture = nullptr;
+    }
   }
   if (renderer) {
     SDL_DestroyRenderer(renderer);
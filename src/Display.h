@@ -12,17 +12,27 @@ public:
   ~Display();
 
   bool Init(const char *title, int width, int height, int scale);
+
+  // Zero-copy path: returns a locked streaming texture for the emulator to
+  // render the next frame into, or nullptr if the texture's row pitch does
+  // not match the PPU's. Update() presents it without copying; without a
+  // locked frame it uploads from screen instead.
+  Pixel *LockFrame();
   void Update(Pixel *screen);
   void HandleEvents(bool &running, uint8_t &controller, Config &config,
                     bool &loadNewRom, std::string &newRomPath,
-                    int &menuCommand);
+                    int &menuCommand, bool &turboHeld);
   void Close();
   void SetScale(int scale);
 
 private:
   SDL_Window *window = nullptr;
   SDL_Renderer *renderer = nullptr;
-  SDL_Texture *texture = nullptr;
+  // Double buffered, so a frame can be written while the last one is shown
+  SDL_Texture *textures[2] = {};
+  int nShown = 0;        // Texture holding the frame on screen
+  bool bLocked = false;  // The other texture is locked for the next frame
+  bool bZeroCopy = true; // Cleared if locking cannot be used
 
   int screenWidth = 256;
   int screenHeight = 240;
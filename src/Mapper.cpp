@@ -7,3 +7,40 @@ Mapper::Mapper(uint8_t prgBanks, uint8_t chrBanks) {
 
 Mapper::~Mapper() {
 }
+
+void Mapper::ConnectMemory(std::vector<uint8_t> &prg, std::vector<uint8_t> &chr) {
+    pPRGMemory = prg.data();
+    nPRGMemorySize = (uint32_t)prg.size();
+    pCHRMemory = chr.data();
+    nCHRMemorySize = (uint32_t)chr.size();
+    BanksChanged();
+}
+
+void Mapper::State(SaveState &s) {
+    s.Values(mirrorMode, bIRQActive, nIRQDeadline);
+    MapperState(s);
+    if (s.Loading()) {
+        BanksChanged();
+        MirrorChanged();
+    }
+}
+
+void Mapper::BanksChanged() {
+    updateSlots();
+    if (bankChangeCallback)
+        bankChangeCallback();
+}
+
+void Mapper::MirrorChanged() {
+    updateNametables();
+    if (mirrorChangeCallback)
+        mirrorChangeCallback();
+}
+
+void Mapper::SetPRGSlot(int slot, uint32_t offset) {
+    prgSlot[slot] = nPRGMemorySize ? pPRGMemory + (offset % nPRGMemorySize) : nullptr;
+}
+
+void Mapper::SetCHRSlot(int slot, uint32_t offset) {
+    chrSlot[slot] = nCHRMemorySize ? pCHRMemory + (offset % nCHRMemorySize) : nullptr;
+}
@@ -1,13 +1,53 @@
 #pragma once
+#include "SaveState.h"
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 enum MIRROR { HORIZONTAL, VERTICAL, ONESCREEN_LO, ONESCREEN_HI };
 
+// PPU address bus events a mapper can subscribe to
+enum PPU_OBSERVE : uint8_t {
+  PPU_OBSERVE_A12 = 0x01, // ppuA12Rise on each 0 -> 1 edge of PPU A12
+  PPU_OBSERVE_NT = 0x02,  // ppuNTFetch on background NT/AT fetches, ppuIdle
+};
+
 class Mapper {
 public:
   Mapper(uint8_t prgBanks, uint8_t chrBanks);
   virtual ~Mapper();
 
+  // Give the mapper the cartridge's PRG ROM and CHR ROM/RAM so it can
+  // resolve its bank slots to host pointers
+  void ConnectMemory(std::vector<uint8_t> &prg, std::vector<uint8_t> &chr);
+
+  // Host pointer for each 8KB CPU page (addr >> 13) and each 1KB pattern
+  // table page (addr >> 10). Mappers recompute these whenever a bank register
+  // changes. nullptr means reads go through cpuMapRead/ppuMapRead instead.
+  uint8_t *prgSlot[8] = {};
+  uint8_t *chrSlot[8] = {};
+
+  // Nametable pages ($2000 + 1KB * i) for mappers with custom PPU handling,
+  // for reads and for writes. nullptr means the access goes through
+  // ppuReadCustom/ppuWriteCustom.
+  uint8_t *ntSlot[4] = {};
+  uint8_t *ntWriteSlot[4] = {};
+
+  // The PPU's 2KB nametable RAM, for mappers that route CIRAM themselves
+  void ConnectCIRAM(uint8_t *ciram) {
+    pCIRAM = ciram;
+    BanksChanged();
+  }
+
+  // Called whenever slots change, so the PPU can refresh its page table
+  void SetBankChangeCallback(std::function<void()> callback) {
+    bankChangeCallback = callback;
+  }
+  // Called when only the nametable mapping changed
+  void SetMirrorChangeCallback(std::function<void()> callback) {
+    mirrorChangeCallback = callback;
+  }
+
   // Transform CPU bus address into PRG ROM offset
   virtual bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr) = 0;
   virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) = 0;
@@ -29,14 +69,80 @@ public:
   virtual void reset() {}
 
   // Get current mirroring mode
-  virtual MIRROR mirror() { return MIRROR::HORIZONTAL; }
+  MIRROR mirror() const { return mirrorMode; }
 
   // IRQ interface (for mappers like MMC3)
-  virtual bool irqState() { return false; }
+  bool irqState() const { return bIRQActive; }
   virtual void irqClear() {}
-  virtual void scanline() {}
+  // PPU dots that will pass before the IRQ line can rise without a register
+  // write, at least. UINT32_MAX: not until then.
+  virtual uint32_t irqQuietDots() const { return UINT32_MAX; }
+
+  // CPU cycle counting IRQs (FME-7 style) are scheduled rather than ticked:
+  // the mapper sets nIRQDeadline when its counter registers change, and the
+  // bus calls irqDeadlineReached() on that CPU cycle
+  void ConnectCPUClock(const uint64_t *pCycles) { pCPUCycles = pCycles; }
+  uint64_t IRQDeadline() const { return nIRQDeadline; }
+  virtual void irqDeadlineReached() {}
+
+  // PPU bus observers. The PPU only reports the events set in
+  // PPUObserveMask(), so mappers that watch nothing cost nothing per dot.
+  uint8_t PPUObserveMask() const { return nPPUObserve; }
+  // A12 went high after nLowDots PPU dots low
+  virtual void ppuA12Rise(uint32_t nLowDots) {}
+  // Background nametable or attribute fetch while rendering
+  virtual void ppuNTFetch(uint16_t addr) {}
+  // Rendering fetches stopped (vblank or rendering disabled)
+  virtual void ppuIdle() {}
+
+  // True if ppuReadCustom/ppuWriteCustom need to see PPU accesses
+  bool HasCustomPPU() const { return bCustomPPU; }
+
+  // Save or load registers and RAM; slots are recomputed after a load
+  void State(SaveState &s);
 
 protected:
   uint8_t nPRGBanks = 0;
   uint8_t nCHRBanks = 0;
+
+  // Hot state is plain data so the cartridge can read it without a call
+  MIRROR mirrorMode = MIRROR::HORIZONTAL;
+  bool bIRQActive = false; // IRQ line as seen by the CPU
+  bool bCustomPPU = false;
+  uint8_t nPPUObserve = 0; // PPU_OBSERVE_* flags
+  // CPU cycle of the next scheduled IRQ, UINT64_MAX = none
+  uint64_t nIRQDeadline = UINT64_MAX;
+
+  // Current bus CPU cycle, for scheduling nIRQDeadline
+  uint64_t CPUCycle() const { return pCPUCycles ? *pCPUCycles : 0; }
+
+  // CIRAM as connected by the PPU, nullptr until then
+  uint8_t *pCIRAM = nullptr;
+
+  // Recompute prgSlot/chrSlot/ntSlot from the current bank registers
+  virtual void updateSlots() {}
+  // Recompute ntSlot/ntWriteSlot only
+  virtual void updateNametables() {}
+  // The mapper's own registers and RAM, for State()
+  virtual void MapperState(SaveState &s) {}
+
+  // Mappers call this after any bank register write
+  void BanksChanged();
+  // Mappers call this after a write that only changes mirroring
+  void MirrorChanged();
+
+  // Point a slot at a PRG ROM / CHR offset, wrapped to the memory size
+  void SetPRGSlot(int slot, uint32_t offset);
+  void SetCHRSlot(int slot, uint32_t offset);
+
+private:
+  const uint64_t *pCPUCycles = nullptr;
+
+  uint8_t *pPRGMemory = nullptr;
+  uint32_t nPRGMemorySize = 0;
+  uint8_t *pCHRMemory = nullptr;
+  uint32_t nCHRMemorySize = 0;
+
+  std::function<void()> bankChangeCallback;
+  std::function<void()> mirrorChangeCallback;
 };
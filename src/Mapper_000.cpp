@@ -1,11 +1,32 @@
 #include "Mapper_000.h"
 
 Mapper_000::Mapper_000(uint8_t prgBanks, uint8_t chrBanks, MIRROR hwMirror)
-    : Mapper(prgBanks, chrBanks), mirrorMode(hwMirror) {}
+    : Mapper(prgBanks, chrBanks) {
+  mirrorMode = hwMirror;
+  vRAMStatic.resize(8192, 0x00);
+}
 
 Mapper_000::~Mapper_000() {}
 
+void Mapper_000::updateSlots() {
+  // Fixed mapping - a 16KB image is mirrored into $C000 by the slot wrap
+  prgSlot[3] = vRAMStatic.data();
+  for (int i = 0; i < 4; i++)
+    SetPRGSlot(4 + i, i * 0x2000);
+  for (int i = 0; i < 8; i++)
+    SetCHRSlot(i, i * 0x0400);
+}
+
+void Mapper_000::MapperState(SaveState &s) {
+  s.Values(vRAMStatic);
+}
+
 bool Mapper_000::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    // PRG RAM region - handled in cartridge
+    mapped_addr = 0xFFFFFFFF;
+    return true;
+  }
   if (addr >= 0x8000 && addr <= 0xFFFF) {
     mapped_addr = addr & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
     return true;
@@ -13,6 +34,16 @@ bool Mapper_000::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
   return false;
 }
 
+bool Mapper_000::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
+                             uint8_t data) {
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    mapped_addr = 0xFFFFFFFF;
+    vRAMStatic[addr & 0x1FFF] = data;
+    return true;
+  }
+  return cpuMapWrite(addr, mapped_addr);
+}
+
 bool Mapper_000::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) {
   if (addr >= 0x8000 && addr <= 0xFFFF) {
     mapped_addr = addr & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
@@ -1,5 +1,6 @@
 #pragma once
 #include "Mapper.h"
+#include <vector>
 
 class Mapper_000 : public Mapper {
 public:
@@ -7,12 +8,19 @@ public:
   ~Mapper_000();
 
   bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr) override;
+  bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
   bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
   bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr) override;
   bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
 
-  MIRROR mirror() override { return mirrorMode; }
+  // PRG RAM access
+  uint8_t *GetPRGRAM() { return vRAMStatic.data(); }
+
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
 
 private:
-  MIRROR mirrorMode;
+  // 8KB PRG RAM (Family BASIC boards; also used by test ROMs for results)
+  std::vector<uint8_t> vRAMStatic;
 };
@@ -23,9 +23,44 @@ void Mapper_001::reset() {
   nPRGBankSelect32 = 0;
 
   mirrorMode = MIRROR::HORIZONTAL;
+  BanksChanged();
 }
 
-MIRROR Mapper_001::mirror() { return mirrorMode; }
+void Mapper_001::updateSlots() {
+  prgSlot[3] = vRAMStatic.data();
+  if (nControlRegister & 0x08) {
+    // 16KB PRG mode
+    SetPRGSlot(4, nPRGBankSelect16Lo * 0x4000);
+    SetPRGSlot(5, nPRGBankSelect16Lo * 0x4000 + 0x2000);
+    SetPRGSlot(6, nPRGBankSelect16Hi * 0x4000);
+    SetPRGSlot(7, nPRGBankSelect16Hi * 0x4000 + 0x2000);
+  } else {
+    // 32KB PRG mode
+    for (int i = 0; i < 4; i++)
+      SetPRGSlot(4 + i, nPRGBankSelect32 * 0x8000 + i * 0x2000);
+  }
+
+  for (int i = 0; i < 8; i++) {
+    if (nCHRBanks == 0) {
+      // CHR RAM - direct mapping
+      SetCHRSlot(i, i * 0x0400);
+    } else if (nControlRegister & 0x10) {
+      // 4KB CHR mode
+      uint8_t bank = i < 4 ? nCHRBankSelect4Lo : nCHRBankSelect4Hi;
+      SetCHRSlot(i, bank * 0x1000 + (i & 0x03) * 0x0400);
+    } else {
+      // 8KB CHR mode
+      SetCHRSlot(i, nCHRBankSelect8 * 0x1000 + i * 0x0400);
+    }
+  }
+}
+
+void Mapper_001::MapperState(SaveState &s) {
+  s.Values(nLoadRegister, nLoadRegisterCount, nControlRegister,
+           nCHRBankSelect4Lo, nCHRBankSelect4Hi, nCHRBankSelect8,
+           nPRGBankSelect16Lo, nPRGBankSelect16Hi, nPRGBankSelect32,
+           vRAMStatic);
+}
 
 bool Mapper_001::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
   if (addr >= 0x6000 && addr <= 0x7FFF) {
@@ -136,6 +171,7 @@ bool Mapper_001::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
         nLoadRegisterCount = 0;
       }
     }
+    BanksChanged();
     return false; // Don't write to PRG ROM
   }
 
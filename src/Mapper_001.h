@@ -14,11 +14,14 @@ public:
   bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
 
   void reset() override;
-  MIRROR mirror() override;
 
   // PRG RAM access
   uint8_t *GetPRGRAM() { return vRAMStatic.data(); }
 
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
+
 private:
   uint8_t nLoadRegister = 0x00;
   uint8_t nLoadRegisterCount = 0;
@@ -32,9 +35,6 @@ private:
   uint8_t nPRGBankSelect16Hi = 0;
   uint8_t nPRGBankSelect32 = 0;
 
-  // Mirroring mode
-  MIRROR mirrorMode = MIRROR::HORIZONTAL;
-
   // 8KB PRG RAM
   std::vector<uint8_t> vRAMStatic;
 };
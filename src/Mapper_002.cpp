@@ -1,13 +1,31 @@
 #include "Mapper_002.h"
 
 Mapper_002::Mapper_002(uint8_t prgBanks, uint8_t chrBanks, MIRROR hwMirror)
-    : Mapper(prgBanks, chrBanks), mirrorMode(hwMirror) {
+    : Mapper(prgBanks, chrBanks) {
+  mirrorMode = hwMirror;
   reset();
 }
 
 Mapper_002::~Mapper_002() {}
 
-void Mapper_002::reset() { nPRGBankSelect = 0; }
+void Mapper_002::reset() {
+  nPRGBankSelect = 0;
+  BanksChanged();
+}
+
+void Mapper_002::updateSlots() {
+  // Switchable 16KB bank at $8000, last bank fixed at $C000
+  SetPRGSlot(4, nPRGBankSelect * 0x4000);
+  SetPRGSlot(5, nPRGBankSelect * 0x4000 + 0x2000);
+  SetPRGSlot(6, (nPRGBanks - 1) * 0x4000);
+  SetPRGSlot(7, (nPRGBanks - 1) * 0x4000 + 0x2000);
+  for (int i = 0; i < 8; i++)
+    SetCHRSlot(i, i * 0x0400);
+}
+
+void Mapper_002::MapperState(SaveState &s) {
+  s.Values(nPRGBankSelect);
+}
 
 bool Mapper_002::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
   if (addr >= 0x8000 && addr <= 0xBFFF) {
@@ -34,6 +52,7 @@ bool Mapper_002::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
   if (addr >= 0x8000 && addr <= 0xFFFF) {
     // Bank select - use low bits based on number of banks
     nPRGBankSelect = data & 0x0F;
+    BanksChanged();
   }
   return false;
 }
@@ -13,9 +13,11 @@ public:
   bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
 
   void reset() override;
-  MIRROR mirror() override { return mirrorMode; }
+
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
 
 private:
   uint8_t nPRGBankSelect = 0;
-  MIRROR mirrorMode;
 };
@@ -3,6 +3,7 @@
 Mapper_004::Mapper_004(uint8_t prgBanks, uint8_t chrBanks)
     : Mapper(prgBanks, chrBanks) {
   vRAMStatic.resize(8192, 0);
+  nPPUObserve = PPU_OBSERVE_A12;
   reset();
 }
 
@@ -32,6 +33,21 @@ void Mapper_004::reset() {
   pPRGBank[1] = 1 * 0x2000;
   pPRGBank[2] = (nPRGBanks * 2 - 2) * 0x2000;
   pPRGBank[3] = (nPRGBanks * 2 - 1) * 0x2000;
+  BanksChanged();
+}
+
+void Mapper_004::updateSlots() {
+  prgSlot[3] = vRAMStatic.data();
+  for (int i = 0; i < 4; i++)
+    SetPRGSlot(4 + i, pPRGBank[i]);
+  for (int i = 0; i < 8; i++)
+    SetCHRSlot(i, pCHRBank[i]);
+}
+
+void Mapper_004::MapperState(SaveState &s) {
+  s.Values(nTargetRegister, bPRGBankMode, bCHRInversion, pRegister,
+           pCHRBank, pPRGBank, bIRQEnable, bIRQUpdate, nIRQCounter,
+           nIRQReload, vRAMStatic);
 }
 
 bool Mapper_004::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
@@ -117,6 +133,7 @@ bool Mapper_004::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
       }
       pPRGBank[1] = (pRegister[7] & 0x3F) * 0x2000;
       pPRGBank[3] = (nPRGBanks * 2 - 1) * 0x2000;
+      BanksChanged();
     }
     return false;
   }
@@ -125,6 +142,7 @@ bool Mapper_004::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
     if (!(addr & 0x0001)) {
       // Mirroring
       mirrorMode = (data & 0x01) ? MIRROR::HORIZONTAL : MIRROR::VERTICAL;
+      MirrorChanged();
     }
     return false;
   }
@@ -168,7 +186,28 @@ bool Mapper_004::ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) {
   return false;
 }
 
-void Mapper_004::scanline() {
+uint32_t Mapper_004::irqQuietDots() const {
+  if (!bIRQEnable)
+    return UINT32_MAX;
+
+  // Rises the counter needs before it fires. A reload of 0 never fires.
+  uint32_t nRises = nIRQCounter;
+  if (nIRQCounter == 0 || bIRQUpdate) {
+    if (nIRQReload == 0)
+      return UINT32_MAX;
+    nRises = nIRQReload + 1;
+  }
+  // The first may come on the next dot, later ones after the 10 low dots
+  // the filter wants
+  return (nRises - 1) * 11;
+}
+
+void Mapper_004::ppuA12Rise(uint32_t nLowDots) {
+  // A12 has to stay low for about three CPU cycles before a rise counts,
+  // which filters out the short drops between tile fetches
+  if (nLowDots < 10)
+    return;
+
   if (nIRQCounter == 0 || bIRQUpdate) {
     nIRQCounter = nIRQReload;
     bIRQUpdate = false;
@@ -14,31 +14,32 @@ public:
   bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
 
   void reset() override;
-  MIRROR mirror() override { return mirrorMode; }
 
   // IRQ interface
-  bool irqState() override { return bIRQActive; }
   void irqClear() override { bIRQActive = false; }
+  uint32_t irqQuietDots() const override;
 
-  // Scanline counter
-  void scanline() override;
+  // Scanline counter, clocked by filtered PPU A12 rises
+  void ppuA12Rise(uint32_t nLowDots) override;
 
   // PRG RAM access
   std::vector<uint8_t> &GetPRGRAM() { return vRAMStatic; }
 
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
+
 private:
   // Bank registers
   uint8_t nTargetRegister = 0;
   bool bPRGBankMode = false;
   bool bCHRInversion = false;
-  MIRROR mirrorMode = MIRROR::HORIZONTAL;
 
   uint32_t pRegister[8];
   uint32_t pCHRBank[8];
   uint32_t pPRGBank[4];
 
   // IRQ
-  bool bIRQActive = false;
   bool bIRQEnable = false;
   bool bIRQUpdate = false;
   uint16_t nIRQCounter = 0;
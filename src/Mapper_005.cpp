@@ -7,8 +7,12 @@ Mapper_005::Mapper_005(uint8_t prgBanks, uint8_t chrBanks)
   vPRGRAM.resize(64 * 1024, 0);
   // Internal Extended RAM - 1KB
   vExRAM.resize(1024, 0);
-  // Internal Nametable RAM - 2KB (replaces NES internal CIRAM)
-  internalNametable.resize(2048, 0);
+  // Fill mode nametable - 1KB, rebuilt when $5106/$5107 change
+  vFillPage.resize(1024, 0);
+  // Nametables and fill mode are served by ppuReadCustom
+  bCustomPPU = true;
+  // Scanline IRQ and the 1KB CHR bank split watch nametable fetches
+  nPPUObserve = PPU_OBSERVE_NT;
   reset();
 }
 
@@ -23,12 +27,14 @@ void Mapper_005::reset() {
   ntMapping = 0;
   fillTile = 0;
   fillColor = 0;
+  UpdateFillPage();
   chrUpperBits = 0;
   multiplierA = 0xFF;
   multiplierB = 0xFF;
 
   irqScanline = 0;
   bIRQEnable = false;
+  bIRQPending = false;
   bIRQActive = false;
   bInFrame = false;
   scanlineCounter = 0;
@@ -53,6 +59,111 @@ void Mapper_005::reset() {
   for (int i = 0; i < 12; i++) {
     chrBankReg[i] = i; // Map 1:1 initially
   }
+
+  BanksChanged();
+}
+
+void Mapper_005::SetPRGSlotFromReg(int slot, uint8_t reg, uint32_t romOffset,
+                                   uint32_t ramBank) {
+  // Bit 7 clear selects PRG RAM instead of ROM
+  if (reg & 0x80)
+    SetPRGSlot(slot, romOffset);
+  else
+    prgSlot[slot] = &vPRGRAM[(ramBank & 0x07) * 8192];
+}
+
+void Mapper_005::updateSlots() {
+  // $5000-$5FFF stays on cpuMapRead for registers and ExRAM
+  // $6000-$7FFF: always PRG RAM, 8KB bank via $5113
+  prgSlot[3] = &vPRGRAM[(prgBankReg[0] & 0x07) * 8192];
+
+  switch (prgMode) {
+  case 0: // One 32KB bank via $5117
+    for (int i = 0; i < 4; i++)
+      SetPRGSlot(4 + i, ((prgBankReg[4] >> 2) & 0x1F) * 32768 + i * 8192);
+    break;
+
+  case 1: // Two 16KB banks via $5115 / $5117
+    for (int i = 0; i < 2; i++) {
+      SetPRGSlotFromReg(4 + i, prgBankReg[2],
+                        ((prgBankReg[2] >> 1) & 0x3F) * 16384 + i * 8192,
+                        (prgBankReg[2] & 0x06) + i);
+      SetPRGSlot(6 + i, ((prgBankReg[4] >> 1) & 0x3F) * 16384 + i * 8192);
+    }
+    break;
+
+  case 2: // 16KB + 8KB + 8KB via $5115 / $5116 / $5117
+    for (int i = 0; i < 2; i++)
+      SetPRGSlotFromReg(4 + i, prgBankReg[2],
+                        ((prgBankReg[2] >> 1) & 0x3F) * 16384 + i * 8192,
+                        (prgBankReg[2] & 0x06) + i);
+    SetPRGSlotFromReg(6, prgBankReg[3], (prgBankReg[3] & 0x7F) * 8192,
+                      prgBankReg[3]);
+    SetPRGSlot(7, (prgBankReg[4] & 0x7F) * 8192);
+    break;
+
+  case 3: // Four 8KB banks via $5114-$5117
+  default:
+    for (int i = 0; i < 3; i++)
+      SetPRGSlotFromReg(4 + i, prgBankReg[1 + i],
+                        (prgBankReg[1 + i] & 0x7F) * 8192, prgBankReg[1 + i]);
+    SetPRGSlot(7, (prgBankReg[4] & 0x7F) * 8192);
+    break;
+  }
+
+  updateNametables();
+
+  // 1KB mode picks sprite or background banks per fetch, so it stays on
+  // ppuMapRead
+  for (int i = 0; i < 8; i++) {
+    switch (chrMode) {
+    case 0: // 8KB
+      SetCHRSlot(i, chrBankReg[7] * 8192 + i * 1024);
+      break;
+    case 1: // 4KB
+      SetCHRSlot(i, chrBankReg[i < 4 ? 3 : 7] * 4096 + (i & 0x03) * 1024);
+      break;
+    case 2: // 2KB
+      SetCHRSlot(i, chrBankReg[(i & 0x06) + 1] * 2048 + (i & 0x01) * 1024);
+      break;
+    default:
+      chrSlot[i] = nullptr;
+      break;
+    }
+  }
+}
+
+void Mapper_005::MapperState(SaveState &s) {
+  s.Values(prgMode, chrMode, prgRamProtect1, prgRamProtect2, exRamMode,
+           ntMapping, fillTile, fillColor, prgBankReg, chrBankReg,
+           chrUpperBits, lastCHRBankWriteIsUpperHalf, bSprite8x16Mode,
+           multiplierA, multiplierB, irqScanline, bIRQEnable, bIRQPending,
+           bInFrame, scanlineCounter, lastPPUAddr, matchCount,
+           bg_fetches_remaining, lastBgTileAddr, lastBgTileExRam, vPRGRAM,
+           vExRAM);
+  if (s.Loading())
+    UpdateFillPage();
+}
+
+void Mapper_005::updateNametables() {
+  // Nametable pages: the two CIRAM pages, ExRAM or the fill page. ExRAM
+  // mode 1 substitutes attributes per tile, so it keeps every nametable read
+  // on ppuReadCustom. Fill mode ignores writes.
+  bool bHookNametables = exRamMode == 1;
+  uint8_t *pages[4] = {pCIRAM, pCIRAM ? pCIRAM + 1024 : nullptr, vExRAM.data(),
+                       vFillPage.data()};
+  for (int i = 0; i < 4; i++) {
+    uint8_t source = (ntMapping >> (i * 2)) & 0x03;
+    ntSlot[i] = bHookNametables ? nullptr : pages[source];
+    ntWriteSlot[i] = source != 3 ? pages[source] : nullptr;
+  }
+}
+
+void Mapper_005::UpdateFillPage() {
+  uint8_t palette = fillColor & 0x03;
+  memset(vFillPage.data(), fillTile, 0x03C0);
+  memset(vFillPage.data() + 0x03C0,
+         palette | (palette << 2) | (palette << 4) | (palette << 6), 0x40);
 }
 
 bool Mapper_005::IsPRGRAMEnabled() {
@@ -76,8 +187,6 @@ uint32_t Mapper_005::GetCHRBankOffset(int bank, int bankSize) {
   return bank * bankSize;
 }
 
-MIRROR Mapper_005::mirror() { return mirrorMode; }
-
 uint8_t Mapper_005::ReadRegister(uint16_t addr) {
   if (addr == 0x5204) {
     // IRQ Status
@@ -86,9 +195,10 @@ uint8_t Mapper_005::ReadRegister(uint16_t addr) {
     uint8_t status = 0;
     if (bInFrame)
       status |= 0x40;
-    if (bIRQActive)
+    if (bIRQPending)
       status |= 0x80;
     // Reading clears IRQ pending
+    bIRQPending = false;
     bIRQActive = false;
     return status;
   } else if (addr == 0x5205) {
@@ -227,14 +337,17 @@ bool Mapper_005::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
     // Configuration registers
     if (addr == 0x5100) {
       prgMode = data & 0x03;
+      BanksChanged();
     } else if (addr == 0x5101) {
       chrMode = data & 0x03;
+      BanksChanged();
     } else if (addr == 0x5102) {
       prgRamProtect1 = data & 0x03;
     } else if (addr == 0x5103) {
       prgRamProtect2 = data & 0x03;
     } else if (addr == 0x5104) {
       exRamMode = data & 0x03;
+      MirrorChanged();
     } else if (addr == 0x5105) {
       // Nametable mapping
       ntMapping = data;
@@ -253,14 +366,18 @@ bool Mapper_005::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
       } else if (nt0 == nt1 && nt1 == nt2 && nt2 == nt3) {
         mirrorMode = (nt0 == 0) ? MIRROR::ONESCREEN_LO : MIRROR::ONESCREEN_HI;
       }
+      MirrorChanged();
     } else if (addr == 0x5106) {
       fillTile = data;
+      UpdateFillPage();
     } else if (addr == 0x5107) {
       fillColor = data & 0x03;
+      UpdateFillPage();
     }
     // PRG bank registers $5113-$5117
     else if (addr >= 0x5113 && addr <= 0x5117) {
       prgBankReg[addr - 0x5113] = data;
+      BanksChanged();
     }
     // CHR bank registers $5120-$512B
     else if (addr >= 0x5120 && addr <= 0x512B) {
@@ -268,6 +385,7 @@ bool Mapper_005::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
       // Track which half was written (for 8x8 sprite mode)
       // $5120-$5127 = sprite banks, $5128-$512B = background banks
       lastCHRBankWriteIsUpperHalf = (addr >= 0x5128);
+      BanksChanged();
     } else if (addr == 0x5130) {
       chrUpperBits = data & 0x03;
     }
@@ -280,6 +398,7 @@ bool Mapper_005::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
       irqScanline = data;
     } else if (addr == 0x5204) {
       bIRQEnable = (data & 0x80) != 0;
+      bIRQActive = bIRQPending && bIRQEnable;
     }
     // Multiplier
     else if (addr == 0x5205) {
@@ -349,17 +468,6 @@ bool Mapper_005::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
 }
 
 bool Mapper_005::ppuMapRead(uint16_t addr, uint32_t &mapped_addr) {
-  // PPU Fetch Monitoring Logic
-  // The PPU fetches NT, AT, PT Low, PT High for each background tile
-  // If we see an Attribute Table read ($23C0-$23FF, etc.), we expect the next 2
-  // PT reads to be for background We strictly check for AT because the PPU does
-  // a dummy NT read at cycle 340 which messes up sprite fetching
-  if (addr >= 0x2000 && addr <= 0x3FFF) {
-    if ((addr & 0x03FF) >= 0x03C0) {
-      bg_fetches_remaining = 2; // Next 2 PT reads are for background
-    }
-  }
-
   // Pattern table $0000-$1FFF
   if (addr < 0x2000) {
     uint32_t bank = 0;
@@ -447,10 +555,10 @@ bool Mapper_005::ppuWriteCustom(uint16_t addr, uint8_t data) {
 
     switch (mode) {
     case 0: // CIRAM Page 0
-      internalNametable[0 + offset] = data;
-      return true;
     case 1: // CIRAM Page 1
-      internalNametable[1024 + offset] = data;
+      if (!pCIRAM)
+        return false;
+      pCIRAM[mode * 1024 + offset] = data;
       return true;
     case 2: // Extended RAM
       vExRAM[offset] = data;
@@ -465,12 +573,6 @@ bool Mapper_005::ppuWriteCustom(uint16_t addr, uint8_t data) {
 // Custom PPU Read for Fill Mode / Complex Mirroring
 bool Mapper_005::ppuReadCustom(uint16_t addr, uint8_t &data) {
   if (addr >= 0x2000 && addr <= 0x3EFF) {
-    // Trigger BG Mode on AT Read (Essential for correct CHR Banking)
-    // Since ppuReadCustom handles logic before ppuMapRead, we must trigger here
-    if ((addr & 0x03FF) >= 0x03C0) {
-      bg_fetches_remaining = 2;
-    }
-
     uint16_t tempAddr = addr & 0x0FFF;
     uint8_t quadrant = (tempAddr >> 10) & 0x03;
     uint8_t mode = (ntMapping >> (quadrant * 2)) & 0x03;
@@ -489,10 +591,10 @@ bool Mapper_005::ppuReadCustom(uint16_t addr, uint8_t &data) {
 
     switch (mode) {
     case 0: // CIRAM Page 0
-      data = internalNametable[0 + offset];
-      return true;
     case 1: // CIRAM Page 1
-      data = internalNametable[1024 + offset];
+      if (!pCIRAM)
+        return false;
+      data = pCIRAM[mode * 1024 + offset];
       return true;
     case 2: // Extended RAM
       data = vExRAM[offset];
@@ -512,9 +614,25 @@ bool Mapper_005::ppuReadCustom(uint16_t addr, uint8_t &data) {
   return false;
 }
 
-void Mapper_005::scanline() {
-  // This is called by the PPU on each scanline
-  // The MMC5 has its own scanline detection, but we use this as a fallback
+void Mapper_005::ppuNTFetch(uint16_t addr) {
+  // The PPU fetches NT, AT, PT low, PT high for each background tile. After
+  // an attribute fetch the next 2 pattern reads are background, everything
+  // else (sprites) uses $5120-$5127 in 1KB mode.
+  if ((addr & 0x03FF) >= 0x03C0)
+    bg_fetches_remaining = 2;
+
+  // A new scanline is detected by three consecutive fetches of the same
+  // nametable address: the two dummy fetches at the end of a line and the
+  // first fetch of the next one
+  if (addr == lastPPUAddr) {
+    if (++matchCount < 2)
+      return;
+  } else {
+    lastPPUAddr = addr;
+    matchCount = 0;
+    return;
+  }
+  matchCount = 0;
 
   if (!bInFrame) {
     bInFrame = true;
@@ -525,12 +643,14 @@ void Mapper_005::scanline() {
 
   // Compare with target scanline
   if (scanlineCounter == irqScanline && irqScanline > 0) {
-    bIRQActive = true;
+    bIRQPending = true;
+    bIRQActive = bIRQEnable;
   }
+}
 
-  // Reset at end of visible frame
-  if (scanlineCounter >= 240) {
-    bInFrame = false;
-    scanlineCounter = 0;
-  }
+void Mapper_005::ppuIdle() {
+  // PPU stopped fetching: vblank or rendering disabled
+  bInFrame = false;
+  lastPPUAddr = 0;
+  matchCount = 0;
 }
@@ -18,12 +18,20 @@ public:
   bool ppuWriteCustom(uint16_t addr, uint8_t data) override;
 
   void reset() override;
-  MIRROR mirror() override;
 
-  // IRQ interface
-  bool irqState() override { return bIRQActive && bIRQEnable; }
-  void irqClear() override { bIRQActive = false; }
-  void scanline() override;
+  // IRQ interface - the line is pending && enabled
+  void irqClear() override {
+    bIRQPending = false;
+    bIRQActive = false;
+  }
+  // The scanline counter is not modelled ahead
+  uint32_t irqQuietDots() const override {
+    return bIRQEnable ? 0 : UINT32_MAX;
+  }
+
+  // Scanline detection and background/sprite fetch tracking
+  void ppuNTFetch(uint16_t addr) override;
+  void ppuIdle() override;
 
   // PRG RAM access
   std::vector<uint8_t> &GetPRGRAM() { return vPRGRAM; }
@@ -34,6 +42,11 @@ public:
   // ExRAM access
   std::vector<uint8_t> &GetExRAM() { return vExRAM; }
 
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
+  void updateNametables() override;
+
 private:
   // Configuration registers
   uint8_t prgMode = 3;        // $5100: PRG banking mode (0-3)
@@ -68,7 +81,7 @@ private:
   // Scanline IRQ
   uint8_t irqScanline = 0; // $5203: Target scanline
   bool bIRQEnable = false; // $5204 bit 7
-  bool bIRQActive = false; // IRQ pending flag
+  bool bIRQPending = false; // IRQ pending flag
   bool bInFrame = false;   // In-frame flag
   uint8_t scanlineCounter = 0;
 
@@ -83,20 +96,20 @@ private:
   uint16_t lastBgTileAddr = 0;
   uint8_t lastBgTileExRam = 0;
 
-  // Mirroring
-  MIRROR mirrorMode = MIRROR::VERTICAL;
-
   // PRG RAM (up to 64KB for compatibility, though games use 8-32KB)
   std::vector<uint8_t> vPRGRAM;
 
   // Internal Extended RAM (1KB)
   std::vector<uint8_t> vExRAM;
 
-  // Internal Nametable RAM (2KB - replaces NES internal CIRAM)
-  std::vector<uint8_t> internalNametable;
+  // Fill mode nametable as seen by the PPU
+  std::vector<uint8_t> vFillPage;
 
   // Helper functions
   uint32_t GetPRGBankOffset(int bank, int bankSize);
   uint32_t GetCHRBankOffset(int bank, int bankSize);
   bool IsPRGRAMEnabled();
+  void UpdateFillPage();
+  void SetPRGSlotFromReg(int slot, uint8_t reg, uint32_t romOffset,
+                         uint32_t ramBank);
 };
@@ -1,8 +1,4 @@
 #include "Mapper_069.h"
-#include <fstream>
-
-// Track if we've logged bank changes (only log first few)
-static int bankChangeCount = 0;
 
 Mapper_069::Mapper_069(uint8_t prgBanks, uint8_t chrBanks)
     : Mapper(prgBanks, chrBanks) {
@@ -34,63 +30,70 @@ void Mapper_069::reset() {
   bIRQCounterEnable = false;
   bIRQActive = false;
   irqCounter = 0;
+  nIRQDeadline = UINT64_MAX;
+  BanksChanged();
 }
 
-void Mapper_069::CountIRQ() {
-  if (bIRQCounterEnable) {
-    irqCounter--;
-    if (irqCounter == 0xFFFF && bIRQEnable) {
-      bIRQActive = true;
-    }
-  }
-}
-
-bool Mapper_069::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
+void Mapper_069::updateSlots() {
+  // Bank offsets wrapped to the memory size once, here, for the slots and
+  // for cpuMapRead/ppuMapRead. $E000-$FFFF is fixed to the last 8KB bank.
   uint32_t prgRomSize = nPRGBanks * 16384;
+  for (int i = 0; i < 4; i++)
+    prgOffset[i] = prgRomSize ? ((prgBank[i] & 0x3F) * 8192) % prgRomSize : 0;
+  prgOffset[4] = prgRomSize ? prgRomSize - 8192 : 0;
+  uint32_t chrSize = nCHRBanks ? nCHRBanks * 8192 : 8192;
+  for (int i = 0; i < 8; i++)
+    chrOffset[i] = (chrBank[i] * 1024) % chrSize;
 
   // $6000-$7FFF: PRG RAM or ROM bank
-  if (addr >= 0x6000 && addr <= 0x7FFF) {
-    if (prgRamSelect) {
-      // PRG RAM
-      mapped_addr = 0xFFFFFFFF;
-      return true;
-    } else {
-      // PRG ROM
-      uint32_t bank = prgBank[0] & 0x3F;
-      mapped_addr = ((bank * 8192) + (addr & 0x1FFF)) % prgRomSize;
-      return true;
-    }
-  }
+  if (prgRamSelect)
+    prgSlot[3] = vPRGRAM.data();
+  else
+    SetPRGSlot(3, prgOffset[0]);
 
-  // $8000-$9FFF: Switchable 8KB PRG ROM
-  if (addr >= 0x8000 && addr <= 0x9FFF) {
-    uint32_t bank = prgBank[1] & 0x3F;
-    mapped_addr = ((bank * 8192) + (addr & 0x1FFF)) % prgRomSize;
-    return true;
-  }
+  for (int i = 1; i < 5; i++)
+    SetPRGSlot(3 + i, prgOffset[i]);
 
-  // $A000-$BFFF: Switchable 8KB PRG ROM
-  if (addr >= 0xA000 && addr <= 0xBFFF) {
-    uint32_t bank = prgBank[2] & 0x3F;
-    mapped_addr = ((bank * 8192) + (addr & 0x1FFF)) % prgRomSize;
-    return true;
-  }
+  for (int i = 0; i < 8; i++)
+    SetCHRSlot(i, chrOffset[i]);
+}
 
-  // $C000-$DFFF: Switchable 8KB PRG ROM
-  if (addr >= 0xC000 && addr <= 0xDFFF) {
-    uint32_t bank = prgBank[3] & 0x3F;
-    mapped_addr = ((bank * 8192) + (addr & 0x1FFF)) % prgRomSize;
-    return true;
-  }
+void Mapper_069::MapperState(SaveState &s) {
+  s.Values(commandRegister, prgBank, prgRamEnable, prgRamSelect, chrBank,
+           bIRQEnable, bIRQCounterEnable, irqCounter, vPRGRAM);
+}
+
+// The counter decrements once per CPU cycle starting with the cycle after
+// a write, so a running counter holding c at cycle t wraps on cycle t + c + 1
+void Mapper_069::SyncIRQCounter() {
+  if (bIRQCounterEnable)
+    irqCounter = (uint16_t)(nIRQDeadline - 1 - CPUCycle());
+}
+
+void Mapper_069::ScheduleIRQ() {
+  nIRQDeadline = bIRQCounterEnable ? CPUCycle() + irqCounter + 1 : UINT64_MAX;
+}
+
+void Mapper_069::irqDeadlineReached() {
+  if (bIRQEnable)
+    bIRQActive = true;
+  // Counting continues from $FFFF
+  nIRQDeadline += 0x10000;
+}
 
-  // $E000-$FFFF: Fixed to last 8KB bank
-  if (addr >= 0xE000) {
-    uint32_t lastBank = (nPRGBanks * 2) - 1; // Last 8KB bank
-    mapped_addr = ((lastBank * 8192) + (addr & 0x1FFF)) % prgRomSize;
+bool Mapper_069::cpuMapRead(uint16_t addr, uint32_t &mapped_addr) {
+  if (addr < 0x6000)
+    return false;
+
+  // $6000-$7FFF: PRG RAM or ROM bank
+  if (addr <= 0x7FFF && prgRamSelect) {
+    mapped_addr = 0xFFFFFFFF;
     return true;
   }
 
-  return false;
+  // $6000-$DFFF switchable 8KB banks, $E000-$FFFF fixed
+  mapped_addr = prgOffset[(addr >> 13) - 3] + (addr & 0x1FFF);
+  return true;
 }
 
 bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) {
@@ -103,6 +106,7 @@ bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
   if (addr >= 0x6000 && addr <= 0x7FFF) {
     if (prgRamSelect && prgRamEnable) {
       mapped_addr = 0xFFFFFFFF;
+      vPRGRAM[addr & 0x1FFF] = data;
       return true;
     }
     return false;
@@ -127,13 +131,7 @@ bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
     case 0x7:
       // CHR Bank 0-7
       chrBank[commandRegister] = data;
-      if (bankChangeCount < 20) {
-        std::ofstream debugLog("nes_debug.log", std::ios::app);
-        debugLog << "CHR Bank " << (int)commandRegister << " = " << (int)data
-                 << std::endl;
-        debugLog.close();
-        bankChangeCount++;
-      }
+      BanksChanged();
       break;
 
     case 0x8:
@@ -141,21 +139,25 @@ bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
       prgRamEnable = (data & 0x80) != 0;
       prgRamSelect = (data & 0x40) != 0;
       prgBank[0] = data & 0x3F;
+      BanksChanged();
       break;
 
     case 0x9:
       // PRG Bank at $8000-$9FFF
       prgBank[1] = data & 0x3F;
+      BanksChanged();
       break;
 
     case 0xA:
       // PRG Bank at $A000-$BFFF
       prgBank[2] = data & 0x3F;
+      BanksChanged();
       break;
 
     case 0xB:
       // PRG Bank at $C000-$DFFF
       prgBank[3] = data & 0x3F;
+      BanksChanged();
       break;
 
     case 0xC:
@@ -174,25 +176,30 @@ bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
         mirrorMode = MIRROR::ONESCREEN_HI;
         break;
       }
+      MirrorChanged();
       break;
 
     case 0xD:
-      // IRQ Control
+      // IRQ Control - any write acknowledges the IRQ
+      SyncIRQCounter();
       bIRQEnable = (data & 0x01) != 0;
       bIRQCounterEnable = (data & 0x80) != 0;
-      if (!bIRQEnable) {
-        bIRQActive = false;
-      }
+      bIRQActive = false;
+      ScheduleIRQ();
       break;
 
     case 0xE:
       // IRQ Counter Low
+      SyncIRQCounter();
       irqCounter = (irqCounter & 0xFF00) | data;
+      ScheduleIRQ();
       break;
 
     case 0xF:
       // IRQ Counter High
+      SyncIRQCounter();
       irqCounter = (irqCounter & 0x00FF) | (data << 8);
+      ScheduleIRQ();
       break;
     }
     return false;
@@ -203,13 +210,7 @@ bool Mapper_069::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr,
 
 bool Mapper_069::ppuMapRead(uint16_t addr, uint32_t &mapped_addr) {
   if (addr < 0x2000) {
-    uint32_t chrRomSize = nCHRBanks * 8192;
-    if (chrRomSize == 0)
-      chrRomSize = 8192; // CHR RAM
-
-    int bankIndex = (addr >> 10) & 0x07;
-    uint32_t bank = chrBank[bankIndex];
-    mapped_addr = ((bank * 1024) + (addr & 0x03FF)) % chrRomSize;
+    mapped_addr = chrOffset[(addr >> 10) & 0x07] + (addr & 0x03FF);
     return true;
   }
   return false;
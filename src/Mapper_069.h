@@ -14,18 +14,20 @@ public:
   bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
 
   void reset() override;
-  MIRROR mirror() override { return mirrorMode; }
 
   // IRQ interface - FME-7 uses cycle-counting IRQ
-  bool irqState() override { return bIRQActive; }
   void irqClear() override { bIRQActive = false; }
 
-  // Called every CPU cycle (for IRQ counting)
-  void CountIRQ();
+  // The IRQ counter wrapped from $0000 to $FFFF
+  void irqDeadlineReached() override;
 
   // PRG RAM access
   std::vector<uint8_t> &GetPRGRAM() { return vPRGRAM; }
 
+protected:
+  void updateSlots() override;
+  void MapperState(SaveState &s) override;
+
 private:
   // Command register ($8000-$9FFF)
   uint8_t commandRegister = 0;
@@ -43,14 +45,19 @@ private:
   // CHR bank registers (8 x 1KB banks)
   uint8_t chrBank[8] = {0};
 
-  // Mirroring
-  MIRROR mirrorMode = MIRROR::VERTICAL;
+  // PRG ROM offsets of the banks at $6000-$E000 and CHR offsets of the 1KB
+  // banks, wrapped to the memory size by updateSlots()
+  uint32_t prgOffset[5] = {0};
+  uint32_t chrOffset[8] = {0};
 
   // IRQ
   bool bIRQEnable = false;
   bool bIRQCounterEnable = false;
-  bool bIRQActive = false;
-  uint16_t irqCounter = 0;
+  uint16_t irqCounter = 0; // Only current while the counter is stopped
+
+  // Counter <-> deadline conversion while the counter runs
+  void SyncIRQCounter();
+  void ScheduleIRQ();
 
   // PRG RAM (8KB)
   std::vector<uint8_t> vPRGRAM;
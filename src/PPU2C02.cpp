@@ -1,11 +1,19 @@
 #include "PPU2C02.h"
+#include "PPUCompositor.h"
+#include "PPUThread.h"
+#include <algorithm>
 #include <cstring>
+#ifdef MGK_PPU_VERIFY
+#include <cstdio>
+#endif
 
 PPU2C02::PPU2C02() {
   memset(tblName, 0, sizeof(tblName));
   memset(tblPalette, 0, sizeof(tblPalette));
   memset(OAM, 0, sizeof(OAM));
-  memset(screen, 0, sizeof(screen));
+  memset(poolSum, 0, sizeof(poolSum));
+  screen.assign(256 * 240, Pixel{0, 0, 0, 0});
+  pScreen = screen.data();
 
   // Initialize NES Color Palette (NTSC)
   palScreen[0x00] = {84, 84, 84, 255};
@@ -75,11 +83,19 @@ PPU2C02::PPU2C02() {
   palScreen[0x3D] = {160, 162, 160, 255};
   palScreen[0x3E] = {0, 0, 0, 255};
   palScreen[0x3F] = {0, 0, 0, 255};
+
+  // BT.601 luma
+  for (int i = 0; i < 0x40; i++)
+    palLuma[i] = (uint8_t)((77 * palScreen[i].r + 150 * palScreen[i].g +
+                            29 * palScreen[i].b + 128) >>
+                           8);
 }
 
 PPU2C02::~PPU2C02() {}
 
 void PPU2C02::reset() {
+  if (pThread)
+    pThread->Reset();
   fine_x = 0x00;
   address_latch = 0x00;
   ppu_data_buffer = 0x00;
@@ -98,18 +114,447 @@ void PPU2C02::reset() {
   control.reg = 0x00;
   vram_addr.reg = 0x0000;
   tram_addr.reg = 0x0000;
+  bA12 = false;
+  bFetching = false;
+  nIdleDots = 0;
+  nIdleRun = 0;
+  bIdleDot = false;
+  bLineActive = false;
+  memset(poolSum, 0, sizeof(poolSum));
+}
+
+void PPU2C02::SetOutput(OUTPUT format, uint8_t scale, void *pBuffer) {
+  nOutput = format;
+  nOutputShift = scale >= 4 ? 2 : scale >= 2 ? 1 : 0;
+  memset(poolSum, 0, sizeof(poolSum));
+
+  if (format == OUTPUT_RGBA && nOutputShift == 0) {
+    if (screen.empty())
+      screen.assign(256 * 240, Pixel{0, 0, 0, 0});
+    pScreen = pBuffer ? (Pixel *)pBuffer : screen.data();
+    std::vector<uint8_t>().swap(vOutput);
+    pOutput = nullptr;
+    return;
+  }
+
+  size_t nSize = (size_t)(256 >> nOutputShift) * (240 >> nOutputShift) *
+                 (format == OUTPUT_RGBA ? sizeof(Pixel) : 1);
+  if (pBuffer) {
+    std::vector<uint8_t>().swap(vOutput);
+    pOutput = (uint8_t *)pBuffer;
+  } else {
+    vOutput.assign(nSize, 0);
+    pOutput = vOutput.data();
+  }
+  std::vector<Pixel>().swap(screen);
+  pScreen = nullptr;
+}
+
+void *PPU2C02::OutputBuffer() const {
+  return pOutput ? (void *)pOutput : (void *)pScreen;
+}
+
+// Fill a table indexed by palette RAM entry, only at the entries a short
+// span uses (the per-dot path draws one pixel at a time)
+template <class T, class F>
+static void FillTable(T *table, const uint8_t *src, int n, F f) {
+  if (n < 32)
+    for (int x = 0; x < n; x++)
+      table[src[x]] = f(src[x]);
+  else
+    for (int i = 0; i < 32; i++)
+      table[i] = f(i);
+}
+
+void PPU2C02::OutputSpan(int16_t line, int16_t x0, int16_t x1,
+                         const uint8_t *src) {
+  // NES colour of each palette RAM entry
+  int n = x1 - x0;
+  uint8_t nMask = mask.grayscale ? 0x30 : 0x3F;
+  uint8_t colour[32];
+  FillTable(colour, src, n,
+            [&](int i) { return tblPalette[paletteMirror[i]] & nMask; });
+
+  if (nOutputShift == 0) {
+    switch (nOutput) {
+    case OUTPUT_RGBA: {
+      Pixel rgba[32];
+      FillTable(rgba, src, n, [&](int i) { return palScreen[colour[i]]; });
+      Pixel *row = &pScreen[line * 256 + x0];
+      for (int x = 0; x < n; x++)
+        row[x] = rgba[src[x]];
+      break;
+    }
+    case OUTPUT_INDEX: {
+      uint8_t *row = &pOutput[line * 256 + x0];
+      for (int x = 0; x < n; x++)
+        row[x] = colour[src[x]];
+      break;
+    }
+    case OUTPUT_GRAY: {
+      uint8_t luma[32];
+      FillTable(luma, src, n, [&](int i) { return palLuma[colour[i]]; });
+      uint8_t *row = &pOutput[line * 256 + x0];
+      for (int x = 0; x < n; x++)
+        row[x] = luma[src[x]];
+      break;
+    }
+    }
+    return;
+  }
+
+  int nScale = 1 << nOutputShift;
+  int nMod = nScale - 1;
+  switch (nOutput) {
+  case OUTPUT_INDEX: {
+    if (line & nMod)
+      return;
+    uint8_t *row = &pOutput[(line >> nOutputShift) * (256 >> nOutputShift)];
+    for (int x = (x0 + nMod) & ~nMod; x < x1; x += nScale)
+      row[x >> nOutputShift] = colour[src[x - x0]];
+    return;
+  }
+  case OUTPUT_GRAY:
+    for (int x = x0; x < x1; x++)
+      poolSum[x >> nOutputShift] += palLuma[colour[src[x - x0]]];
+    break;
+  case OUTPUT_RGBA:
+    for (int x = x0; x < x1; x++) {
+      const Pixel &p = palScreen[colour[src[x - x0]]];
+      uint16_t *sum = &poolSum[(x >> nOutputShift) * 3];
+      sum[0] += p.r;
+      sum[1] += p.g;
+      sum[2] += p.b;
+    }
+    break;
+  }
+
+  // Each pixel is drawn once a frame, so a block row is complete with the
+  // last pixel of its last line
+  if (x1 == 256 && (line & nMod) == nMod)
+    OutputPooledRow(line >> nOutputShift);
+}
+
+void PPU2C02::OutputPooledRow(int16_t row) {
+  int nWidth = 256 >> nOutputShift;
+  int nArea = 2 * nOutputShift;
+  uint16_t nRound = (uint16_t)(1 << (nArea - 1));
+  if (nOutput == OUTPUT_GRAY) {
+    uint8_t *out = &pOutput[row * nWidth];
+    for (int x = 0; x < nWidth; x++)
+      out[x] = (uint8_t)((poolSum[x] + nRound) >> nArea);
+    memset(poolSum, 0, nWidth * sizeof(uint16_t));
+  } else {
+    Pixel *out = (Pixel *)pOutput + row * nWidth;
+    for (int x = 0; x < nWidth; x++) {
+      const uint16_t *sum = &poolSum[x * 3];
+      out[x] = {(uint8_t)((sum[0] + nRound) >> nArea),
+                (uint8_t)((sum[1] + nRound) >> nArea),
+                (uint8_t)((sum[2] + nRound) >> nArea), 255};
+    }
+    memset(poolSum, 0, nWidth * 3 * sizeof(uint16_t));
+  }
+}
+
+void PPU2C02::State(SaveState &s) {
+  // Idle runs are caught up first, so the state has none
+  EndIdleRun();
+  s.Values(tblName, tblPalette, OAM, oam_addr);
+  s.Values(status.reg, control.reg, mask.reg, vram_addr.reg, tram_addr.reg);
+  s.Values(fine_x, address_latch, ppu_data_buffer, scanline, cycle);
+  s.Values(bg_next_tile_id, bg_next_tile_attrib, bg_next_tile_lsb,
+           bg_next_tile_msb);
+  s.Values(bg_shifter_pattern_lo, bg_shifter_pattern_hi, bg_shifter_attrib_lo,
+           bg_shifter_attrib_hi);
+  s.Values(sprite_count, spriteScanline, bSpriteZeroHitPossible, spriteLine,
+           nZeroX, nZeroEnd);
+  s.Values(nmi, frame_complete, bA12, bFetching, nFrameCount, nA12FallDot);
+  s.Values(bLineActive, nLineX, nLineFlush, nRenderStamp, bgLine, lineOut);
+  if (s.Loading())
+    memset(poolSum, 0, sizeof(poolSum));
 }
 
 void PPU2C02::ConnectCartridge(const std::shared_ptr<Cartridge> &cartridge) {
   this->cart = cartridge;
+  cart->SetBankChangeCallback([this]() { UpdatePageTable(); });
+  cart->SetMirrorChangeCallback([this]() { UpdateNametablePages(); });
+  cart->ConnectCIRAM(&tblName[0][0]);
+  UpdatePageTable();
+  nObserve = cart->GetPPUObserveMask();
+}
+
+void PPU2C02::UpdatePageTable() {
+  for (int i = 0; i < 8; i++)
+    pPage[i] = cart->GetCHRPage(i);
+  UpdateNametablePages();
+}
+
+void PPU2C02::UpdateNametablePages() {
+  // CIRAM page for each nametable, indexed by MIRROR
+  static const uint8_t ciramPage[4][4] = {
+      {0, 0, 1, 1}, // HORIZONTAL
+      {0, 1, 0, 1}, // VERTICAL
+      {0, 0, 0, 0}, // ONESCREEN_LO
+      {1, 1, 1, 1}, // ONESCREEN_HI
+  };
+
+  bool bCustom = cart->HasCustomPPU();
+  MIRROR mirrorMode = cart->GetMirror();
+  for (int i = 0; i < 4; i++) {
+    uint8_t *ciram = tblName[ciramPage[mirrorMode][i]];
+    pPage[8 + i] = bCustom ? cart->GetNTPage(i) : ciram;
+    pPage[12 + i] = pPage[8 + i]; // $3000-$3EFF mirrors $2000-$2EFF
+    pNTWrite[i] = bCustom ? cart->GetNTWritePage(i) : ciram;
+  }
+  if (pThread)
+    pThread->PagesChanged();
+}
+
+void PPU2C02::ObserveA12(uint16_t addr) {
+  bool bHigh = (addr & 0x1000) != 0;
+  if (bHigh == bA12)
+    return;
+  bA12 = bHigh;
+  if (bHigh)
+    cart->PPUA12Rise(
+        (uint32_t)std::min<uint64_t>(DotStamp() - nA12FallDot, UINT32_MAX));
+  else
+    nA12FallDot = DotStamp();
+}
+
+void PPU2C02::ObserveFetch() {
+  if (scanline >= 240 || !(mask.render_background || mask.render_sprites)) {
+    if (bFetching && (nObserve & PPU_OBSERVE_NT))
+      cart->PPUIdle();
+    bFetching = false;
+    return;
+  }
+  bFetching = true;
+  if (cycle == 0)
+    return;
+
+  // Each 8-dot slot puts NT, AT, pattern low and pattern high addresses on
+  // the bus on its 1st, 3rd, 5th and 7th dot
+  uint8_t phase = (cycle - 1) & 0x07;
+  uint16_t addr = 0x2000 | (vram_addr.reg & 0x0FFF);
+  if (cycle <= 256 || (cycle >= 321 && cycle <= 336)) {
+    if (phase == 2)
+      addr = 0x23C0 | (vram_addr.reg & 0x0C00) |
+             ((vram_addr.reg >> 4) & 0x38) | ((vram_addr.reg >> 2) & 0x07);
+    else if (phase == 4)
+      addr = control.pattern_background << 12;
+    else if (phase != 0)
+      return;
+    if (phase < 4 && (nObserve & PPU_OBSERVE_NT))
+      cart->PPUNTFetch(addr);
+  } else if (cycle <= 320) {
+    // Sprite slots: garbage NT fetch, then the sprite's pattern. Unused
+    // slots fetch tile $FF, which matters for 8x16 sprites.
+    if (phase == 4) {
+      int i = (cycle - 257) >> 3;
+      uint8_t id = (scanline >= 0 && i < sprite_count) ? spriteScanline[i].id
+                                                       : 0xFF;
+      addr = control.sprite_size ? (id & 0x01) << 12
+                                 : control.pattern_sprite << 12;
+    } else if (phase != 0) {
+      return;
+    }
+  } else {
+    // Two dummy NT fetches of the next line's third tile
+    if (cycle != 337 && cycle != 339)
+      return;
+    if (nObserve & PPU_OBSERVE_NT)
+      cart->PPUNTFetch(addr);
+  }
+
+  if (nObserve & PPU_OBSERVE_A12)
+    ObserveA12(addr);
+}
+
+uint32_t PPU2C02::IdleRunLength() {
+  // Visible and pre-render lines are only idle with rendering disabled, or
+  // when a render thread draws them
+  int32_t stop = INT32_MAX;
+  if (scanline < 240 && (mask.render_background || mask.render_sprites)) {
+    if (!pThread)
+      return 0;
+    stop = SpriteZeroStop();
+  }
+  // A mapper observer is still owed its ppuIdle()
+  if (nObserve && bFetching)
+    return 0;
+
+  // Events, as dots into the frame: flag clear at -1/1, the skipped dot at
+  // 0/0, vblank at 241/1 and the frame wrap at 260/340
+  static const int32_t events[] = {1, 341, 242 * 341 + 1, 261 * 341 + 340};
+  int32_t dot = (scanline + 1) * 341 + cycle;
+  for (int32_t event : events)
+    if (dot <= event)
+      return std::max(std::min(event, stop) - dot, 0);
+  return 0;
+}
+
+int32_t PPU2C02::SpriteZeroStop() const {
+  // Sprite 0 can only hit on a line whose evaluation at dot 257 found it, so
+  // dots are clocked from there until the next line's evaluation. Either
+  // layer may be enabled before the hit.
+  if (status.sprite_zero_hit)
+    return INT32_MAX;
+  int32_t dot = (scanline + 1) * 341 + cycle;
+  // Found or drawn for this line before OAM changed
+  if (bSpriteZeroHitPossible || (nZeroEnd > nZeroX && scanline >= 0 &&
+                                 cycle <= 256))
+    return dot;
+  int16_t last = std::min(OAM[0] + (control.sprite_size ? 15 : 7), 238);
+  for (int16_t line = OAM[0]; line <= last; line++) {
+    int32_t start = (line + 1) * 341 + 257;
+    if (start + 341 > dot)
+      return start;
+  }
+  return INT32_MAX;
+}
+
+uint32_t PPU2C02::DotsUntilNMI() {
+  if (nmi)
+    return 0;
+  if (!control.enable_nmi)
+    return UINT32_MAX;
+  CatchUp();
+
+  // Vblank starts at 241/1. The skipped dot at 0/0 is not subtracted, so the
+  // result may be one short.
+  const int32_t vblank = 242 * 341 + 1;
+  int32_t dot = (scanline + 1) * 341 + cycle;
+  return dot <= vblank ? vblank - dot : 262 * 341 - dot + vblank;
 }
 
+uint32_t PPU2C02::DotsUntilOAMRead() {
+  if (!(mask.render_background || mask.render_sprites))
+    return UINT32_MAX;
+  CatchUp();
+
+  // Lines 0-239 evaluate sprites at dot 257
+  const int32_t first = 1 * 341 + 257, last = 240 * 341 + 257;
+  int32_t dot = (scanline + 1) * 341 + cycle;
+  if (dot <= first)
+    return first - dot;
+  if (dot <= last)
+    return cycle <= 257 ? 257 - cycle : 341 - cycle + 257;
+  return 262 * 341 - dot + first;
+}
+
+void PPU2C02::SkipIdleDots() {
+  int32_t dot = (scanline + 1) * 341 + cycle;
+  int32_t end = dot + (nIdleRun - nIdleDots);
+  nIdleRun = nIdleDots;
+
+  if (scanline < 240 && (mask.render_background || mask.render_sprites)) {
+    SkipRenderedDots(dot, end);
+    scanline = end / 341 - 1;
+    cycle = end % 341;
+    return;
+  }
+
+  // Visible lines with rendering disabled show the backdrop colour, which
+  // a render thread draws instead
+  if (scanline < 240 && !pThread) {
+    static const uint8_t backdrop[256] = {};
+    for (int s = std::max<int>(scanline, 0); s < 240; s++) {
+      int32_t lineStart = (s + 1) * 341;
+      if (lineStart >= end)
+        break;
+      int32_t x0 = std::max(dot, lineStart + 1) - lineStart;
+      int32_t x1 = std::min(end, lineStart + 257) - lineStart;
+      if (x1 > x0)
+        OutputSpan(s, x0 - 1, x1 - 1, backdrop);
+    }
+  }
+
+  // No sprite evaluation or fetches happened for the skipped lines
+  if (scanline < 240 && end > (scanline + 1) * 341 + 257) {
+    sprite_count = 0;
+    memset(spriteLine, 0, sizeof(spriteLine));
+    nZeroX = nZeroEnd = 0;
+  }
+
+  scanline = end / 341 - 1;
+  cycle = end % 341;
+}
+
+void PPU2C02::SkipRenderedDots(int32_t dot, int32_t end) {
+  // What the rendering path does to the scroll address, and the last sprite
+  // evaluation for the overflow flag. No sprite 0 is on these lines, so
+  // nothing is fetched or drawn.
+  int16_t nEvaluate = -1;
+  for (int16_t s = scanline; s < 240; s++) {
+    int32_t lineStart = (s + 1) * 341;
+    if (lineStart >= end)
+      break;
+    int32_t c0 = std::max(dot, lineStart) - lineStart;
+    int32_t c1 = std::min(end, lineStart + 341) - lineStart;
+    auto Covers = [&](int32_t c) { return c0 <= c && c < c1; };
+
+    for (int32_t c = std::max((c0 + 7) & ~7, 8); c <= 256 && c < c1; c += 8)
+      IncrementScrollX();
+    if (Covers(256))
+      IncrementScrollY();
+    if (Covers(257)) {
+      TransferAddressX();
+      if (s >= 0)
+        nEvaluate = s;
+    }
+    if (s == -1 && c0 < 305 && c1 > 280)
+      TransferAddressY();
+    if (Covers(328))
+      IncrementScrollX();
+    if (Covers(336))
+      IncrementScrollX();
+    if (Covers(340)) {
+      memset(spriteLine, 0, sizeof(spriteLine));
+      nZeroX = nZeroEnd = 0;
+    }
+  }
+  if (nEvaluate >= 0)
+    EvaluateSprites(nEvaluate);
+  bLineActive = false;
+}
+
+void PPU2C02::EndIdleRun() {
+  CatchUp();
+  nIdleDots = nIdleRun = 0;
+  bIdleDot = false;
+}
+
+void PPU2C02::DMAWrite(uint8_t addr, uint8_t data) {
+  // Where a render thread's skipped runs stop depends on OAM
+  if (pThread) {
+    EndIdleRun();
+    pThread->OAMWrite(addr, data);
+  }
+  OAM[addr] = data;
+}
+
+void PPU2C02::DMAPage(const uint8_t *src) {
+  if (pThread) {
+    EndIdleRun();
+    pThread->OAMPage(src);
+  }
+  memcpy(OAM, src, sizeof(OAM));
+}
+
+// $3F10/$3F14/$3F18/$3F1C mirror the backdrop entries below them
+const uint8_t PPU2C02::paletteMirror[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,
+    0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0x11, 0x12, 0x13, 0x04, 0x15,
+    0x16, 0x17, 0x08, 0x19, 0x1A, 0x1B, 0x0C, 0x1D, 0x1E, 0x1F};
+
 Pixel &PPU2C02::GetColorFromPaletteRam(uint8_t palette, uint8_t pixel) {
   return palScreen[ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F];
 }
 
 uint8_t PPU2C02::cpuRead(uint16_t addr, bool rdonly) {
   uint8_t data = 0x00;
+  CatchUp();
 
   if (rdonly) {
     switch (addr) {
@@ -140,6 +585,8 @@ uint8_t PPU2C02::cpuRead(uint16_t addr, bool rdonly) {
     case 0x0001:
       break;
     case 0x0002:
+      if (pThread)
+        pThread->Read(addr);
       data = (status.reg & 0xE0) | (ppu_data_buffer & 0x1F);
       status.vertical_blank = 0;
       address_latch = 0;
@@ -154,6 +601,10 @@ uint8_t PPU2C02::cpuRead(uint16_t addr, bool rdonly) {
     case 0x0006:
       break;
     case 0x0007:
+      if (pThread)
+        pThread->Read(addr);
+      if ((nObserve & PPU_OBSERVE_A12) && !bFetching)
+        ObserveA12(vram_addr.reg);
       data = ppu_data_buffer;
       ppu_data_buffer = ppuRead(vram_addr.reg);
       if (vram_addr.reg >= 0x3F00)
@@ -166,6 +617,15 @@ uint8_t PPU2C02::cpuRead(uint16_t addr, bool rdonly) {
 }
 
 void PPU2C02::cpuWrite(uint16_t addr, uint8_t data) {
+  // Any write may end an idle run, the next clock() decides again
+  EndIdleRun();
+  if (pThread)
+    pThread->Write(addr, data);
+
+  // Pixels already drawn keep the state they were drawn with
+  if (bLineActive)
+    ComposeSpan(cycle - 1);
+
   switch (addr) {
   case 0x0000: // Control
     control.reg = data;
@@ -173,6 +633,13 @@ void PPU2C02::cpuWrite(uint16_t addr, uint8_t data) {
     tram_addr.nametable_y = control.nametable_y;
     break;
   case 0x0001: // Mask
+    if ((data ^ mask.reg) & 0x18) {
+      // Shifters stall while disabled, which line mode does not model: the
+      // rest of this line and the next one's prefetch use the per-dot path
+      nRenderStamp = DotStamp();
+      if (bLineActive)
+        EndLine();
+    }
     mask.reg = data;
     break;
   case 0x0002: // Status
@@ -202,9 +669,14 @@ void PPU2C02::cpuWrite(uint16_t addr, uint8_t data) {
       tram_addr.reg = (tram_addr.reg & 0xFF00) | data;
       vram_addr = tram_addr;
       address_latch = 0;
+      // Outside rendering the PPU bus follows v, which MMC3 can see
+      if ((nObserve & PPU_OBSERVE_A12) && !bFetching)
+        ObserveA12(vram_addr.reg);
     }
     break;
   case 0x0007: // PPU Data
+    if ((nObserve & PPU_OBSERVE_A12) && !bFetching)
+      ObserveA12(vram_addr.reg);
     ppuWrite(vram_addr.reg, data);
     vram_addr.reg += (control.increment_mode ? 32 : 1);
     break;
@@ -215,49 +687,15 @@ uint8_t PPU2C02::ppuRead(uint16_t addr, bool rdonly) {
   uint8_t data = 0x00;
   addr &= 0x3FFF;
 
-  if (cart->ppuRead(addr, data)) {
-  } else if (addr >= 0x0000 && addr <= 0x1FFF) {
-    // Pattern memory
-  } else if (addr >= 0x2000 && addr <= 0x3EFF) {
-    addr &= 0x0FFF;
-
-    // Dynamic mirroring based on mapper
-    MIRROR mirrorMode = cart->GetMirror();
-
-    if (mirrorMode == MIRROR::VERTICAL) {
-      if (addr >= 0x0000 && addr <= 0x03FF)
-        data = tblName[0][addr & 0x03FF];
-      else if (addr >= 0x0400 && addr <= 0x07FF)
-        data = tblName[1][addr & 0x03FF];
-      else if (addr >= 0x0800 && addr <= 0x0BFF)
-        data = tblName[0][addr & 0x03FF];
-      else if (addr >= 0x0C00 && addr <= 0x0FFF)
-        data = tblName[1][addr & 0x03FF];
-    } else if (mirrorMode == MIRROR::HORIZONTAL) {
-      if (addr >= 0x0000 && addr <= 0x03FF)
-        data = tblName[0][addr & 0x03FF];
-      else if (addr >= 0x0400 && addr <= 0x07FF)
-        data = tblName[0][addr & 0x03FF];
-      else if (addr >= 0x0800 && addr <= 0x0BFF)
-        data = tblName[1][addr & 0x03FF];
-      else if (addr >= 0x0C00 && addr <= 0x0FFF)
-        data = tblName[1][addr & 0x03FF];
-    } else if (mirrorMode == MIRROR::ONESCREEN_LO) {
-      data = tblName[0][addr & 0x03FF];
-    } else if (mirrorMode == MIRROR::ONESCREEN_HI) {
-      data = tblName[1][addr & 0x03FF];
-    }
-  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
-    addr &= 0x001F;
-    if (addr == 0x0010)
-      addr = 0x0000;
-    if (addr == 0x0014)
-      addr = 0x0004;
-    if (addr == 0x0018)
-      addr = 0x0008;
-    if (addr == 0x001C)
-      addr = 0x000C;
-    data = tblPalette[addr] & (mask.grayscale ? 0x30 : 0x3F);
+  if (addr <= 0x3EFF) {
+    // Pattern tables and nametables
+    if (uint8_t *page = pPage[addr >> 10])
+      data = page[addr & 0x03FF];
+    else
+      cart->ppuRead(addr, data);
+  } else {
+    data = tblPalette[paletteMirror[addr & 0x001F]] &
+           (mask.grayscale ? 0x30 : 0x3F);
   }
   return data;
 }
@@ -265,95 +703,104 @@ uint8_t PPU2C02::ppuRead(uint16_t addr, bool rdonly) {
 void PPU2C02::ppuWrite(uint16_t addr, uint8_t data) {
   addr &= 0x3FFF;
 
-  if (cart->ppuWrite(addr, data)) {
-  } else if (addr >= 0x0000 && addr <= 0x1FFF) {
-  } else if (addr >= 0x2000 && addr <= 0x3EFF) {
-    addr &= 0x0FFF;
-
-    // Dynamic mirroring based on mapper
-    MIRROR mirrorMode = cart->GetMirror();
-
-    if (mirrorMode == MIRROR::VERTICAL) {
-      if (addr >= 0x0000 && addr <= 0x03FF)
-        tblName[0][addr & 0x03FF] = data;
-      else if (addr >= 0x0400 && addr <= 0x07FF)
-        tblName[1][addr & 0x03FF] = data;
-      else if (addr >= 0x0800 && addr <= 0x0BFF)
-        tblName[0][addr & 0x03FF] = data;
-      else if (addr >= 0x0C00 && addr <= 0x0FFF)
-        tblName[1][addr & 0x03FF] = data;
-    } else if (mirrorMode == MIRROR::HORIZONTAL) {
-      if (addr >= 0x0000 && addr <= 0x03FF)
-        tblName[0][addr & 0x03FF] = data;
-      else if (addr >= 0x0400 && addr <= 0x07FF)
-        tblName[0][addr & 0x03FF] = data;
-      else if (addr >= 0x0800 && addr <= 0x0BFF)
-        tblName[1][addr & 0x03FF] = data;
-      else if (addr >= 0x0C00 && addr <= 0x0FFF)
-        tblName[1][addr & 0x03FF] = data;
-    } else if (mirrorMode == MIRROR::ONESCREEN_LO) {
-      tblName[0][addr & 0x03FF] = data;
-    } else if (mirrorMode == MIRROR::ONESCREEN_HI) {
-      tblName[1][addr & 0x03FF] = data;
-    }
-  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
-    addr &= 0x001F;
-    if (addr == 0x0010)
-      addr = 0x0000;
-    if (addr == 0x0014)
-      addr = 0x0004;
-    if (addr == 0x0018)
-      addr = 0x0008;
-    if (addr == 0x001C)
-      addr = 0x000C;
-    tblPalette[addr] = data;
+  if (addr <= 0x1FFF) {
+    // CHR RAM and mapper registers. A render thread's replica has no
+    // cartridge and is sent the resulting byte instead.
+    if (cart)
+      cart->ppuWrite(addr, data);
+    if (pThread)
+      pThread->CHRWritten(addr);
+  } else if (addr <= 0x3EFF) {
+    // Nametables through the write page table
+    if (uint8_t *page = pNTWrite[(addr >> 10) & 0x03])
+      page[addr & 0x03FF] = data;
+    else
+      cart->ppuWrite(addr, data);
+  } else {
+    tblPalette[paletteMirror[addr & 0x001F]] = data;
+  }
+}
+
+void PPU2C02::IncrementScrollX() {
+  if (mask.render_background || mask.render_sprites) {
+    if (vram_addr.coarse_x == 31) {
+      vram_addr.coarse_x = 0;
+      vram_addr.nametable_x = ~vram_addr.nametable_x;
+    } else {
+      vram_addr.coarse_x++;
+    }
   }
 }
 
-void PPU2C02::clock() {
-  auto IncrementScrollX = [&]() {
-    if (mask.render_background || mask.render_sprites) {
-      if (vram_addr.coarse_x == 31) {
-        vram_addr.coarse_x = 0;
-        vram_addr.nametable_x = ~vram_addr.nametable_x;
+void PPU2C02::IncrementScrollY() {
+  if (mask.render_background || mask.render_sprites) {
+    if (vram_addr.fine_y < 7) {
+      vram_addr.fine_y++;
+    } else {
+      vram_addr.fine_y = 0;
+      if (vram_addr.coarse_y == 29) {
+        vram_addr.coarse_y = 0;
+        vram_addr.nametable_y = ~vram_addr.nametable_y;
+      } else if (vram_addr.coarse_y == 31) {
+        vram_addr.coarse_y = 0;
       } else {
-        vram_addr.coarse_x++;
+        vram_addr.coarse_y++;
       }
     }
-  };
+  }
+}
 
-  auto IncrementScrollY = [&]() {
-    if (mask.render_background || mask.render_sprites) {
-      if (vram_addr.fine_y < 7) {
-        vram_addr.fine_y++;
-      } else {
-        vram_addr.fine_y = 0;
-        if (vram_addr.coarse_y == 29) {
-          vram_addr.coarse_y = 0;
-          vram_addr.nametable_y = ~vram_addr.nametable_y;
-        } else if (vram_addr.coarse_y == 31) {
-          vram_addr.coarse_y = 0;
-        } else {
-          vram_addr.coarse_y++;
+void PPU2C02::TransferAddressX() {
+  if (mask.render_background || mask.render_sprites) {
+    vram_addr.nametable_x = tram_addr.nametable_x;
+    vram_addr.coarse_x = tram_addr.coarse_x;
+  }
+}
+
+void PPU2C02::TransferAddressY() {
+  if (mask.render_background || mask.render_sprites) {
+    vram_addr.fine_y = tram_addr.fine_y;
+    vram_addr.nametable_y = tram_addr.nametable_y;
+    vram_addr.coarse_y = tram_addr.coarse_y;
+  }
+}
+
+void PPU2C02::EvaluateSprites(int16_t line) {
+  memset(spriteScanline, 0xFF, sizeof(spriteScanline));
+  sprite_count = 0;
+
+  uint8_t nOAMEntry = 0;
+  uint8_t nLimit = bSpriteLimit ? 8 : 64;
+  bSpriteZeroHitPossible = false;
+
+  while (nOAMEntry < 64 && sprite_count < nLimit + 1) {
+    int16_t diff = ((int16_t)line - (int16_t)OAM[nOAMEntry * 4 + 0]);
+    if (diff >= 0 && diff < (control.sprite_size ? 16 : 8)) {
+      if (sprite_count < nLimit) {
+        if (nOAMEntry == 0) {
+          bSpriteZeroHitPossible = true;
         }
+        memcpy(&spriteScanline[sprite_count], &OAM[nOAMEntry * 4],
+               sizeof(sObjectAttributeEntry));
+        sprite_count++;
       }
     }
-  };
+    nOAMEntry++;
+  }
+  status.sprite_overflow = (sprite_count > 8);
+}
 
-  auto TransferAddressX = [&]() {
-    if (mask.render_background || mask.render_sprites) {
-      vram_addr.nametable_x = tram_addr.nametable_x;
-      vram_addr.coarse_x = tram_addr.coarse_x;
-    }
-  };
+void PPU2C02::clock() {
+  CatchUp();
 
-  auto TransferAddressY = [&]() {
-    if (mask.render_background || mask.render_sprites) {
-      vram_addr.fine_y = tram_addr.fine_y;
-      vram_addr.nametable_y = tram_addr.nametable_y;
-      vram_addr.coarse_y = tram_addr.coarse_y;
-    }
-  };
+  // Without skipping, idle dots still take the catch-up path one at a time,
+  // so both modes produce the same state
+  if (bIdleDot) {
+    nIdleRun = 1;
+    SkipIdleDots();
+    bIdleDot = IdleRunLength() > 0;
+    return;
+  }
 
   auto LoadBackgroundShifters = [&]() {
     bg_shifter_pattern_lo = (bg_shifter_pattern_lo & 0xFF00) | bg_next_tile_lsb;
@@ -371,31 +818,24 @@ void PPU2C02::clock() {
       bg_shifter_attrib_lo <<= 1;
       bg_shifter_attrib_hi <<= 1;
     }
-    if (mask.render_sprites && cycle >= 1 && cycle < 258) {
-      for (int i = 0; i < sprite_count; i++) {
-        if (spriteScanline[i].x > 0) {
-          spriteScanline[i].x--;
-        } else {
-          sprite_shifter_pattern_lo[i] <<= 1;
-          sprite_shifter_pattern_hi[i] <<= 1;
-        }
-      }
-    }
   };
 
+  if (scanline == 0 && cycle == 0) {
+    cycle = 1;
+  }
+
+  // Mapper IRQ counters (MMC3, MMC5) watch the PPU bus
+  if (nObserve)
+    ObserveFetch();
+
   if (scanline >= -1 && scanline < 240) {
-    if (scanline == 0 && cycle == 0) {
-      cycle = 1;
-    }
+    if (bLineMode && scanline >= 0 && cycle == 1)
+      BeginLine();
 
     if (scanline == -1 && cycle == 1) {
       status.vertical_blank = 0;
       status.sprite_zero_hit = 0;
       status.sprite_overflow = 0;
-      for (int i = 0; i < 8; i++) {
-        sprite_shifter_pattern_lo[i] = 0;
-        sprite_shifter_pattern_hi[i] = 0;
-      }
     }
 
     if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338)) {
@@ -404,6 +844,13 @@ void PPU2C02::clock() {
       switch ((cycle - 1) % 8) {
       case 0:
         LoadBackgroundShifters();
+        if (bLineMode) {
+          // Tiles 0 and 1 of a line are prefetched at 329/337 of the last
+          int16_t tile = cycle >= 321 ? (cycle - 329) / 8 : (cycle - 1) / 8 + 1;
+          if (tile >= 0)
+            PPUCompositor::ExpandTile(bg_next_tile_lsb, bg_next_tile_msb,
+                                      bg_next_tile_attrib, &bgLine[tile * 8]);
+        }
         bg_next_tile_id = ppuRead(0x2000 | (vram_addr.reg & 0x0FFF));
         break;
       case 2:
@@ -442,24 +889,6 @@ void PPU2C02::clock() {
       TransferAddressX();
     }
 
-    // MMC3 scanline counter - clocked when A12 rises from 0 to 1
-    // MUST include pre-render scanline (-1) for correct counter behavior!
-    if (scanline >= -1 && scanline < 240 &&
-        (mask.render_background || mask.render_sprites)) {
-
-      // Determine clock cycle based on pattern table configuration
-      int clockCycle = 260; // Default for standard setup
-
-      // If BG is at $1000 (A12 high during BG fetch), use later cycle
-      if (control.pattern_background == 1) {
-        clockCycle = 324;
-      }
-
-      if (cycle == clockCycle) {
-        cart->Scanline();
-      }
-    }
-
     if (cycle == 338 || cycle == 340) {
       bg_next_tile_id = ppuRead(0x2000 | (vram_addr.reg & 0x0FFF));
     }
@@ -469,37 +898,15 @@ void PPU2C02::clock() {
     }
 
     // Sprite evaluation
-    if (cycle == 257 && scanline >= 0) {
-      memset(spriteScanline, 0xFF, 8 * sizeof(sObjectAttributeEntry));
-      sprite_count = 0;
-
-      for (int i = 0; i < 8; i++) {
-        sprite_shifter_pattern_lo[i] = 0;
-        sprite_shifter_pattern_hi[i] = 0;
-      }
-
-      uint8_t nOAMEntry = 0;
-      bSpriteZeroHitPossible = false;
-
-      while (nOAMEntry < 64 && sprite_count < 9) {
-        int16_t diff = ((int16_t)scanline - (int16_t)OAM[nOAMEntry * 4 + 0]);
-        if (diff >= 0 && diff < (control.sprite_size ? 16 : 8)) {
-          if (sprite_count < 8) {
-            if (nOAMEntry == 0) {
-              bSpriteZeroHitPossible = true;
-            }
-            memcpy(&spriteScanline[sprite_count], &OAM[nOAMEntry * 4],
-                   sizeof(sObjectAttributeEntry));
-            sprite_count++;
-          }
-        }
-        nOAMEntry++;
-      }
-      status.sprite_overflow = (sprite_count > 8);
-    }
+    if (cycle == 257 && scanline >= 0)
+      EvaluateSprites(scanline);
 
     if (cycle == 340) {
-      for (uint8_t i = 0; i < sprite_count; i++) {
+      // Draw the next line's sprites into spriteLine. The pre-render line
+      // fetches no sprites for line 0.
+      memset(spriteLine, 0, sizeof(spriteLine));
+      nZeroX = nZeroEnd = 0;
+      for (uint8_t i = 0; scanline >= 0 && i < sprite_count; i++) {
         uint8_t sprite_pattern_bits_lo, sprite_pattern_bits_hi;
         uint16_t sprite_pattern_addr_lo, sprite_pattern_addr_hi;
 
@@ -558,9 +965,23 @@ void PPU2C02::clock() {
           sprite_pattern_bits_hi = flipbyte(sprite_pattern_bits_hi);
         }
 
-        sprite_shifter_pattern_lo[i] = sprite_pattern_bits_lo;
-        sprite_shifter_pattern_hi[i] = sprite_pattern_bits_hi;
+        uint8_t flags = (spriteScanline[i].attribute & 0x20)
+                            ? PPUCompositor::SPRITE_BEHIND
+                            : 0;
+        if (i == 0 && bSpriteZeroHitPossible) {
+          flags |= PPUCompositor::SPRITE_ZERO;
+          // Hits only count from x = 8
+          nZeroX = std::max<int16_t>(spriteScanline[0].x, 8);
+          nZeroEnd = std::min<int16_t>(spriteScanline[0].x + 8, 256);
+        }
+        PPUCompositor::DrawSprite(spriteLine, spriteScanline[i].x,
+                                  sprite_pattern_bits_lo,
+                                  sprite_pattern_bits_hi,
+                                  (spriteScanline[i].attribute & 0x03) + 0x04,
+                                  flags);
       }
+      for (int x = 0; x < 8; x++)
+        spriteLine[x] &= ~PPUCompositor::SPRITE_ZERO;
     }
   }
 
@@ -577,6 +998,44 @@ void PPU2C02::clock() {
   }
 
   // Compose pixel
+  if (bLineActive) {
+#ifdef MGK_PPU_VERIFY
+    bool bHit;
+    verifyLine[cycle - 1] = ComposeDot(bHit);
+    if (bHit && nVerifyHit < 0)
+      nVerifyHit = cycle - 1;
+#endif
+    if (cycle == nLineFlush)
+      ComposeSpan(cycle);
+  } else {
+    bool bHit;
+    uint8_t index = ComposeDot(bHit);
+    if (bHit)
+      status.sprite_zero_hit = 1;
+    if (scanline >= 0 && scanline < 240 && cycle >= 1 && cycle <= 256)
+      OutputSpan(scanline, cycle - 1, cycle, &index);
+  }
+
+  cycle++;
+  if (cycle >= 341) {
+    cycle = 0;
+    scanline++;
+    if (scanline >= 261) {
+      scanline = -1;
+      frame_complete = true;
+      nFrameCount++;
+    }
+  }
+
+  nIdleDots = nIdleRun = IdleRunLength();
+  if (!bIdleSkip) {
+    bIdleDot = nIdleRun > 0;
+    nIdleDots = nIdleRun = 0;
+  }
+}
+
+uint8_t PPU2C02::ComposeDot(bool &bHit) {
+  bHit = false;
   uint8_t bg_pixel = 0x00;
   uint8_t bg_palette = 0x00;
 
@@ -595,26 +1054,15 @@ void PPU2C02::clock() {
   uint8_t fg_palette = 0x00;
   uint8_t fg_priority = 0x00;
 
-  if (mask.render_sprites) {
-    bSpriteZeroBeingRendered = false;
-
-    for (uint8_t i = 0; i < sprite_count; i++) {
-      if (spriteScanline[i].x == 0) {
-        uint8_t fg_pixel_lo = (sprite_shifter_pattern_lo[i] & 0x80) > 0;
-        uint8_t fg_pixel_hi = (sprite_shifter_pattern_hi[i] & 0x80) > 0;
-        fg_pixel = (fg_pixel_hi << 1) | fg_pixel_lo;
-
-        fg_palette = (spriteScanline[i].attribute & 0x03) + 0x04;
-        fg_priority = (spriteScanline[i].attribute & 0x20) == 0;
+  bool bSpriteZero = false;
 
-        if (fg_pixel != 0) {
-          if (i == 0) {
-            bSpriteZeroBeingRendered = true;
-          }
-          break;
-        }
-      }
-    }
+  if (mask.render_sprites && scanline >= 0 && scanline < 240 && cycle >= 1 &&
+      cycle <= 256) {
+    uint8_t sprite = spriteLine[cycle - 1];
+    fg_pixel = sprite & 0x03;
+    fg_palette = (sprite >> 2) & 0x07;
+    fg_priority = !(sprite & PPUCompositor::SPRITE_BEHIND);
+    bSpriteZero = (sprite & PPUCompositor::SPRITE_ZERO) != 0;
   }
 
   uint8_t pixel = 0x00;
@@ -638,22 +1086,22 @@ void PPU2C02::clock() {
       palette = bg_palette;
     }
 
-    if (bSpriteZeroHitPossible && bSpriteZeroBeingRendered) {
+    if (bSpriteZero) {
       if (mask.render_background & mask.render_sprites) {
         if (~(mask.render_background_left | mask.render_sprites_left)) {
           if (cycle >= 9 && cycle < 258) {
-            status.sprite_zero_hit = 1;
+            bHit = true;
           }
         } else {
           if (cycle >= 1 && cycle < 258) {
-            status.sprite_zero_hit = 1;
+            bHit = true;
           }
         }
       }
     }
   }
 
-  if (scanline >= 0 && scanline < 240 && cycle >= 1 && cycle <= 256) {
+  if (cycle >= 1 && cycle <= 256) {
     // Edge clipping - hide leftmost and rightmost 8 pixels to simulate TV
     // overscan and hide scrolling artifacts common in NES games (like SMB3/FF1)
     if (cycle <= 8 || cycle >= 249) {
@@ -676,18 +1124,86 @@ void PPU2C02::clock() {
         palette = 0;
       }
     }
+  }
+
+  return (palette << 2) | pixel;
+}
+
+void PPU2C02::BeginLine() {
+  // Spans assume the render enables have not changed since this line's
+  // prefetch began at dot 321 of the line before
+  bLineActive = (mask.render_background || mask.render_sprites) &&
+                DotStamp() - nRenderStamp >= 21;
+  if (!bLineActive)
+    return;
+
+  nLineX = 0;
+  nLineFlush = NextSpriteZeroDot();
+
+#ifdef MGK_PPU_VERIFY
+  nVerifyHit = nLineHit = -1;
+#endif
+}
+
+int16_t PPU2C02::NextSpriteZeroDot() const {
+  // A span must end on any pixel that could set the sprite 0 hit flag, so
+  // the CPU sees it on the same dot as on the per-dot path
+  if (!status.sprite_zero_hit)
+    for (int16_t x = std::max(nLineX, nZeroX); x < nZeroEnd; x++)
+      if (spriteLine[x] & PPUCompositor::SPRITE_ZERO)
+        return x + 1;
+  return 256;
+}
+
+void PPU2C02::ComposeSpan(int16_t x1) {
+  static const uint8_t noBackground[sizeof(bgLine)] = {};
+  static const uint8_t noSprites[sizeof(spriteLine)] = {};
+
+  x1 = std::min<int16_t>(x1, 256);
+  if (x1 > nLineX) {
+    const uint8_t *bg =
+        (mask.render_background ? bgLine : noBackground) + fine_x;
+    const uint8_t *sprites = mask.render_sprites ? spriteLine : noSprites;
+    int hit = PPUCompositor::MergeLine(bg, sprites, lineOut, nLineX, x1);
+    if (hit >= 0) {
+      status.sprite_zero_hit = 1;
+#ifdef MGK_PPU_VERIFY
+      if (nLineHit < 0)
+        nLineHit = hit;
+#endif
+    }
 
-    screen[scanline * 256 + (cycle - 1)] =
-        GetColorFromPaletteRam(palette, pixel);
+    // Edge clipping, as on the per-dot path
+    for (int16_t x = nLineX; x < x1; x++)
+      if (x < 8 || x >= 248)
+        lineOut[x] = 0;
+
+    OutputSpan(scanline, nLineX, x1, &lineOut[nLineX]);
+    nLineX = x1;
   }
 
-  cycle++;
-  if (cycle >= 341) {
-    cycle = 0;
-    scanline++;
-    if (scanline >= 261) {
-      scanline = -1;
-      frame_complete = true;
+  if (nLineX == 256)
+    EndLine();
+  else
+    nLineFlush = NextSpriteZeroDot();
+}
+
+void PPU2C02::EndLine() {
+  bLineActive = false;
+
+#ifdef MGK_PPU_VERIFY
+  // Check the composed pixels against the per-dot path
+  for (int16_t x = 0; x < nLineX; x++) {
+    if (lineOut[x] != verifyLine[x]) {
+      fprintf(stderr, "PPU verify: frame %llu line %d x %d: %02X, dot %02X\n",
+              (unsigned long long)nFrameCount, scanline, x, lineOut[x],
+              verifyLine[x]);
+      break;
     }
   }
+  int16_t nDotHit = nVerifyHit < nLineX ? nVerifyHit : -1;
+  if (nDotHit != nLineHit)
+    fprintf(stderr, "PPU verify: frame %llu line %d: hit x %d, dot %d\n",
+            (unsigned long long)nFrameCount, scanline, nLineHit, nDotHit);
+#endif
 }
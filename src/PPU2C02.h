@@ -2,7 +2,9 @@
 #include "Cartridge.h"
 #include <cstdint>
 #include <memory>
+#include <vector>
 
+class PPUThread;
 
 // Forward declaration for SDL types (we'll use raw pixel buffer)
 struct Pixel {
@@ -27,11 +29,65 @@ public:
   void clock();
   void reset();
 
+  // Save or load registers, VRAM, OAM and the position in the frame (see
+  // SaveState.h). Not while a render thread is attached.
+  void State(SaveState &s);
+
   bool nmi = false;
   bool frame_complete = false;
 
-  // Frame buffer (256x240)
-  Pixel screen[256 * 240];
+  // Dots the bus may skip instead of calling clock(). Set while nothing
+  // observable happens (vblank, or rendering disabled) until the next event;
+  // the PPU catches up in bulk when it is clocked or its registers are used.
+  uint32_t nIdleDots = 0;
+  // Clearing this has the bus clock every dot, for reference runs
+  bool bIdleSkip = true;
+
+  // Line mode: visible lines are composed a span at a time from per-line
+  // background and sprite buffers instead of pixel by pixel. Spans end at
+  // register writes and possible sprite 0 hits, so the output matches the
+  // per-dot path exactly. Fetches still run per dot.
+  bool bLineMode = true;
+
+  // Hardware shows at most 8 sprites per line. Clearing this draws every
+  // sprite on the line, which removes the flicker games use to work around
+  // the limit.
+  bool bSpriteLimit = true;
+
+  // Dots before NMI can be raised: a lower bound, 0 if one is pending and
+  // UINT32_MAX while NMIs are disabled
+  uint32_t DotsUntilNMI();
+
+  // Dots before sprite evaluation next reads OAM, UINT32_MAX while
+  // rendering is disabled
+  uint32_t DotsUntilOAMRead();
+
+  // Current position (pre-render line reported as 261, as in nestest.log)
+  int16_t GetScanline() {
+    CatchUp();
+    return scanline < 0 ? 261 : scanline;
+  }
+  int16_t GetCycle() {
+    CatchUp();
+    return cycle;
+  }
+
+  // Frame buffer (256x240), released while another output is set
+  std::vector<Pixel> screen;
+
+  // Where pixels are written, screen unless the frontend points it at its
+  // own 256x240 buffer (a locked texture) for the frames it runs
+  Pixel *pScreen = nullptr;
+
+  // Frame output. OUTPUT_RGBA at scale 1 is pScreen above. The byte formats
+  // write the NES colour (0-63) or its luma. Scales 2 and 4 give a frame of
+  // 256/scale x 240/scale pixels, each the average of a block (index frames
+  // take the block's top-left pixel). Pixels are converted as they are
+  // drawn, so a full RGBA frame only exists when one is asked for. A null
+  // buffer is one the PPU allocates.
+  enum OUTPUT : uint8_t { OUTPUT_RGBA, OUTPUT_INDEX, OUTPUT_GRAY };
+  void SetOutput(OUTPUT format, uint8_t scale, void *pBuffer);
+  void *OutputBuffer() const;
 
   // Get color from palette
   Pixel &GetColorFromPaletteRam(uint8_t palette, uint8_t pixel);
@@ -40,6 +96,10 @@ public:
   uint8_t OAM[256];
   uint8_t oam_addr = 0x00;
 
+  // OAM DMA from the bus, a byte or the whole page at a time
+  void DMAWrite(uint8_t addr, uint8_t data);
+  void DMAPage(const uint8_t *src);
+
 private:
   std::shared_ptr<Cartridge> cart;
 
@@ -47,8 +107,97 @@ private:
   uint8_t tblName[2][1024];
   uint8_t tblPalette[32];
 
+  // 1KB host pages for $0000-$3EFF: pattern tables from the mapper's CHR
+  // slots, then nametables (and their $3000 mirror) from CIRAM or the
+  // mapper. nullptr pages are read through the cartridge hook.
+  uint8_t *pPage[16] = {};
+  // Nametable pages for writes, which differ for mapper fill modes
+  uint8_t *pNTWrite[4] = {};
+  void UpdatePageTable();
+  void UpdateNametablePages();
+
+  // Palette RAM index for $3F00-$3F1F
+  static const uint8_t paletteMirror[32];
+
+  // Mapper bus observers (PPU_OBSERVE_* flags the cartridge asked for).
+  // Events follow the hardware fetch schedule rather than the order this
+  // PPU performs its reads in.
+  uint8_t nObserve = 0;
+  bool bA12 = false;        // A12 as last driven on the PPU bus
+  bool bFetching = false;   // Rendering fetches active
+  uint64_t nFrameCount = 0; // Frames since power on, for dot stamps
+  uint64_t nA12FallDot = 0; // Dot stamp of the last A12 1 -> 0 edge
+  uint64_t DotStamp() const {
+    return nFrameCount * 341 * 262 + (scanline + 1) * 341 + cycle;
+  }
+  void ObserveA12(uint16_t addr);
+  void ObserveFetch();
+
+  // Idle fast path
+  uint32_t nIdleRun = 0; // Length of the current idle run
+  bool bIdleDot = false; // Next dot is idle (bIdleSkip clear)
+  uint32_t IdleRunLength();
+  void CatchUp() {
+    if (nIdleRun != nIdleDots)
+      SkipIdleDots();
+  }
+  void SkipIdleDots();
+  void EndIdleRun();
+
+  // Render thread this PPU journals its inputs to (see PPUThread.h). The
+  // replica there draws the pixels, so rendered dots are skipped like idle
+  // ones, except around lines where sprite 0 may hit: only what the CPU can
+  // see (scroll address, sprite evaluation, status) is kept up to date.
+  PPUThread *pThread = nullptr;
+  friend class PPUThread;
+  int32_t SpriteZeroStop() const;
+  void SkipRenderedDots(int32_t dot, int32_t end);
+
+  // Line mode state. bgLine holds the line's fetched tiles 8 pixels each,
+  // starting with the two prefetched on the previous line.
+  bool bLineActive = false;  // This line is composed in spans
+  int16_t nLineX = 0;        // First pixel not yet composed
+  int16_t nLineFlush = 0;    // Dot at which the next span is composed
+  uint64_t nRenderStamp = 0; // Dot stamp of the last render enable change
+  uint8_t bgLine[34 * 8];
+  uint8_t lineOut[256];
+  void BeginLine();
+  void ComposeSpan(int16_t x1);
+  void EndLine();
+  int16_t NextSpriteZeroDot() const;
+#ifdef MGK_PPU_VERIFY
+  uint8_t verifyLine[256];
+  int16_t nVerifyHit = -1, nLineHit = -1;
+  void VerifyLine();
+#endif
+
+  // Scroll address updates made while rendering
+  void IncrementScrollX();
+  void IncrementScrollY();
+  void TransferAddressX();
+  void TransferAddressY();
+
+  // Fill spriteScanline with the sprites on the line after this one
+  void EvaluateSprites(int16_t line);
+
+  // Per-dot compositor: palette RAM index of the pixel at this dot, and
+  // whether it is a sprite 0 hit
+  uint8_t ComposeDot(bool &bHit);
+
   // NES Color Palette (64 colors)
   Pixel palScreen[0x40];
+  uint8_t palLuma[0x40];
+
+  // Output of pixels [x0, x1) of a visible line, from their palette RAM
+  // indices (src[0] is pixel x0)
+  void OutputSpan(int16_t line, int16_t x0, int16_t x1, const uint8_t *src);
+  void OutputPooledRow(int16_t row);
+  OUTPUT nOutput = OUTPUT_RGBA;
+  uint8_t nOutputShift = 0; // log2 of the scale
+  uint8_t *pOutput = nullptr;
+  std::vector<uint8_t> vOutput; // pOutput when the caller gives no buffer
+  // Channel sums of the output row being pooled, 3 per pixel for RGBA
+  uint16_t poolSum[128 * 3];
 
 private: // Registers
   union {
@@ -131,10 +280,14 @@ private: // Registers
   } OAM_entry[64];
 
   uint8_t sprite_count = 0;
-  sObjectAttributeEntry spriteScanline[8];
-  uint8_t sprite_shifter_pattern_lo[8];
-  uint8_t sprite_shifter_pattern_hi[8];
+  sObjectAttributeEntry spriteScanline[64];
 
   bool bSpriteZeroHitPossible = false;
-  bool bSpriteZeroBeingRendered = false;
+
+  // Sprite pixels of the next line (PPUCompositor format), drawn when its
+  // sprites are fetched at dot 340. Pixels [nZeroX, nZeroEnd) may hold
+  // sprite 0.
+  uint8_t spriteLine[256 + 8];
+  int16_t nZeroX = 0;
+  int16_t nZeroEnd = 0;
 };
@@ -0,0 +1,156 @@
+#include "PPUCompositor.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MGK_COMPOSITOR_SSE2
+#endif
+
+namespace PPUCompositor {
+
+// Byte i of kBitBytes[b] is bit (7 - i) of b, so a pattern byte expands to
+// its 8 pixels in screen order. Tiles and sprites are expanded 8 pixels at a
+// time in a uint64_t, with every byte one pixel.
+struct BitBytes {
+  uint8_t bytes[256][8];
+  BitBytes() {
+    for (int b = 0; b < 256; b++)
+      for (int i = 0; i < 8; i++)
+        bytes[b][i] = (b >> (7 - i)) & 0x01;
+  }
+};
+static const BitBytes kBitBytes;
+
+static const uint64_t kLowBits = 0x0101010101010101ULL;
+
+static uint64_t ExpandPixels(uint8_t lsb, uint8_t msb) {
+  uint64_t lo, hi;
+  memcpy(&lo, kBitBytes.bytes[lsb], 8);
+  memcpy(&hi, kBitBytes.bytes[msb], 8);
+  return lo | (hi << 1);
+}
+
+// 0x01 in every byte holding a non-zero 2 bit pixel
+static uint64_t OpaqueBytes(uint64_t pixels) {
+  return (pixels | (pixels >> 1)) & kLowBits;
+}
+
+void ExpandTile(uint8_t lsb, uint8_t msb, uint8_t attrib, uint8_t *out) {
+  uint64_t pixels = ExpandPixels(lsb, msb);
+  pixels |= OpaqueBytes(pixels) * (uint64_t)((attrib & 0x03) << 2);
+  memcpy(out, &pixels, 8);
+}
+
+void DrawSprite(uint8_t *line, int x, uint8_t lsb, uint8_t msb,
+                uint8_t palette, uint8_t flags) {
+  uint64_t pixels = ExpandPixels(lsb, msb);
+  uint64_t row;
+  memcpy(&row, line + x, 8);
+
+  // Opaque sprite pixels always have bit 4 set (palettes 4-7), so that bit
+  // marks the pixels an earlier sprite has already taken
+  uint64_t take = OpaqueBytes(pixels) & ~(row >> 4) & kLowBits;
+  row |= (pixels & (take * 0x03)) |
+         take * (uint64_t)(((palette & 0x07) << 2) | flags);
+  memcpy(line + x, &row, 8);
+}
+
+static int MergeScalar(const uint8_t *bg, const uint8_t *sprites,
+                       uint8_t *out, int x0, int x1) {
+  int hit = -1;
+  for (int x = x0; x < x1; x++) {
+    uint8_t b = bg[x], s = sprites[x];
+    bool bBackground = (b & 0x03) != 0;
+    bool bSprite = (s & 0x03) != 0;
+    if (bSprite && (!bBackground || !(s & SPRITE_BEHIND)))
+      out[x] = s & 0x1F;
+    else
+      out[x] = b;
+    if (hit < 0 && bBackground && bSprite && (s & SPRITE_ZERO))
+      hit = x;
+  }
+  return hit;
+}
+
+int MergeLine(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, int x0,
+              int x1) {
+  int hit = -1;
+  int x = x0;
+
+#if defined(__AVX2__)
+  const __m256i pixelBits = _mm256_set1_epi8(0x03);
+  const __m256i indexBits = _mm256_set1_epi8(0x1F);
+  const __m256i behindBit = _mm256_set1_epi8(SPRITE_BEHIND);
+  const __m256i zeroBit = _mm256_set1_epi8(SPRITE_ZERO);
+  const __m256i none = _mm256_setzero_si256();
+  for (; x + 32 <= x1; x += 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)(bg + x));
+    __m256i s = _mm256_loadu_si256((const __m256i *)(sprites + x));
+    __m256i bgClear =
+        _mm256_cmpeq_epi8(_mm256_and_si256(b, pixelBits), none);
+    __m256i spClear =
+        _mm256_cmpeq_epi8(_mm256_and_si256(s, pixelBits), none);
+    __m256i front = _mm256_cmpeq_epi8(_mm256_and_si256(s, behindBit), none);
+    __m256i useSprite =
+        _mm256_andnot_si256(spClear, _mm256_or_si256(bgClear, front));
+    __m256i pixel = _mm256_or_si256(
+        _mm256_and_si256(useSprite, _mm256_and_si256(s, indexBits)),
+        _mm256_andnot_si256(useSprite, b));
+    _mm256_storeu_si256((__m256i *)(out + x), pixel);
+
+    if (hit < 0) {
+      __m256i zero = _mm256_cmpeq_epi8(_mm256_and_si256(s, zeroBit), zeroBit);
+      __m256i overlap =
+          _mm256_andnot_si256(_mm256_or_si256(bgClear, spClear), zero);
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(overlap);
+      if (mask) {
+        hit = x;
+        while (!(mask & 1)) {
+          mask >>= 1;
+          hit++;
+        }
+      }
+    }
+  }
+#elif defined(MGK_COMPOSITOR_SSE2)
+  const __m128i pixelBits = _mm_set1_epi8(0x03);
+  const __m128i indexBits = _mm_set1_epi8(0x1F);
+  const __m128i behindBit = _mm_set1_epi8(SPRITE_BEHIND);
+  const __m128i zeroBit = _mm_set1_epi8(SPRITE_ZERO);
+  const __m128i none = _mm_setzero_si128();
+  for (; x + 16 <= x1; x += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(bg + x));
+    __m128i s = _mm_loadu_si128((const __m128i *)(sprites + x));
+    __m128i bgClear = _mm_cmpeq_epi8(_mm_and_si128(b, pixelBits), none);
+    __m128i spClear = _mm_cmpeq_epi8(_mm_and_si128(s, pixelBits), none);
+    __m128i front = _mm_cmpeq_epi8(_mm_and_si128(s, behindBit), none);
+    __m128i useSprite = _mm_andnot_si128(spClear, _mm_or_si128(bgClear, front));
+    __m128i pixel =
+        _mm_or_si128(_mm_and_si128(useSprite, _mm_and_si128(s, indexBits)),
+                     _mm_andnot_si128(useSprite, b));
+    _mm_storeu_si128((__m128i *)(out + x), pixel);
+
+    if (hit < 0) {
+      __m128i zero = _mm_cmpeq_epi8(_mm_and_si128(s, zeroBit), zeroBit);
+      __m128i overlap = _mm_andnot_si128(_mm_or_si128(bgClear, spClear), zero);
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(overlap);
+      if (mask) {
+        hit = x;
+        while (!(mask & 1)) {
+          mask >>= 1;
+          hit++;
+        }
+      }
+    }
+  }
+#endif
+
+  // Scalar build, or the tail of a span
+  int tailHit = MergeScalar(bg, sprites, out, x, x1);
+  return hit >= 0 ? hit : tailHit;
+}
+
+} // namespace PPUCompositor
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+// Scanline compositor used by PPU2C02's line mode.
+//
+// Line buffers hold palette RAM indices, one byte per pixel: palette << 2 |
+// pixel, or 0 where the pixel is transparent. Sprite lines use palettes 4-7
+// and carry the flags below in the upper bits.
+namespace PPUCompositor {
+
+const uint8_t SPRITE_BEHIND = 0x20; // Sprite is behind the background
+const uint8_t SPRITE_ZERO = 0x40;   // Pixel belongs to OAM entry 0
+
+// Expand one fetched background tile row to 8 pixels
+void ExpandTile(uint8_t lsb, uint8_t msb, uint8_t attrib, uint8_t *out);
+
+// Draw an 8 pixel sprite row at x into a sprite line. Pixels already taken
+// by an earlier (higher priority) sprite are kept. flags holds the
+// SPRITE_* bits to attach. The line must be at least x + 8 bytes long.
+void DrawSprite(uint8_t *line, int x, uint8_t lsb, uint8_t msb,
+                uint8_t palette, uint8_t flags);
+
+// Merge background and sprite pixels [x0, x1) into out by sprite priority.
+// Returns the first x in the span where an opaque SPRITE_ZERO pixel meets an
+// opaque background pixel, or -1.
+int MergeLine(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, int x0,
+              int x1);
+
+} // namespace PPUCompositor
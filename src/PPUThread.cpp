@@ -0,0 +1,172 @@
+#include "PPUThread.h"
+#include <algorithm>
+#include <cstring>
+
+PPUThread::PPUThread(PPU2C02 &ppu, Cartridge &cart) : ppu(ppu) {
+  const std::vector<uint8_t> &chr = cart.GetCHRMemory();
+  pCHR = chr.data();
+  nCHR = chr.size();
+
+  // Every page has to be plain memory the replica can have a copy of
+  const uint8_t *ciram = &ppu.tblName[0][0];
+  bActive = !ppu.nObserve && !cart.HasCustomPPU() && !ppu.pThread &&
+            !ppu.pOutput;
+  for (int i = 0; i < 8 && bActive; i++)
+    bActive = ppu.pPage[i] && ppu.pPage[i] >= pCHR &&
+              ppu.pPage[i] + 0x400 <= pCHR + nCHR;
+  for (int i = 0; i < 4 && bActive; i++)
+    bActive = ppu.pPage[8 + i] == ppu.pNTWrite[i] &&
+              ppu.pPage[8 + i] >= ciram &&
+              ppu.pPage[8 + i] + 0x400 <= ciram + sizeof(ppu.tblName);
+  if (!bActive)
+    return;
+
+  ppu.EndIdleRun();
+  replica = std::make_unique<PPU2C02>(ppu);
+  replica->cart.reset();
+  vCHR.assign(chr.begin(), chr.end());
+  SetPages(CurrentPages());
+  for (std::vector<Pixel> &frame : vFrames)
+    frame = ppu.screen;
+
+  ppu.pThread = this;
+  worker = std::thread(&PPUThread::Run, this);
+}
+
+PPUThread::~PPUThread() {
+  if (!bActive)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bQuit = true;
+  }
+  ready.notify_all();
+  worker.join();
+
+  // Back to drawing on this thread, from the next dot on
+  ppu.EndIdleRun();
+  ppu.pThread = nullptr;
+}
+
+Pixel *PPUThread::Submit() {
+  uint64_t nEnd = Stamp();
+  std::unique_lock<std::mutex> lock(mutex);
+  ready.wait(lock, [this] { return !bBusy; });
+
+  std::swap(job, journal);
+  journal.vEntries.clear();
+  journal.vOAM.clear();
+  journal.vPages.clear();
+  job.nEnd = nEnd;
+  job.pFrame = vFrames[nFrame].data();
+  nFrame ^= 1;
+  bBusy = true;
+  ready.notify_all();
+  return vFrames[nFrame].data();
+}
+
+uint64_t PPUThread::Stamp() {
+  ppu.CatchUp();
+  return ppu.DotStamp();
+}
+
+void PPUThread::Log(uint8_t nKind, uint16_t addr, uint32_t nData) {
+  journal.vEntries.push_back({Stamp(), nData, addr, nKind});
+}
+
+void PPUThread::OAMPage(const uint8_t *src) {
+  journal.vOAM.emplace_back();
+  memcpy(journal.vOAM.back().data(), src, 256);
+  Log(OAM_PAGE, 0, (uint32_t)journal.vOAM.size() - 1);
+}
+
+void PPUThread::CHRWritten(uint16_t addr) {
+  // Whatever the mapper made of the write, the replica gets the same byte
+  Log(CHR, addr, ppu.pPage[addr >> 10][addr & 0x03FF]);
+}
+
+void PPUThread::PagesChanged() {
+  journal.vPages.push_back(CurrentPages());
+  Log(PAGES, 0, (uint32_t)journal.vPages.size() - 1);
+}
+
+PPUThread::PAGE_TABLE PPUThread::CurrentPages() const {
+  PAGE_TABLE p;
+  for (int i = 0; i < 8; i++)
+    p.chr[i] = (uint32_t)(ppu.pPage[i] - pCHR);
+  for (int i = 0; i < 4; i++)
+    p.nt[i] = (uint16_t)(ppu.pPage[8 + i] - &ppu.tblName[0][0]);
+  return p;
+}
+
+void PPUThread::SetPages(const PAGE_TABLE &p) {
+  PPU2C02 &r = *replica;
+  for (int i = 0; i < 8; i++)
+    r.pPage[i] = vCHR.data() + p.chr[i];
+  for (int i = 0; i < 4; i++) {
+    r.pPage[8 + i] = &r.tblName[0][0] + p.nt[i];
+    r.pPage[12 + i] = r.pPage[8 + i];
+    r.pNTWrite[i] = r.pPage[8 + i];
+  }
+}
+
+void PPUThread::Advance(uint64_t nStamp) {
+  // As the bus clocks it, skipping idle runs
+  PPU2C02 &r = *replica;
+  for (;;) {
+    r.CatchUp();
+    uint64_t nNow = r.DotStamp();
+    if (nNow >= nStamp)
+      break;
+    if (r.nIdleDots > 0)
+      r.nIdleDots -= (uint32_t)std::min<uint64_t>(r.nIdleDots, nStamp - nNow);
+    else
+      r.clock();
+  }
+}
+
+void PPUThread::Replay() {
+  PPU2C02 &r = *replica;
+  r.pScreen = job.pFrame;
+  for (const ENTRY &e : job.vEntries) {
+    Advance(e.nStamp);
+    switch (e.nKind) {
+    case WRITE:
+      r.cpuWrite(e.addr, (uint8_t)e.nData);
+      break;
+    case READ:
+      r.cpuRead(e.addr);
+      break;
+    case OAM_BYTE:
+      r.OAM[e.addr] = (uint8_t)e.nData;
+      break;
+    case OAM_PAGE:
+      memcpy(r.OAM, job.vOAM[e.nData].data(), sizeof(r.OAM));
+      break;
+    case CHR:
+      r.pPage[e.addr >> 10][e.addr & 0x03FF] = (uint8_t)e.nData;
+      break;
+    case PAGES:
+      SetPages(job.vPages[e.nData]);
+      break;
+    case RESET:
+      r.reset();
+      break;
+    }
+  }
+  Advance(job.nEnd);
+}
+
+void PPUThread::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    ready.wait(lock, [this] { return bBusy || bQuit; });
+    if (!bBusy)
+      return;
+    lock.unlock();
+    Replay();
+    lock.lock();
+    bBusy = false;
+    ready.notify_all();
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "PPU2C02.h"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Frames drawn on a second thread (experimental).
+//
+// The CPU only sees a few PPU outputs: the status flags, NMI and what $2007
+// reads return. While a PPUThread is attached, the PPU journals every input
+// that changes its state, stamped with the dot it arrived on: register reads
+// and writes, OAM DMA, CHR RAM bytes and bank switches. A replica PPU on the
+// render thread replays the journal of one frame, drawing its pixels, while
+// the CPU thread runs the next frame with a PPU that skips rendered dots
+// except around sprite 0 (see PPU2C02::pThread).
+//
+// Only mappers that neither watch the PPU bus nor supply nametables of their
+// own can be replayed, and only into full RGBA frames. For others Active()
+// is false and the PPU keeps drawing as before.
+class PPUThread {
+public:
+  PPUThread(PPU2C02 &ppu, Cartridge &cart);
+  ~PPUThread();
+
+  bool Active() const { return bActive; }
+
+  // Hand the frame the PPU just completed to the render thread and return
+  // the one before it, once drawn. The buffer stays valid until the next
+  // call.
+  Pixel *Submit();
+
+  // Journal, filled by the PPU
+  void Write(uint8_t addr, uint8_t data) { Log(WRITE, addr, data); }
+  void Read(uint8_t addr) { Log(READ, addr, 0); }
+  void OAMWrite(uint8_t addr, uint8_t data) { Log(OAM_BYTE, addr, data); }
+  void OAMPage(const uint8_t *src);
+  void CHRWritten(uint16_t addr);
+  void PagesChanged();
+  void Reset() { Log(RESET, 0, 0); }
+
+private:
+  PPU2C02 &ppu;
+  bool bActive = false;
+
+  enum KIND : uint8_t { WRITE, READ, OAM_BYTE, OAM_PAGE, CHR, PAGES, RESET };
+  struct ENTRY {
+    uint64_t nStamp; // PPU2C02::DotStamp() of the access
+    uint32_t nData;  // Byte, or index into the job's OAM pages or page tables
+    uint16_t addr;
+    uint8_t nKind;
+  };
+  // The PPU's page table as offsets, CHR pages into CHR memory and nametable
+  // pages into CIRAM
+  struct PAGE_TABLE {
+    uint32_t chr[8];
+    uint16_t nt[4];
+  };
+  struct JOB {
+    std::vector<ENTRY> vEntries;
+    std::vector<std::array<uint8_t, 256>> vOAM;
+    std::vector<PAGE_TABLE> vPages;
+    uint64_t nEnd = 0; // Stamp the frame ends on
+    Pixel *pFrame = nullptr;
+  };
+  JOB journal; // Filled on the CPU thread
+  JOB job;     // Replayed on the render thread
+
+  uint64_t Stamp();
+  void Log(uint8_t nKind, uint16_t addr, uint32_t nData);
+  PAGE_TABLE CurrentPages() const;
+
+  // CHR memory of the cartridge, for the offsets
+  const uint8_t *pCHR = nullptr;
+  size_t nCHR = 0;
+
+  // Render thread state: the replica with its own copy of CHR memory, and
+  // the two frame buffers it draws into in turn
+  std::unique_ptr<PPU2C02> replica;
+  std::vector<uint8_t> vCHR;
+  std::vector<Pixel> vFrames[2];
+  int nFrame = 0;
+  void SetPages(const PAGE_TABLE &p);
+  void Advance(uint64_t nStamp);
+  void Replay();
+  void Run();
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool bBusy = false; // A job is handed over and not done yet
+  bool bQuit = false;
+};
@@ -42,6 +42,7 @@ void Platform_CreateMenu(void *nativeWindowHandle) {
   HMENU hEmuMenu = CreatePopupMenu();
   AppendMenu(hEmuMenu, MF_STRING, ID_EMU_RESET, "Reset");
   AppendMenu(hEmuMenu, MF_STRING, ID_EMU_PAUSE, "Pause/Resume\tP");
+  AppendMenu(hEmuMenu, MF_STRING, ID_EMU_TURBO, "Fast Forward\t`");
   AppendMenu(hMenu, MF_POPUP, (UINT_PTR)hEmuMenu, "Emulation");
 
   // Scale Menu
@@ -6,10 +6,13 @@
 #define ID_FILE_EXIT 1002
 #define ID_EMU_RESET 2001
 #define ID_EMU_PAUSE 2002
+#define ID_EMU_TURBO 2003
 #define ID_SCALE_1X 3001
 #define ID_SCALE_2X 3002
 #define ID_SCALE_3X 3003
 #define ID_SCALE_4X 3004
+#define ID_DEBUG_TRACE 4001
+#define ID_DEBUG_PROFILE 4002
 
 // Cross-platform helper functions
 std::string Platform_OpenFileDialog();
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Machine state in a caller's buffer. Saving and loading take the same walk:
+// each device lists its fields once in its State() function, and they are
+// copied into or out of the buffer in that order. Bytes that do not fit are
+// only counted, so a walk over an empty buffer measures the state.
+class SaveState {
+public:
+  SaveState(void *pBuffer, size_t nSize, bool bLoading)
+      : p((uint8_t *)pBuffer), nSize(nSize), bLoading(bLoading) {}
+
+  bool Loading() const { return bLoading; }
+
+  // Bytes walked, whether or not they fit
+  size_t Size() const { return nPos; }
+
+  // The state is not for this machine; the walk stops
+  bool Failed() const { return bFailed; }
+  void Fail() { bFailed = true; }
+
+  // Every field fit and the state was for this machine
+  bool Good() const { return nPos <= nSize && !bFailed; }
+
+  void Bytes(void *pData, size_t n) {
+    if (nPos + n <= nSize) {
+      if (bLoading)
+        memcpy(pData, p + nPos, n);
+      else
+        memcpy(p + nPos, pData, n);
+    }
+    nPos += n;
+  }
+
+  template <class T> void Value(T &v) {
+    static_assert(std::is_trivially_copyable<T>::value, "plain data only");
+    Bytes(&v, sizeof(T));
+  }
+  // RAM, whose size is fixed by the cartridge
+  void Value(std::vector<uint8_t> &v) { Bytes(v.data(), v.size()); }
+
+  template <class... T> void Values(T &...v) { (Value(v), ...); }
+
+private:
+  uint8_t *p;
+  size_t nSize;
+  size_t nPos = 0;
+  bool bLoading;
+  bool bFailed = false;
+};
@@ -2,9 +2,12 @@
 #include "Cartridge.h"
 #include "Config.h"
 #include "Display.h"
+#include "PPUThread.h"
 #include "Platform.h"
 #include "include/SDL2/SDL.h"
+#include <algorithm>
 #include <atomic>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -42,6 +45,31 @@ void AudioCallback(void *userdata, Uint8 *stream, int len) {
   audioReadPos.store(readPos, std::memory_order_release);
 }
 
+// The core loads cartridges silently; the frontend reports the header on the
+// console and in nes_debug.log
+static void ReportCartridge(const Cartridge &cart) {
+  if (cart.GetPRGBanks() == 0)
+    return;
+  std::cout << "Mapper ID: " << (int)cart.GetMapperID() << std::endl;
+  std::cout << "PRG Banks: " << (int)cart.GetPRGBanks() << std::endl;
+  std::cout << "CHR Banks: " << (int)cart.GetCHRBanks() << std::endl;
+  std::cout << "Mirroring: "
+            << (cart.GetHeaderMirror() == MIRROR::VERTICAL ? "Vertical"
+                                                           : "Horizontal")
+            << std::endl;
+
+  std::ofstream debugLog("nes_debug.log", std::ios::app);
+  debugLog << "Loading ROM - Mapper: " << (int)cart.GetMapperID()
+           << ", PRG: " << (int)cart.GetPRGBanks()
+           << ", CHR: " << (int)cart.GetCHRBanks() << std::endl;
+  if (!cart.ImageValid()) {
+    std::cerr << "Unsupported Mapper: " << (int)cart.GetMapperID()
+              << std::endl;
+    debugLog << "UNSUPPORTED Mapper: " << (int)cart.GetMapperID()
+             << std::endl;
+  }
+}
+
 int main(int argc, char *argv[]) {
   Config config;
   config.Load("config.ini");
@@ -52,6 +80,8 @@ int main(int argc, char *argv[]) {
   }
 
   Bus nes;
+  nes.ppu.bSpriteLimit = !config.noSpriteLimit;
+  nes.cpu.bJit = config.jit;
   Display display;
 
   if (!display.Init("NES Emulator", 256, 240, config.windowScale)) {
@@ -89,16 +119,33 @@ int main(int argc, char *argv[]) {
   std::cout << "NES Emulator Started" << std::endl;
   std::cout << "Use File menu or press F1 to load a ROM" << std::endl;
   std::cout << "Press P to pause/resume" << std::endl;
+  std::cout << "Hold Tab to fast forward, ` to toggle it" << std::endl;
 
   bool running = true;
   bool romLoaded = false;
   bool paused = false;
 
+  // Render thread (ppu_thread=1), for cartridges it supports. Its frames
+  // arrive one late; the last one stays valid until the next is submitted.
+  std::unique_ptr<PPUThread> ppuThread;
+  Pixel *pThreadFrame = nullptr;
+  auto InsertCartridge = [&](const std::shared_ptr<Cartridge> &cart) {
+    ppuThread.reset();
+    nes.insertCartridge(cart);
+    nes.reset();
+    if (config.ppuThread) {
+      ppuThread = std::make_unique<PPUThread>(nes.ppu, *cart);
+      if (!ppuThread->Active())
+        ppuThread.reset();
+      pThreadFrame = nes.ppu.screen.data();
+    }
+  };
+
   if (!romPath.empty()) {
     std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(romPath);
+    ReportCartridge(*cart);
     if (cart->ImageValid()) {
-      nes.insertCartridge(cart);
-      nes.reset();
+      InsertCartridge(cart);
       romLoaded = true;
       std::cout << "Loaded: " << romPath << std::endl;
     } else {
@@ -121,9 +168,57 @@ int main(int argc, char *argv[]) {
   double lastSample = 0.0;
   const double FILTER_ALPHA = 0.4; // Simple low-pass filter coefficient
 
+  // Fast-forward state
+  bool turboHeld = false;
+  bool turboToggled = false;
+
+  // While fast-forwarding, audio may only run this far ahead of playback.
+  // Extra samples are dropped, so what is heard keeps its pitch and latency
+  // is back to normal as soon as fast-forward ends.
+  const size_t TURBO_AUDIO_LATENCY = 2048;
+
+  // Uncapped fast-forward emulates frames for this long per presented frame
+  const double TURBO_FRAME_BUDGET_MS = 14.0;
+
+  // Emulate one frame, feeding the audio ring buffer up to audioLimit samples
+  auto RunFrame = [&](size_t audioLimit) {
+    do {
+      nes.clock();
+
+      // Sample audio at correct rate
+      // Master clock is 3x CPU clock, so we need to account for that
+      audioSampleCounter += 1.0 / 3.0; // Convert PPU clocks to CPU cycles
+
+      if (audioSampleCounter >= CYCLES_PER_SAMPLE) {
+        audioSampleCounter -= CYCLES_PER_SAMPLE;
+
+        double rawSample = nes.GetAudioSample();
+
+        // Simple low-pass filter to reduce high-frequency noise
+        double filteredSample =
+            lastSample + FILTER_ALPHA * (rawSample - lastSample);
+        lastSample = filteredSample;
+
+        // Write to ring buffer (lock-free)
+        size_t writePos = audioWritePos.load(std::memory_order_relaxed);
+        size_t readPos = audioReadPos.load(std::memory_order_acquire);
+
+        // Only write if buffer not past the limit
+        if (writePos - readPos < audioLimit) {
+          audioBuffer[writePos % AUDIO_BUFFER_SIZE] =
+              (float)(filteredSample * 0.5);
+          audioWritePos.store(writePos + 1, std::memory_order_release);
+        }
+      }
+    } while (!nes.ppu.frame_complete);
+    nes.ppu.frame_complete = false;
+    if (ppuThread)
+      pThreadFrame = ppuThread->Submit();
+  };
+
   while (running) {
     display.HandleEvents(running, nes.controller[0], config, loadNewRom,
-                         newRomPath, menuCommand);
+                         newRomPath, menuCommand, turboHeld);
 
     if (menuCommand == ID_EMU_RESET && romLoaded) {
       nes.reset();
@@ -132,14 +227,30 @@ int main(int argc, char *argv[]) {
       paused = !paused;
       SDL_PauseAudioDevice(audioDevice, paused ? 1 : 0);
       std::cout << (paused ? "Paused" : "Resumed") << std::endl;
+    } else if (menuCommand == ID_EMU_TURBO) {
+      turboToggled = !turboToggled;
+      std::cout << "Fast forward " << (turboToggled ? "on" : "off")
+                << std::endl;
+    }
+#ifdef MGK_CPU_TRACE
+    else if (menuCommand == ID_DEBUG_TRACE) {
+      nes.cpu.DumpTrace("cpu_trace.log");
+      std::cout << "CPU trace written to cpu_trace.log" << std::endl;
     }
+#endif
+#ifdef MGK_CPU_PROFILE
+    else if (menuCommand == ID_DEBUG_PROFILE) {
+      nes.cpu.DumpProfile("cpu_profile.log");
+      std::cout << "CPU profile written to cpu_profile.log" << std::endl;
+    }
+#endif
 
     if (loadNewRom && !newRomPath.empty()) {
       loadNewRom = false;
       std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(newRomPath);
+      ReportCartridge(*cart);
       if (cart->ImageValid()) {
-        nes.insertCartridge(cart);
-        nes.reset();
+        InsertCartridge(cart);
         romLoaded = true;
         paused = false;
         audioWritePos = 0;
@@ -152,45 +263,47 @@ int main(int argc, char *argv[]) {
     }
 
     if (romLoaded && !paused) {
-      do {
-        nes.clock();
-
-        // Sample audio at correct rate
-        // Master clock is 3x CPU clock, so we need to account for that
-        audioSampleCounter += 1.0 / 3.0; // Convert PPU clocks to CPU cycles
-
-        if (audioSampleCounter >= CYCLES_PER_SAMPLE) {
-          audioSampleCounter -= CYCLES_PER_SAMPLE;
-
-          double rawSample = nes.GetAudioSample();
+      // Render straight into the display's texture when it can be locked
+      Pixel *pFrame = ppuThread ? nullptr : display.LockFrame();
+      nes.ppu.pScreen = pFrame ? pFrame : nes.ppu.screen.data();
 
-          // Simple low-pass filter to reduce high-frequency noise
-          double filteredSample =
-              lastSample + FILTER_ALPHA * (rawSample - lastSample);
-          lastSample = filteredSample;
-
-          // Write to ring buffer (lock-free)
-          size_t writePos = audioWritePos.load(std::memory_order_relaxed);
-          size_t readPos = audioReadPos.load(std::memory_order_acquire);
-
-          // Only write if buffer not full
-          if (writePos - readPos < AUDIO_BUFFER_SIZE - 1) {
-            audioBuffer[writePos % AUDIO_BUFFER_SIZE] =
-                (float)(filteredSample * 0.5);
-            audioWritePos.store(writePos + 1, std::memory_order_release);
-          }
-        }
-      } while (!nes.ppu.frame_complete);
-      nes.ppu.frame_complete = false;
+      if (!(turboHeld || turboToggled)) {
+        RunFrame(AUDIO_BUFFER_SIZE - 1);
+      } else if (config.turboSpeed > 0) {
+        // Fixed multiplier - only the last frame gets presented
+        for (int i = 0; i < config.turboSpeed; i++)
+          RunFrame(TURBO_AUDIO_LATENCY);
+      } else {
+        // Uncapped - emulate as many frames as fit in one vsync interval
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint64 budget = (Uint64)(TURBO_FRAME_BUDGET_MS *
+                                 SDL_GetPerformanceFrequency() / 1000.0);
+        do {
+          RunFrame(TURBO_AUDIO_LATENCY);
+        } while (SDL_GetPerformanceCounter() - start < budget);
+      }
     }
 
-    display.Update(nes.ppu.screen);
+    if (ppuThread) {
+      // The render thread's buffer is copied to the display
+      Pixel *pFrame = display.LockFrame();
+      if (pFrame)
+        std::copy(pThreadFrame, pThreadFrame + 256 * 240, pFrame);
+      display.Update(pFrame ? pFrame : pThreadFrame);
+    } else {
+      display.Update(nes.ppu.screen.data());
+    }
+    nes.ppu.pScreen = nes.ppu.screen.data();
   }
 
   if (audioDevice != 0) {
     SDL_CloseAudioDevice(audioDevice);
   }
 
+#ifdef MGK_CPU_PROFILE
+  nes.cpu.DumpProfile("cpu_profile.log");
+#endif
+
   config.Save("config.ini");
   display.Close();
   return 0;
@@ -0,0 +1,173 @@
+// Batch stepping benchmark
+//
+// Runs copies of one or more ROMs on a BatchRunner, first with threads
+// stealing machines from each other and then with every machine kept on the
+// thread it was dealt to. Reports each machine's frame rate and the
+// aggregate rate and thread utilization of both runs. Machines are stepped
+// with the same input in both, so each must end with the same RAM and frame
+// buffer; any difference is reported.
+//
+// Usage: batchbench <rom> [<rom> ...] [--copies N] [--frames N]
+//                   [--threads N] [--hold N] [--pin] [--jit]
+//   --copies N   machines per ROM (default 4)
+//   --frames N   frames to run (default 600)
+//   --threads N  worker threads (default one per hardware thread)
+//   --hold N     frames each random controller state is held (default 8)
+//   --pin        bind each worker thread to its own CPU
+//   --jit        enable the block translator
+
+#include "../src/BatchRunner.h"
+#include "../src/Bus.h"
+#include "../src/Cartridge.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Machine {
+  std::string sName;
+  std::shared_ptr<Cartridge> cart;
+  std::unique_ptr<Bus> bus;
+};
+
+static Machine MakeMachine(const char *sFileName, bool bJit) {
+  Machine m;
+  m.sName = sFileName;
+  size_t nSlash = m.sName.find_last_of("/\\");
+  if (nSlash != std::string::npos)
+    m.sName = m.sName.substr(nSlash + 1);
+  m.cart = std::make_shared<Cartridge>(sFileName);
+  m.bus = std::make_unique<Bus>();
+  m.bus->cpu.bJit = bJit;
+  m.bus->insertCartridge(m.cart);
+  m.bus->reset();
+  return m;
+}
+
+static uint8_t Input(size_t nMachine, uint64_t nFrame, int nHold) {
+  uint32_t h = (uint32_t)(nMachine + 1) * 2654435761u;
+  h ^= (uint32_t)(nFrame / nHold);
+  h ^= h >> 15;
+  h *= 2246822519u;
+  h ^= h >> 13;
+  return (uint8_t)h;
+}
+
+// FNV-1a
+static uint64_t Hash(uint64_t h, const void *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    h ^= ((const uint8_t *)p)[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static uint64_t HashMachine(Bus &nes) {
+  uint64_t h = Hash(1469598103934665603ull, nes.ram.data(), nes.ram.size());
+  return Hash(h, nes.ppu.screen.data(), nes.ppu.screen.size() * sizeof(Pixel));
+}
+
+struct Pass {
+  std::vector<Machine> vMachines;
+  std::vector<BatchRunner::MACHINE_STATS> vStats;
+  std::vector<uint64_t> vHashes;
+  double dWall = 0;
+  double dBusy = 0;
+  uint32_t nSteals = 0;
+  int nThreads = 0;
+};
+
+static void Batch(Pass &r, const std::vector<const char *> &vROMs, int nCopies,
+                  int nFrames, int nThreads, int nHold, bool bPin, bool bJit,
+                  bool bSteal) {
+  // Copies of a ROM are dealt to different threads
+  for (int c = 0; c < nCopies; c++)
+    for (const char *sROM : vROMs)
+      r.vMachines.push_back(MakeMachine(sROM, bJit));
+
+  BatchRunner batch(nThreads, bPin);
+  batch.bSteal = bSteal;
+  for (Machine &m : r.vMachines)
+    batch.Add(*m.bus);
+  batch.onFrame = [&](size_t n, uint64_t nFrame) {
+    r.vMachines[n].bus->controller[0] = Input(n, nFrame, nHold);
+  };
+  batch.Run(nFrames);
+
+  for (size_t i = 0; i < r.vMachines.size(); i++) {
+    r.vStats.push_back(batch.MachineStats(i));
+    r.vHashes.push_back(HashMachine(*r.vMachines[i].bus));
+  }
+  r.nThreads = batch.Threads();
+  r.dWall = batch.WallSeconds();
+  for (int t = 0; t < r.nThreads; t++) {
+    r.dBusy += batch.ThreadStats(t).dBusy;
+    r.nSteals += batch.ThreadStats(t).nSteals;
+  }
+}
+
+static void Report(const char *sName, const Pass &r) {
+  printf("  %-9s %8.1f ms  %8.0f frames/s  %3.0f%% busy  %u steals\n", sName,
+         r.dWall * 1000, r.vStats.size() * r.vStats[0].nFrames / r.dWall,
+         100 * r.dBusy / (r.dWall * r.nThreads), r.nSteals);
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<const char *> vROMs;
+  int nCopies = 4, nFrames = 600, nThreads = 0, nHold = 8;
+  bool bPin = false, bJit = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--copies") && i + 1 < argc)
+      nCopies = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+      nFrames = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      nThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--hold") && i + 1 < argc)
+      nHold = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--pin"))
+      bPin = true;
+    else if (!strcmp(argv[i], "--jit"))
+      bJit = true;
+    else
+      vROMs.push_back(argv[i]);
+  }
+  if (vROMs.empty()) {
+    std::cerr << "Usage: batchbench <rom> [<rom> ...] [--copies N] "
+                 "[--frames N] [--threads N] [--hold N] [--pin] [--jit]"
+              << std::endl;
+    return 2;
+  }
+  for (const char *sROM : vROMs) {
+    if (!MakeMachine(sROM, false).cart->ImageValid()) {
+      printf("FAIL  %s: unsupported or invalid image\n", sROM);
+      return 2;
+    }
+  }
+
+  Pass steal, fixed;
+  Batch(steal, vROMs, nCopies, nFrames, nThreads, nHold, bPin, bJit, true);
+  Batch(fixed, vROMs, nCopies, nFrames, nThreads, nHold, bPin, bJit, false);
+
+  printf("%zu machines x %d frames on %d threads%s%s\n",
+         steal.vMachines.size(), nFrames, steal.nThreads,
+         bPin ? ", pinned" : "", bJit ? ", translator on" : "");
+  int nFailed = 0;
+  for (size_t i = 0; i < steal.vMachines.size(); i++) {
+    const BatchRunner::MACHINE_STATS &s = steal.vStats[i];
+    printf("  %3zu %-20s %8.0f frames/s  %4u moves\n", i,
+           steal.vMachines[i].sName.c_str(), s.nFrames / s.dSeconds, s.nMoves);
+    if (steal.vHashes[i] != fixed.vHashes[i]) {
+      printf("FAIL  machine %zu: RAM or frame differs between the runs\n", i);
+      nFailed++;
+    }
+  }
+  Report("stealing", steal);
+  Report("fixed", fixed);
+  printf("%s\n", nFailed ? "FAIL" : "all machines match");
+  return nFailed ? 1 : 0;
+}
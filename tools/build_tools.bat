@@ -0,0 +1,37 @@
+@echo off
+set CORE=src/Bus.cpp src/CPU6502.cpp src/CPUJit.cpp src/CPULanes.cpp src/PPU2C02.cpp src/PPUThread.cpp src/PPUCompositor.cpp src/APU2A03.cpp src/Cartridge.cpp src/Mapper*.cpp
+
+echo Building testroms...
+g++ -O2 -std=c++17 -o testroms tools/testroms.cpp %CORE%
+if %errorlevel% neq 0 goto failed
+
+echo Building difftest...
+g++ -O2 -std=c++17 -o difftest tools/difftest.cpp %CORE%
+if %errorlevel% neq 0 goto failed
+
+echo Building lanebench...
+g++ -O2 -std=c++17 -o lanebench tools/lanebench.cpp %CORE%
+if %errorlevel% neq 0 goto failed
+
+echo Building batchbench...
+g++ -O2 -std=c++17 -o batchbench tools/batchbench.cpp src/BatchRunner.cpp %CORE%
+if %errorlevel% neq 0 goto failed
+
+echo Building libcheck...
+g++ -O2 -std=c++17 -DMGK_BUILD_LIBRARY -o libcheck tools/libcheck.cpp lib/mgkemu.cpp %CORE%
+if %errorlevel% neq 0 goto failed
+
+echo Building mapperbench...
+g++ -O2 -std=c++17 -o mapperbench tools/mapperbench.cpp src/Cartridge.cpp src/Mapper*.cpp
+if %errorlevel% neq 0 goto failed
+
+echo.
+echo Build successful!
+pause
+exit /b 0
+
+:failed
+echo.
+echo Build failed!
+pause
+exit /b 1
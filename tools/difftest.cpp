@@ -0,0 +1,308 @@
+// Lockstep differential tester
+//
+// Runs a ROM on two machines side by side, dot by dot: a reference one with
+// the fast paths that can be switched off switched off (per-dot PPU, no
+// idle dot skipping, no instruction cache, no translator, byte-wise OAM
+// DMA) and one configured like the emulator.
+//
+// Both machines share code with no switch, which is therefore not checked:
+// mapper bank slots (the host pointers reads go through), the PPU's page
+// table for pattern tables and nametables, and the sprite line buffer,
+// which the per-dot path draws from as well.
+//
+// Checks made:
+//   - CPU registers and cycle count whenever both CPUs are between
+//     instructions. Translated blocks run several instructions at once, so
+//     the reference may pass boundaries the fast machine does not stop at.
+//   - frame completion on the same dot, and the frame buffer hash
+//   - internal RAM and OAM at the first common instruction boundary after
+//     each frame with no OAM DMA under way in either machine, since a bulk
+//     transfer fills OAM at its start
+// On the first mismatch both states and the last instructions each machine
+// started (for translated code, the first of each block) are printed, and the
+// exit code is 1. The fast machine's PPU position is only read for that
+// report: reading it catches up skipped dots, which would keep them from
+// being skipped in bulk.
+//
+// With --ppu-thread the fast machine draws on a render thread (PPUThread),
+// whose frames arrive one late and are checked against the reference's
+// previous one.
+//
+// Usage: difftest <rom> [--frames N] [--movie FILE] [--trace N] [--no-jit]
+//                [--ppu-thread]
+//   --frames N   frames to run (default 600)
+//   --movie FILE controller input, one line per frame: "<pad1> [<pad2>]" as
+//                hex bytes in Bus::controller format; '#' starts a comment
+//   --trace N    instructions kept per machine for the report (default 32)
+//   --no-jit     leave the translator off in the fast machine
+//   --ppu-thread draw the fast machine's frames on a render thread
+
+#include "../src/Bus.h"
+#include "../src/Cartridge.h"
+#include "../src/PPUThread.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct CPUState {
+  uint16_t pc;
+  uint8_t a, x, y, st, sp;
+  uint32_t cycle;
+  int16_t scanline, dot;
+
+  bool operator==(const CPUState &o) const {
+    return pc == o.pc && a == o.a && x == o.x && y == o.y && st == o.st &&
+           sp == o.sp && cycle == o.cycle;
+  }
+};
+
+// Registers only. Asking the fast machine's PPU for its position would make
+// it catch up skipped dots there and then, one at a time, so the spans it
+// skips in one go would never run.
+static CPUState Registers(Bus &nes) {
+  return {nes.cpu.pc, nes.cpu.a,  nes.cpu.x,           nes.cpu.y,
+          nes.cpu.st, nes.cpu.sp, nes.cpu.clock_count, 0,
+          0};
+}
+
+// With the PPU position, for the reference and for reports
+static CPUState Capture(Bus &nes) {
+  CPUState s = Registers(nes);
+  s.scanline = nes.ppu.GetScanline();
+  s.dot = nes.ppu.GetCycle();
+  return s;
+}
+
+// Last instructions a machine started, oldest first when printed
+struct Trace {
+  std::vector<CPUState> ring;
+  size_t nCount = 0;
+
+  explicit Trace(size_t n) : ring(n) {}
+  void Push(const CPUState &s) {
+    if (!ring.empty())
+      ring[nCount++ % ring.size()] = s;
+  }
+  void Print(Bus &nes, const char *sName) const {
+    printf("last instructions started (%s):\n", sName);
+    size_t first = nCount > ring.size() ? nCount - ring.size() : 0;
+    for (size_t n = first; n < nCount; n++) {
+      const CPUState &s = ring[n % ring.size()];
+      printf("  %04X  %02X %02X %02X  A:%02X X:%02X Y:%02X P:%02X SP:%02X "
+             "PPU:%3d,%3d CYC:%u\n",
+             s.pc, nes.read(s.pc, true), nes.read(s.pc + 1, true),
+             nes.read(s.pc + 2, true), s.a, s.x, s.y, s.st, s.sp, s.scanline,
+             s.dot, s.cycle);
+    }
+  }
+};
+
+static void PrintState(const char *sName, const CPUState &s, uint32_t nCycles) {
+  printf("%-9s PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%u "
+         "PPU:%d,%d (instruction cycles left %u)\n",
+         sName, s.pc, s.a, s.x, s.y, s.st, s.sp, s.cycle, s.scanline, s.dot,
+         nCycles);
+}
+
+static void PrintMemoryDiff(const char *sName, const uint8_t *ref,
+                            const uint8_t *fast, size_t n) {
+  int nShown = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (ref[i] == fast[i])
+      continue;
+    if (nShown++ == 16) {
+      printf("  ...\n");
+      break;
+    }
+    printf("  %s $%04zX: reference %02X, fast %02X\n", sName, i, ref[i],
+           fast[i]);
+  }
+}
+
+static uint64_t HashScreen(const Pixel *screen) {
+  // FNV-1a over the RGBA frame buffer
+  const uint8_t *p = (const uint8_t *)screen;
+  uint64_t h = 1469598103934665603ull;
+  for (size_t i = 0; i < 256 * 240 * sizeof(Pixel); i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static std::vector<uint16_t> LoadMovie(const std::string &sFileName) {
+  std::vector<uint16_t> vInput;
+  std::ifstream ifs(sFileName);
+  std::string sLine;
+  while (std::getline(ifs, sLine)) {
+    sLine = sLine.substr(0, sLine.find('#'));
+    std::istringstream ss(sLine);
+    std::string sPad1, sPad2;
+    if (!(ss >> sPad1))
+      continue;
+    ss >> sPad2;
+    uint16_t pad1 = (uint16_t)strtoul(sPad1.c_str(), nullptr, 16) & 0xFF;
+    uint16_t pad2 = (uint16_t)strtoul(sPad2.c_str(), nullptr, 16) & 0xFF;
+    vInput.push_back(pad2 << 8 | pad1);
+  }
+  return vInput;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: difftest <rom> [--frames N] [--movie FILE] "
+                 "[--trace N] [--no-jit] [--ppu-thread]"
+              << std::endl
+              << "Not checked, as both machines use them: mapper bank slots, "
+                 "the PPU page table and the sprite line buffer"
+              << std::endl;
+    return 2;
+  }
+
+  int nFrames = 600;
+  size_t nTrace = 32;
+  bool bJit = true, bThread = false;
+  std::vector<uint16_t> vMovie;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+      nFrames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--movie") && i + 1 < argc)
+      vMovie = LoadMovie(argv[++i]);
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+      nTrace = (size_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--no-jit"))
+      bJit = false;
+    else if (!strcmp(argv[i], "--ppu-thread"))
+      bThread = true;
+  }
+
+  // Each machine gets its own cartridge, mappers hold state
+  auto cartRef = std::make_shared<Cartridge>(argv[1]);
+  auto cartFast = std::make_shared<Cartridge>(argv[1]);
+  if (!cartRef->ImageValid()) {
+    printf("FAIL  %s: unsupported or invalid image\n", argv[1]);
+    return 2;
+  }
+
+  auto ref = std::make_unique<Bus>();
+  ref->ppu.bLineMode = false;
+  ref->ppu.bIdleSkip = false;
+  ref->cpu.bDecodeCache = false;
+  ref->cpu.bJit = false;
+  ref->bBulkDMA = false;
+  auto fast = std::make_unique<Bus>();
+  fast->cpu.bJit = bJit;
+
+  ref->insertCartridge(cartRef);
+  fast->insertCartridge(cartFast);
+  ref->reset();
+  fast->reset();
+
+  std::unique_ptr<PPUThread> thread;
+  uint64_t nLastRefScreen = HashScreen(ref->ppu.screen.data());
+  if (bThread) {
+    thread = std::make_unique<PPUThread>(fast->ppu, *cartFast);
+    if (!thread->Active()) {
+      printf("FAIL  %s: the mapper cannot use a render thread\n", argv[1]);
+      return 2;
+    }
+  }
+
+  Trace traceRef(nTrace), traceFast(nTrace);
+  std::string sError;
+  bool bMemoryDue = false;
+  uint32_t nLastCompared = UINT32_MAX;
+  int nFrame = 0;
+  uint64_t nInstructions = 0;
+
+  while (nFrame < nFrames && sError.empty()) {
+    uint16_t input = nFrame < (int)vMovie.size() ? vMovie[nFrame] : 0;
+    for (Bus *nes : {ref.get(), fast.get()}) {
+      nes->controller[0] = input & 0xFF;
+      nes->controller[1] = input >> 8;
+    }
+
+    bool bFrameDone = false;
+    while (!bFrameDone && sError.empty()) {
+      // Both between instructions: everything the CPUs can see must match
+      bool bRefIdle = ref->cpu.cycles == 0;
+      bool bFastIdle = fast->cpu.cycles == 0;
+      if (bFastIdle && !bRefIdle) {
+        sError = "fast CPU is between instructions, reference is not";
+      } else if (bRefIdle && !bFastIdle && !bJit) {
+        sError = "reference CPU is between instructions, fast is not";
+      } else if (bRefIdle && bFastIdle &&
+                 ref->cpu.clock_count != nLastCompared) {
+        nLastCompared = ref->cpu.clock_count;
+        if (!(Registers(*ref) == Registers(*fast)))
+          sError = "CPU registers differ";
+        else if (bMemoryDue && !ref->DMABusy() && !fast->DMABusy()) {
+          bMemoryDue = false;
+          if (ref->ram != fast->ram)
+            sError = "internal RAM differs";
+          else if (memcmp(ref->ppu.OAM, fast->ppu.OAM, 256))
+            sError = "OAM differs";
+        }
+      }
+      if (!sError.empty())
+        break;
+
+      // The machines run in lockstep, so the fast one is where the
+      // reference is
+      CPUState preRef = Capture(*ref), preFast = Registers(*fast);
+      preFast.scanline = preRef.scanline;
+      preFast.dot = preRef.dot;
+      uint32_t nClockRef = ref->cpu.clock_count;
+      uint32_t nClockFast = fast->cpu.clock_count;
+      ref->clock();
+      fast->clock();
+      if (bRefIdle && ref->cpu.clock_count != nClockRef) {
+        traceRef.Push(preRef);
+        nInstructions++;
+      }
+      if (bFastIdle && fast->cpu.clock_count != nClockFast)
+        traceFast.Push(preFast);
+
+      if (ref->ppu.frame_complete != fast->ppu.frame_complete) {
+        sError = "frames complete on different dots";
+      } else if (ref->ppu.frame_complete) {
+        ref->ppu.frame_complete = false;
+        fast->ppu.frame_complete = false;
+        if (thread) {
+          // The previous frame, drawn on the render thread
+          if (HashScreen(thread->Submit()) != nLastRefScreen)
+            sError = "frame buffers differ";
+          nLastRefScreen = HashScreen(ref->ppu.screen.data());
+        } else if (HashScreen(ref->ppu.screen.data()) !=
+                   HashScreen(fast->ppu.screen.data())) {
+          sError = "frame buffers differ";
+        }
+        bMemoryDue = true;
+        bFrameDone = true;
+      }
+    }
+    if (sError.empty())
+      nFrame++;
+  }
+
+  if (sError.empty()) {
+    printf("pass  %s: %d frames, %llu instructions in lockstep\n", argv[1],
+           nFrame, (unsigned long long)nInstructions);
+    return 0;
+  }
+
+  printf("FAIL  %s: %s in frame %d\n", argv[1], sError.c_str(), nFrame);
+  PrintState("reference", Capture(*ref), ref->cpu.cycles);
+  PrintState("fast", Capture(*fast), fast->cpu.cycles);
+  PrintMemoryDiff("RAM", ref->ram.data(), fast->ram.data(), ref->ram.size());
+  PrintMemoryDiff("OAM", ref->ppu.OAM, fast->ppu.OAM, 256);
+  traceRef.Print(*ref, "reference");
+  traceFast.Print(*fast, "fast");
+  return 1;
+}
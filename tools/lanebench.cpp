@@ -0,0 +1,210 @@
+// Lockstep engine benchmark
+//
+// Runs N copies of a ROM with different controller input, first as lanes of
+// one CPULanes engine and then one machine after another on their own, and
+// reports the time for each. The independent runs replay the same dots and
+// input changes, so every lane has to end with the same registers, RAM and
+// frame buffer as its independent run; any difference is reported.
+//
+// Usage: lanebench <rom> [--lanes N] [--frames N] [--hold N] [--jit]
+//   --lanes N   machines (default 16)
+//   --frames N  frames to run (default 600)
+//   --hold N    frames each random controller state is held (default 8);
+//               lane 0 never presses anything
+//   --jit       enable the block translator in both runs
+
+#include "../src/Bus.h"
+#include "../src/CPULanes.h"
+#include "../src/Cartridge.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Lane {
+  std::shared_ptr<Cartridge> cart;
+  std::unique_ptr<Bus> bus;
+};
+
+static Lane MakeLane(const char *sFileName, bool bJit) {
+  Lane l;
+  l.cart = std::make_shared<Cartridge>(sFileName);
+  l.bus = std::make_unique<Bus>();
+  l.bus->cpu.bJit = bJit;
+  l.bus->insertCartridge(l.cart);
+  l.bus->reset();
+  return l;
+}
+
+static uint8_t Input(int nLane, int nFrame, int nHold) {
+  if (nLane == 0)
+    return 0;
+  uint32_t h = (uint32_t)nLane * 2654435761u ^ (uint32_t)(nFrame / nHold);
+  h ^= h >> 15;
+  h *= 2246822519u;
+  h ^= h >> 13;
+  return (uint8_t)h;
+}
+
+// FNV-1a
+static uint64_t Hash(uint64_t h, const void *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    h ^= ((const uint8_t *)p)[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static uint64_t HashScreen(Bus &nes) {
+  return Hash(1469598103934665603ull, nes.ppu.screen.data(),
+              nes.ppu.screen.size() * sizeof(Pixel));
+}
+
+static uint64_t HashCPU(Bus &nes) {
+  uint8_t regs[] = {nes.cpu.a,  nes.cpu.x,  nes.cpu.y,
+                    nes.cpu.st, nes.cpu.sp, (uint8_t)(nes.cpu.pc >> 8),
+                    (uint8_t)nes.cpu.pc};
+  uint64_t h = Hash(1469598103934665603ull, regs, sizeof(regs));
+  return Hash(h, nes.ram.data(), nes.ram.size());
+}
+
+// A lane in a group has run ahead to the end of its last instruction, so its
+// CPU and RAM are compared with the independent run at that cycle
+struct Result {
+  uint64_t nScreen = 0;
+  uint64_t nCPU = 0;
+  uint32_t nCycle = 0; // CPU cycle the next instruction starts on
+};
+
+static double Seconds(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: lanebench <rom> [--lanes N] [--frames N] [--hold N] "
+                 "[--jit]"
+              << std::endl;
+    return 2;
+  }
+
+  int nLanes = 16, nFrames = 600, nHold = 8;
+  bool bJit = false;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--lanes") && i + 1 < argc)
+      nLanes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+      nFrames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--hold") && i + 1 < argc)
+      nHold = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--jit"))
+      bJit = true;
+  }
+
+  if (!MakeLane(argv[1], false).cart->ImageValid()) {
+    printf("FAIL  %s: unsupported or invalid image\n", argv[1]);
+    return 2;
+  }
+
+  // Lockstep, remembering the dot each frame ended on for the replay
+  std::vector<uint64_t> vFrameEnd;
+  std::vector<Result> vLockstep;
+  double tLockstep;
+  uint64_t nGroup, nLaneInstr;
+  {
+    std::vector<Lane> vLane;
+    CPULanes lanes;
+    for (int i = 0; i < nLanes; i++) {
+      vLane.push_back(MakeLane(argv[1], bJit));
+      lanes.Attach(*vLane.back().bus);
+    }
+
+    uint64_t nDots = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int f = 0; f < nFrames; f++) {
+      for (int i = 0; i < nLanes; i++)
+        vLane[i].bus->controller[0] = Input(i, f, nHold);
+      // Frame() by hand, counting dots
+      int nDone = 0;
+      std::vector<bool> vDone(nLanes);
+      while (nDone < nLanes) {
+        lanes.Clock();
+        nDots++;
+        for (int i = 0; i < nLanes; i++) {
+          if (!vDone[i] && vLane[i].bus->ppu.frame_complete) {
+            vDone[i] = true;
+            nDone++;
+            vLane[i].bus->ppu.frame_complete = false;
+          }
+        }
+      }
+      vFrameEnd.push_back(nDots);
+    }
+    tLockstep = Seconds(t0);
+    for (Lane &l : vLane) {
+      Result r;
+      r.nScreen = HashScreen(*l.bus);
+      r.nCPU = HashCPU(*l.bus);
+      r.nCycle = l.bus->cpu.clock_count + l.bus->cpu.cycles;
+      vLockstep.push_back(r);
+    }
+    nGroup = lanes.nGroupInstructions;
+    nLaneInstr = lanes.nLaneInstructions;
+  }
+
+  // The same lanes on their own
+  std::vector<Result> vAlone;
+  double tAlone;
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nLanes; i++) {
+      Lane l = MakeLane(argv[1], bJit);
+      uint64_t nDots = 0;
+      for (int f = 0; f < nFrames; f++) {
+        l.bus->controller[0] = Input(i, f, nHold);
+        for (; nDots < vFrameEnd[f]; nDots++)
+          l.bus->clock();
+      }
+      Result r;
+      r.nScreen = HashScreen(*l.bus);
+      // Up to the lane's instruction boundary, a few dots at most
+      CPU6502 &cpu = l.bus->cpu;
+      uint32_t nCycle = vLockstep[i].nCycle;
+      while (cpu.clock_count <= nCycle &&
+             (cpu.clock_count < nCycle || cpu.cycles != 0))
+        l.bus->clock();
+      r.nCPU = HashCPU(*l.bus);
+      vAlone.push_back(r);
+    }
+    tAlone = Seconds(t0);
+  }
+
+  int nFailed = 0;
+  for (int i = 0; i < nLanes; i++) {
+    const Result &r = vLockstep[i], &q = vAlone[i];
+    if (r.nScreen != q.nScreen || r.nCPU != q.nCPU) {
+      printf("FAIL  lane %d: %s differs from its independent run\n", i,
+             r.nScreen != q.nScreen ? "frame" : "CPU or RAM");
+      nFailed++;
+    }
+  }
+
+  double nTotal = (double)nLanes * nFrames;
+  printf("%s: %d lanes x %d frames%s\n", argv[1], nLanes, nFrames,
+         bJit ? ", translator on" : "");
+  printf("  lockstep     %8.1f ms  %8.0f frames/s\n", tLockstep * 1000,
+         nTotal / tLockstep);
+  printf("  independent  %8.1f ms  %8.0f frames/s\n", tAlone * 1000,
+         nTotal / tAlone);
+  printf("  grouped instructions per lane and frame %.0f, average group %.1f "
+         "lanes\n",
+         nLaneInstr / nTotal, nGroup ? (double)nLaneInstr / nGroup : 0.0);
+  printf("%s\n", nFailed ? "FAIL" : "all lanes match");
+  return nFailed ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// Library frame output check
+//
+// Drives ROMs through lib/mgkemu.h and checks the frames mgk_step leaves
+// with max_pool against frames drawn one at a time by a second instance:
+// after each step the buffer must hold the per-byte maximum of the step's
+// last two frames (the first frame after loading has none before it). The
+// pooled instance draws every step into the next buffer of a ring, as
+// lib/mgkshm.cpp does, and the buffers start out filled with 0xFF, so a frame
+// pooled with what a buffer held before shows up.
+//
+// Usage: libcheck <rom> [<rom> ...] [--steps N]
+//   --steps N  steps per output format and step length (default 120)
+
+#include "../lib/mgkemu.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static const int kSlots = 4;
+
+static bool Check(const std::vector<char> &vROM, int nFormat, int nScale,
+                  int nFramesPerStep, int nSteps, std::string &sError) {
+  mgk_emu *pooled = mgk_create(), *single = mgk_create();
+  size_t nSize = (size_t)(MGK_WIDTH / nScale) * (MGK_HEIGHT / nScale) *
+                 (nFormat == MGK_FORMAT_RGBA ? 4 : 1);
+  std::vector<std::vector<uint8_t>> vSlots(kSlots,
+                                           std::vector<uint8_t>(nSize, 0xFF));
+  std::vector<uint8_t> vLast(nSize, 0), vBefore(nSize, 0);
+  bool bOk = mgk_load_rom(pooled, vROM.data(), vROM.size()) == MGK_OK &&
+             mgk_load_rom(single, vROM.data(), vROM.size()) == MGK_OK &&
+             mgk_set_output(single, nFormat, nScale, nullptr) == MGK_OK;
+  if (!bOk)
+    sError = "cannot load";
+
+  for (int n = 0; n < nSteps && bOk; n++) {
+    uint8_t buttons = (uint8_t)((n / 4) * 37);
+    for (int f = 0; f < nFramesPerStep; f++) {
+      mgk_step(single, buttons, 1, 0, nullptr);
+      vBefore = vLast;
+      memcpy(vLast.data(), mgk_framebuffer(single), nSize);
+    }
+
+    uint8_t *pSlot = vSlots[n % kSlots].data();
+    mgk_set_output(pooled, nFormat, nScale, pSlot);
+    mgk_step(pooled, buttons, nFramesPerStep, 1, nullptr);
+    for (size_t i = 0; i < nSize && bOk; i++) {
+      if (pSlot[i] != std::max(vLast[i], vBefore[i])) {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "step %d byte %zu: %02X, expected %02X", n,
+                 i, pSlot[i], std::max(vLast[i], vBefore[i]));
+        sError = buf;
+        bOk = false;
+      }
+    }
+  }
+  mgk_destroy(pooled);
+  mgk_destroy(single);
+  return bOk;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<const char *> vROMs;
+  int nSteps = 120;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--steps") && i + 1 < argc)
+      nSteps = std::max(1, atoi(argv[++i]));
+    else
+      vROMs.push_back(argv[i]);
+  }
+  if (vROMs.empty()) {
+    std::cerr << "Usage: libcheck <rom> [<rom> ...] [--steps N]" << std::endl;
+    return 2;
+  }
+
+  static const struct {
+    const char *sName;
+    int nFormat, nScale;
+  } kOutputs[] = {
+      {"rgba", MGK_FORMAT_RGBA, 1},
+      {"gray/2", MGK_FORMAT_GRAY, 2},
+      {"index/4", MGK_FORMAT_INDEX, 4},
+  };
+
+  int nFailed = 0;
+  for (const char *sROM : vROMs) {
+    std::ifstream ifs(sROM, std::ios::binary);
+    std::vector<char> vROM((std::istreambuf_iterator<char>(ifs)),
+                           std::istreambuf_iterator<char>());
+    for (const auto &o : kOutputs) {
+      for (int nFrames : {1, 3}) {
+        std::string sError;
+        bool bPass =
+            Check(vROM, o.nFormat, o.nScale, nFrames, nSteps, sError);
+        printf("%s  %-20s %-8s %d frame%s per step  %s\n",
+               bPass ? "pass" : "FAIL", sROM, o.sName, nFrames,
+               nFrames > 1 ? "s" : " ", sError.c_str());
+        if (!bPass)
+          nFailed++;
+      }
+    }
+  }
+  return nFailed ? 1 : 0;
+}
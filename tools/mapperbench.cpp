@@ -0,0 +1,127 @@
+// Mapper microbenchmark
+//
+// Builds a synthetic iNES image for each supported mapper and times the
+// cartridge read paths the CPU and PPU use on every access:
+//   PRG  - Cartridge::cpuRead over $8000-$FFFF
+//   CHR  - Cartridge::ppuRead over $0000-$1FFF
+//   NT   - Cartridge::ppuRead over $2000-$2FFF (nametables, which the PPU
+//          offers to the cartridge first)
+//   miss - Cartridge::cpuRead over $0000-$07FF (internal RAM, which the Bus
+//          offers to the cartridge first)
+//
+// Usage: mapperbench [million reads per test, default 50]
+
+#include "../src/Cartridge.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct BenchROM {
+  uint8_t nMapperID;
+  uint8_t nPRGBanks; // 16KB units
+  uint8_t nCHRBanks; // 8KB units, 0 = CHR RAM
+  const char *sName;
+};
+
+static std::string WriteROM(const BenchROM &rom) {
+  std::string sPath =
+      (fs::temp_directory_path() /
+       ("mapperbench_" + std::to_string(rom.nMapperID) + ".nes"))
+          .string();
+
+  std::ofstream ofs(sPath, std::ofstream::binary);
+  uint8_t header[16] = {'N', 'E', 'S', 0x1A, rom.nPRGBanks, rom.nCHRBanks,
+                        (uint8_t)((rom.nMapperID & 0x0F) << 4),
+                        (uint8_t)(rom.nMapperID & 0xF0)};
+  ofs.write((char *)header, sizeof(header));
+
+  std::vector<uint8_t> data(rom.nPRGBanks * 16384 + rom.nCHRBanks * 8192);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (uint8_t)(i * 7 + (i >> 8));
+  ofs.write((char *)data.data(), data.size());
+  return sPath;
+}
+
+template <typename F>
+static double TimeReads(const std::vector<uint16_t> &addrs, long long nReads,
+                        F read, uint32_t &nSink) {
+  auto t0 = std::chrono::steady_clock::now();
+  size_t mask = addrs.size() - 1;
+  for (long long i = 0; i < nReads; i++) {
+    uint8_t data = 0;
+    read(addrs[i & mask], data);
+    nSink += data;
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count();
+  return ns / nReads;
+}
+
+int main(int argc, char *argv[]) {
+  long long nReads = (argc > 1 ? atoll(argv[1]) : 50) * 1000000LL;
+
+  const BenchROM roms[] = {
+      {0, 2, 1, "NROM"},   {1, 8, 16, "MMC1"},  {2, 8, 0, "UxROM"},
+      {4, 8, 16, "MMC3"},  {5, 8, 16, "MMC5"},  {69, 8, 16, "FME-7"},
+  };
+
+  // Same pseudo-random address stream for every mapper
+  std::vector<uint16_t> prgAddrs(65536), chrAddrs(65536), ntAddrs(65536),
+      ramAddrs(65536);
+  uint32_t lcg = 12345;
+  for (size_t i = 0; i < prgAddrs.size(); i++) {
+    lcg = lcg * 1664525 + 1013904223;
+    prgAddrs[i] = 0x8000 | ((lcg >> 8) & 0x7FFF);
+    chrAddrs[i] = (lcg >> 12) & 0x1FFF;
+    ntAddrs[i] = 0x2000 | ((lcg >> 4) & 0x0FFF);
+    ramAddrs[i] = (lcg >> 16) & 0x07FF;
+  }
+
+  uint32_t nSink = 0;
+  printf("%-8s %10s %10s %10s %10s\n", "Mapper", "PRG ns", "CHR ns", "NT ns",
+         "miss ns");
+  for (const BenchROM &rom : roms) {
+    std::string sPath = WriteROM(rom);
+
+    auto cart = std::make_shared<Cartridge>(sPath);
+    fs::remove(sPath);
+
+    if (!cart->ImageValid()) {
+      printf("%-8s unsupported\n", rom.sName);
+      continue;
+    }
+    cart->reset();
+
+    // Stand-in for the PPU's nametable RAM, which MMC5 maps itself
+    static uint8_t ciram[2048];
+    cart->ConnectCIRAM(ciram);
+
+    double prg = TimeReads(
+        prgAddrs, nReads,
+        [&](uint16_t a, uint8_t &d) { cart->cpuRead(a, d); }, nSink);
+    double chr = TimeReads(
+        chrAddrs, nReads,
+        [&](uint16_t a, uint8_t &d) { cart->ppuRead(a, d); }, nSink);
+    double nt = TimeReads(
+        ntAddrs, nReads,
+        [&](uint16_t a, uint8_t &d) { cart->ppuRead(a, d); }, nSink);
+    double miss = TimeReads(
+        ramAddrs, nReads,
+        [&](uint16_t a, uint8_t &d) { cart->cpuRead(a, d); }, nSink);
+
+    printf("%-8s %10.2f %10.2f %10.2f %10.2f\n", rom.sName, prg, chr, nt,
+           miss);
+  }
+
+  // Keep the reads from being optimised away
+  return nSink == 0x12345678 ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+// Headless test ROM runner
+//
+// Runs every .nes file found under a directory and reports pass/fail and
+// wall time per ROM. Results are detected in one of three ways:
+//   - nestest.nes runs in automation mode from $C000; the error codes are
+//     read from $02/$03 when it reaches its final RTS. Only $02, the
+//     official opcodes, decides: $03 reports the unofficial ones, which this
+//     CPU runs as NOPs, and is shown as a known unsupported result.
+//   - <rom>.hash next to the ROM holds "<frames> <hash>"; the screen is
+//     hashed after that many frames
+//   - otherwise the $6000 status protocol used by blargg's test ROMs
+//     (signature DE B0 61 at $6001, status at $6000, text at $6004)
+//
+// Usage: testroms <dir> [--frames N] [--budget MS] [--record]
+//   --frames N   frame limit per ROM (default 3600, one minute emulated)
+//   --budget MS  also fail any ROM that takes longer than MS to run
+//   --record     write <rom>.hash for ROMs without a status result
+
+#include "../src/Bus.h"
+#include "../src/Cartridge.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct TestResult {
+  bool bPass = false;
+  std::string sMessage;
+  int nFrames = 0;
+};
+
+static void RunFrame(Bus &nes) {
+  do {
+    nes.clock();
+  } while (!nes.ppu.frame_complete);
+  nes.ppu.frame_complete = false;
+}
+
+static uint64_t HashScreen(Bus &nes) {
+  // FNV-1a over the RGBA frame buffer
+  const uint8_t *p = (const uint8_t *)nes.ppu.screen.data();
+  uint64_t h = 1469598103934665603ull;
+  for (size_t i = 0; i < nes.ppu.screen.size() * sizeof(Pixel); i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static TestResult RunNestest(Bus &nes, int nMaxFrames) {
+  TestResult r;
+
+  // Automation mode: start at $C000, finished when PC reaches the final RTS
+  nes.cpu.pc = 0xC000;
+  const int nDotsPerFrame = 341 * 262;
+  long long nMaxDots = (long long)nMaxFrames * nDotsPerFrame;
+  long long nDots = 0;
+  while (nes.cpu.pc != 0xC66E && nDots < nMaxDots) {
+    nes.clock();
+    nDots++;
+  }
+  r.nFrames = (int)(nDots / nDotsPerFrame) + 1;
+
+  if (nes.cpu.pc != 0xC66E) {
+    r.sMessage = "timed out";
+    return r;
+  }
+
+  char buf[96];
+  snprintf(buf, sizeof(buf), "$02=%02X $03=%02X%s", nes.ram[0x02],
+           nes.ram[0x03],
+           nes.ram[0x03] ? " (unofficial opcodes, not supported)" : "");
+  r.sMessage = buf;
+  r.bPass = nes.ram[0x02] == 0x00;
+  return r;
+}
+
+static TestResult RunScreenHash(Bus &nes, int nFrames, uint64_t nExpected) {
+  TestResult r;
+  for (r.nFrames = 0; r.nFrames < nFrames; r.nFrames++)
+    RunFrame(nes);
+
+  uint64_t h = HashScreen(nes);
+  char buf[64];
+  snprintf(buf, sizeof(buf), "screen %016llx", (unsigned long long)h);
+  r.sMessage = buf;
+  r.bPass = h == nExpected;
+  return r;
+}
+
+static TestResult RunStatusProtocol(Bus &nes, int nMaxFrames, bool &bGotResult) {
+  TestResult r;
+  int nResetDelay = -1;
+  bGotResult = false;
+
+  for (r.nFrames = 0; r.nFrames < nMaxFrames; r.nFrames++) {
+    RunFrame(nes);
+
+    // Reset requested: wait at least 100ms before pressing it
+    if (nResetDelay >= 0) {
+      if (nResetDelay-- == 0)
+        nes.reset();
+      continue;
+    }
+
+    if (nes.read(0x6001, true) != 0xDE || nes.read(0x6002, true) != 0xB0 ||
+        nes.read(0x6003, true) != 0x61)
+      continue;
+
+    uint8_t status = nes.read(0x6000, true);
+    if (status == 0x80)
+      continue;
+    if (status == 0x81) {
+      nResetDelay = 6;
+      continue;
+    }
+
+    // Finished - collect the result text
+    std::string text;
+    for (uint16_t addr = 0x6004; addr < 0x7FFF; addr++) {
+      uint8_t c = nes.read(addr, true);
+      if (c == 0x00)
+        break;
+      text += (c == '\n') ? ' ' : (char)c;
+    }
+    while (!text.empty() && text.back() == ' ')
+      text.pop_back();
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "$%02X ", status);
+    r.sMessage = buf + text;
+    r.bPass = status == 0x00;
+    bGotResult = true;
+    r.nFrames++;
+    return r;
+  }
+
+  r.sMessage = "no result";
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: testroms <dir> [--frames N] [--budget MS] [--record]"
+              << std::endl;
+    return 2;
+  }
+
+  std::string sDir = argv[1];
+  int nMaxFrames = 3600;
+  double dBudget = 0.0;
+  bool bRecord = false;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+      nMaxFrames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+      dBudget = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--record"))
+      bRecord = true;
+  }
+
+  std::vector<fs::path> roms;
+  std::error_code ec;
+  for (auto &entry : fs::recursive_directory_iterator(sDir, ec)) {
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (entry.is_regular_file() && ext == ".nes")
+      roms.push_back(entry.path());
+  }
+  std::sort(roms.begin(), roms.end());
+
+  if (roms.empty()) {
+    std::cerr << "No .nes files found in " << sDir << std::endl;
+    return 2;
+  }
+
+  int nPassed = 0;
+  double dTotal = 0.0;
+  for (auto &rom : roms) {
+    std::string sName = fs::relative(rom, sDir, ec).generic_string();
+
+    auto cart = std::make_shared<Cartridge>(rom.string());
+
+    if (!cart->ImageValid()) {
+      printf("FAIL  %-40s unsupported or invalid image\n", sName.c_str());
+      continue;
+    }
+
+    auto nes = std::make_unique<Bus>();
+    nes->insertCartridge(cart);
+    nes->reset();
+
+    fs::path hashFile = rom;
+    hashFile.replace_extension(".hash");
+
+    auto t0 = std::chrono::steady_clock::now();
+    TestResult r;
+    if (rom.filename() == "nestest.nes") {
+      r = RunNestest(*nes, nMaxFrames);
+    } else if (std::ifstream ifs{hashFile}) {
+      int nFrames = 0;
+      std::string sHash;
+      ifs >> nFrames >> sHash;
+      r = RunScreenHash(*nes, nFrames, strtoull(sHash.c_str(), nullptr, 16));
+    } else {
+      bool bGotResult = false;
+      r = RunStatusProtocol(*nes, nMaxFrames, bGotResult);
+      if (!bGotResult && bRecord) {
+        std::ofstream ofs(hashFile);
+        ofs << r.nFrames << " " << std::hex << HashScreen(*nes) << std::endl;
+        r.sMessage = "recorded " + hashFile.filename().string();
+        r.bPass = true;
+      }
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+
+    if (dBudget > 0.0 && ms > dBudget) {
+      r.bPass = false;
+      r.sMessage += " (over time budget)";
+    }
+
+    printf("%s  %-40s %7.0fms %5d frames %5.0f fps  %s\n",
+           r.bPass ? "pass" : "FAIL", sName.c_str(), ms, r.nFrames,
+           r.nFrames * 1000.0 / std::max(ms, 0.001), r.sMessage.c_str());
+    fflush(stdout);
+
+    dTotal += ms;
+    if (r.bPass)
+      nPassed++;
+  }
+
+  printf("\n%d/%d passed, %.0fms total\n", nPassed, (int)roms.size(), dTotal);
+  return nPassed == (int)roms.size() ? 0 : 1;
+}